@@ -2,6 +2,7 @@
 // See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
 
 #include "UE4VoiceChatModule.h"
+#include "VoiceChatDeviceCache.h"
 #include "Core.h"
 #include "Modules/ModuleManager.h"
 //#include "Interfaces/IPluginManager.h"
@@ -19,7 +20,7 @@ void FUE4VoiceChat::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
-
+	FVoiceChatDeviceCache::Destroy();
 }
 
 #undef LOCTEXT_NAMESPACE
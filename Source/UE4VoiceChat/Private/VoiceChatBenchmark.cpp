@@ -0,0 +1,854 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "Async/Async.h"
+#include "VoiceModule.h"
+#include "VoiceChatRingBuffer.h"
+#include "VoiceChatRelay.h"
+#include "VoiceChatComponent.h"
+#include "VoiceChatSyntheticCapture.h"
+#include "VoiceChatDSP.h"
+#include "VoiceChatDeviceCache.h"
+#include "VoiceChatStats.h"
+#include "Interfaces/VoiceCodec.h"
+#include "VoiceChatFormatConverter.h"
+#include "VoiceChatJitterBuffer.h"
+#include "Misc/AutomationTest.h"
+#include "UObject/Package.h"
+
+#if !UE_BUILD_SHIPPING
+
+namespace VoiceChatBenchmark
+{
+	/** 20ms of 48kHz stereo 16 bit audio, the size of a typical decoded packet */
+	static const uint32 PacketBytes = 48000 / 50 * 2 * sizeof(int16);
+	/** One 1024 frame stereo render callback */
+	static const uint32 CallbackBytes = 1024 * 2 * sizeof(int16);
+	/** Queue capacity used by UVoiceChatComponent, 5 seconds of 48kHz stereo */
+	static const uint32 QueueBytes = 48000 * 2 * sizeof(int16) * 5;
+	/** Producer keeps roughly this much audio queued so both variants run at the same fill level */
+	static const uint32 TargetFillBytes = 48000 * 2 * sizeof(int16) / 4;
+
+	/** The playback queue as it was before TVoiceChatRingBuffer: a locked TArray drained from the front */
+	struct FLockedArrayQueue
+	{
+		FCriticalSection Lock;
+		TArray<uint8> Data;
+
+		FLockedArrayQueue()
+		{
+			Data.Empty(QueueBytes);
+		}
+
+		uint32 Num()
+		{
+			FScopeLock ScopeLock(&Lock);
+			return Data.Num();
+		}
+
+		bool Push(const uint8* InData, uint32 Size)
+		{
+			FScopeLock ScopeLock(&Lock);
+			if (Data.Num() + Size > QueueBytes)
+			{
+				return false;
+			}
+			const int32 OldSize = Data.Num();
+			Data.AddUninitialized(Size);
+			FMemory::Memcpy(Data.GetData() + OldSize, InData, Size);
+			return true;
+		}
+
+		uint32 Pop(uint8* OutData, uint32 Size)
+		{
+			FScopeLock ScopeLock(&Lock);
+			const uint32 ToPop = FMath::Min<uint32>(Size, Data.Num());
+			FMemory::Memcpy(OutData, Data.GetData(), ToPop);
+			Data.RemoveAt(0, ToPop, false);
+			return ToPop;
+		}
+	};
+
+	struct FRingQueue
+	{
+		TVoiceChatRingBuffer<uint8> Data;
+
+		FRingQueue()
+			: Data(QueueBytes)
+		{
+		}
+
+		uint32 Num() { return Data.Num(); }
+		bool Push(const uint8* InData, uint32 Size) { return Data.Push(InData, Size); }
+		uint32 Pop(uint8* OutData, uint32 Size) { return Data.Pop(OutData, Size); }
+	};
+
+	struct FResult
+	{
+		double ConsumerAvgNs = 0.0;
+		double ConsumerMaxNs = 0.0;
+		double ProducerAvgNs = 0.0;
+		uint64 Callbacks = 0;
+	};
+
+	/**
+	 * Runs one producer thread (the game thread pushing decoded packets) and one consumer thread
+	 * (the audio render thread servicing every component's underflow callback) against NumQueues queues.
+	 */
+	template<typename QueueType>
+	FResult Run(int32 NumQueues, double Seconds)
+	{
+		TArray<TUniquePtr<QueueType>> Queues;
+		for (int32 Index = 0; Index < NumQueues; ++Index)
+		{
+			Queues.Add(MakeUnique<QueueType>());
+		}
+
+		TAtomic<bool> bStop(false);
+		const double SecondsPerCycle = FPlatformTime::GetSecondsPerCycle64();
+
+		TFuture<FResult> Consumer = Async(EAsyncExecution::Thread, [&Queues, &bStop, SecondsPerCycle]()
+		{
+			FResult Result;
+			TArray<uint8> Sink;
+			Sink.AddUninitialized(CallbackBytes);
+
+			uint64 TotalCycles = 0;
+			uint64 MaxCycles = 0;
+			while (!bStop.Load())
+			{
+				for (TUniquePtr<QueueType>& Queue : Queues)
+				{
+					const uint64 Start = FPlatformTime::Cycles64();
+					Queue->Pop(Sink.GetData(), CallbackBytes);
+					const uint64 Elapsed = FPlatformTime::Cycles64() - Start;
+					TotalCycles += Elapsed;
+					MaxCycles = FMath::Max(MaxCycles, Elapsed);
+					++Result.Callbacks;
+				}
+			}
+
+			Result.ConsumerAvgNs = Result.Callbacks > 0 ? (TotalCycles * SecondsPerCycle * 1e9) / Result.Callbacks : 0.0;
+			Result.ConsumerMaxNs = MaxCycles * SecondsPerCycle * 1e9;
+			return Result;
+		});
+
+		TArray<uint8> Packet;
+		Packet.AddZeroed(PacketBytes);
+
+		uint64 ProducerCycles = 0;
+		uint64 Pushes = 0;
+		const double EndTime = FPlatformTime::Seconds() + Seconds;
+		while (FPlatformTime::Seconds() < EndTime)
+		{
+			for (TUniquePtr<QueueType>& Queue : Queues)
+			{
+				if (Queue->Num() < TargetFillBytes)
+				{
+					const uint64 Start = FPlatformTime::Cycles64();
+					Queue->Push(Packet.GetData(), PacketBytes);
+					ProducerCycles += FPlatformTime::Cycles64() - Start;
+					++Pushes;
+				}
+			}
+		}
+
+		bStop.Store(true);
+		FResult Result = Consumer.Get();
+		Result.ProducerAvgNs = Pushes > 0 ? (ProducerCycles * SecondsPerCycle * 1e9) / Pushes : 0.0;
+		return Result;
+	}
+
+	static void RunQueueBenchmark(const TArray<FString>& Args)
+	{
+		const int32 NumQueues = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 32;
+		const double Seconds = Args.Num() > 1 ? FMath::Max(0.1f, FCString::Atof(*Args[1])) : 2.0;
+
+		const FResult Locked = Run<FLockedArrayQueue>(NumQueues, Seconds);
+		const FResult Ring = Run<FRingQueue>(NumQueues, Seconds);
+
+		UE_LOG(LogVoice, Display, TEXT("VoiceChat queue benchmark: %d components, %.1f seconds"), NumQueues, Seconds);
+		UE_LOG(LogVoice, Display, TEXT("  Locked TArray: pop avg %.0f ns, pop max %.0f ns, push avg %.0f ns, %llu callbacks"),
+			Locked.ConsumerAvgNs, Locked.ConsumerMaxNs, Locked.ProducerAvgNs, Locked.Callbacks);
+		UE_LOG(LogVoice, Display, TEXT("  SPSC ring:     pop avg %.0f ns, pop max %.0f ns, push avg %.0f ns, %llu callbacks"),
+			Ring.ConsumerAvgNs, Ring.ConsumerMaxNs, Ring.ProducerAvgNs, Ring.Callbacks);
+	}
+
+	static FAutoConsoleCommand QueueBenchmarkCommand(
+		TEXT("voicechat.Bench.Queue"),
+		TEXT("Compares the playback queue implementations under concurrent push/pop. Usage: voicechat.Bench.Queue [NumComponents=32] [Seconds=2]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunQueueBenchmark));
+
+	/** A 40ms packet at 32 kbps plus the packet header */
+	static const int32 RelayPacketBytes = 160 + FVoiceChatPacketHeader::Size;
+	/** Packets per second sent by each talking player at a 40ms packet interval */
+	static const int32 RelayPacketsPerSecond = 25;
+
+	/**
+	 * One round is every player sending one packet. Receivers keep what they were handed until the end of the round,
+	 * like RPCs waiting for the net driver to serialize them.
+	 */
+	static double RunRelayRounds(FVoiceChatRelay& Relay, int32 NumPlayers, double Seconds, TArray<FVoiceChatPacketPtr>& Outbox, uint64& OutRounds)
+	{
+		TArray<uint8> Data;
+		Data.AddZeroed(RelayPacketBytes);
+
+		uint64 Cycles = 0;
+		OutRounds = 0;
+		const double EndTime = FPlatformTime::Seconds() + Seconds;
+		while (FPlatformTime::Seconds() < EndTime)
+		{
+			const uint64 Start = FPlatformTime::Cycles64();
+			for (int32 Sender = 0; Sender < NumPlayers; ++Sender)
+			{
+				Relay.Relay(Sender, Relay.AcquirePacket(Data));
+			}
+			Cycles += FPlatformTime::Cycles64() - Start;
+
+			Outbox.Reset();
+			++OutRounds;
+		}
+		return Cycles * FPlatformTime::GetSecondsPerCycle64();
+	}
+
+	static void RunRelayBenchmark(const TArray<FString>& Args)
+	{
+		const int32 NumPlayers = Args.Num() > 0 ? FMath::Max(2, FCString::Atoi(*Args[0])) : 100;
+		const double Seconds = Args.Num() > 1 ? FMath::Max(0.1f, FCString::Atof(*Args[1])) : 2.0;
+		const float RelevancyDistance = Args.Num() > 2 ? FCString::Atof(*Args[2]) : 0.0f;
+
+		FRandomStream Random(NumPlayers);
+		TArray<FVector> Locations;
+		for (int32 Player = 0; Player < NumPlayers; ++Player)
+		{
+			// Spread players over a 200m square
+			Locations.Add(FVector(Random.FRandRange(0.0f, 20000.0f), Random.FRandRange(0.0f, 20000.0f), 0.0f));
+		}
+
+		// Shared: every receiver references the one relayed buffer
+		TArray<FVoiceChatPacketPtr> SharedOutbox;
+		FVoiceChatRelay SharedRelay;
+		SharedRelay.SetRelevancyDistance(RelevancyDistance);
+		for (int32 Player = 0; Player < NumPlayers; ++Player)
+		{
+			SharedRelay.AddParticipant(Player, FOnVoiceChatRelayPacket::CreateLambda([&SharedOutbox](int32 SenderId, const FVoiceChatPacketRef& Packet)
+			{
+				SharedOutbox.Add(Packet);
+			}));
+			SharedRelay.SetParticipantLocation(Player, Locations[Player]);
+		}
+
+		// By value: every receiver gets its own copy, as when the packet goes through Blueprint as a TArray
+		TArray<FVoiceChatPacketPtr> CopyOutbox;
+		FVoiceChatRelay CopyRelay;
+		CopyRelay.SetRelevancyDistance(RelevancyDistance);
+		for (int32 Player = 0; Player < NumPlayers; ++Player)
+		{
+			CopyRelay.AddParticipant(Player, FOnVoiceChatRelayPacket::CreateLambda([&CopyOutbox](int32 SenderId, const FVoiceChatPacketRef& Packet)
+			{
+				FVoiceChatPacketRef Copy = MakeShared<FVoiceChatPacket, ESPMode::ThreadSafe>();
+				Copy->Data = Packet->Data;
+				CopyOutbox.Add(Copy);
+			}));
+			CopyRelay.SetParticipantLocation(Player, Locations[Player]);
+		}
+
+		uint64 SharedRounds = 0;
+		uint64 CopyRounds = 0;
+		const double SharedSeconds = RunRelayRounds(SharedRelay, NumPlayers, Seconds, SharedOutbox, SharedRounds);
+		const double CopySeconds = RunRelayRounds(CopyRelay, NumPlayers, Seconds, CopyOutbox, CopyRounds);
+
+		// Fraction of one core needed when every player talks at once
+		const double RoundsPerSecond = RelayPacketsPerSecond;
+		const double SharedRoundUs = SharedRounds > 0 ? SharedSeconds * 1e6 / SharedRounds : 0.0;
+		const double CopyRoundUs = CopyRounds > 0 ? CopySeconds * 1e6 / CopyRounds : 0.0;
+
+		UE_LOG(LogVoice, Display, TEXT("VoiceChat relay benchmark: %d players all talking, %d byte packets every %d ms, relevancy distance %.0f"),
+			NumPlayers, RelayPacketBytes, 1000 / RelayPacketsPerSecond, RelevancyDistance);
+		UE_LOG(LogVoice, Display, TEXT("  Shared buffer: %.1f us per round, %.2f%% of a core"), SharedRoundUs, SharedRoundUs * RoundsPerSecond / 1e4);
+		UE_LOG(LogVoice, Display, TEXT("  Copy per receiver: %.1f us per round, %.2f%% of a core"), CopyRoundUs, CopyRoundUs * RoundsPerSecond / 1e4);
+	}
+
+	static FAutoConsoleCommand RelayBenchmarkCommand(
+		TEXT("voicechat.Bench.Relay"),
+		TEXT("Measures server relay fan-out cost. Usage: voicechat.Bench.Relay [NumPlayers=100] [Seconds=2] [RelevancyDistance=0]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunRelayBenchmark));
+
+	/** Forwards to an encoder from the device cache, adding the time spent encoding to Cycles */
+	class FTimedVoiceEncoder : public IVoiceEncoder
+	{
+	public:
+
+		explicit FTimedVoiceEncoder(const TSharedRef<IVoiceEncoder>& InInner)
+			: Inner(InInner)
+		{
+		}
+
+		TSharedRef<IVoiceEncoder> Inner;
+		uint64 Cycles = 0;
+
+		virtual bool Init(int32 SampleRate, int32 NumChannels, EAudioEncodeHint EncodeHint) override { return Inner->Init(SampleRate, NumChannels, EncodeHint); }
+		virtual int32 Encode(const uint8* RawPCMData, uint32 RawDataSize, uint8* OutCompressedData, uint32& OutCompressedDataSize) override
+		{
+			const uint64 Start = FPlatformTime::Cycles64();
+			const int32 Remainder = Inner->Encode(RawPCMData, RawDataSize, OutCompressedData, OutCompressedDataSize);
+			Cycles += FPlatformTime::Cycles64() - Start;
+			return Remainder;
+		}
+		virtual bool SetBitrate(int32 InBitrate) override { return Inner->SetBitrate(InBitrate); }
+		virtual bool SetVBR(bool bEnableVBR) override { return Inner->SetVBR(bEnableVBR); }
+		virtual bool SetComplexity(int32 InComplexity) override { return Inner->SetComplexity(InComplexity); }
+		virtual void Reset() override { Inner->Reset(); }
+		virtual void Destroy() override { Inner->Destroy(); }
+		virtual void DumpState() const override { Inner->DumpState(); }
+	};
+
+	/** Forwards to a decoder from the device cache, adding the time spent decoding to Cycles */
+	class FTimedVoiceDecoder : public IVoiceDecoder
+	{
+	public:
+
+		explicit FTimedVoiceDecoder(const TSharedRef<IVoiceDecoder>& InInner)
+			: Inner(InInner)
+		{
+		}
+
+		TSharedRef<IVoiceDecoder> Inner;
+		uint64 Cycles = 0;
+
+		virtual bool Init(int32 SampleRate, int32 NumChannels) override { return Inner->Init(SampleRate, NumChannels); }
+		virtual void Reset() override { Inner->Reset(); }
+		virtual void Destroy() override { Inner->Destroy(); }
+		virtual void Decode(const uint8* CompressedData, uint32 CompressedDataSize, uint8* OutRawPCMData, uint32& OutRawDataSize) override
+		{
+			const uint64 Start = FPlatformTime::Cycles64();
+			Inner->Decode(CompressedData, CompressedDataSize, OutRawPCMData, OutRawDataSize);
+			Cycles += FPlatformTime::Cycles64() - Start;
+		}
+		virtual void DumpState() const override { Inner->DumpState(); }
+	};
+
+	/** One sending and one receiving component, connected directly instead of through the network */
+	struct FPipelineStream
+	{
+		UVoiceChatComponent* Talker = nullptr;
+		UVoiceChatComponent* Listener = nullptr;
+		TSharedPtr<FVoiceChatSyntheticCapture> Capture;
+		/** Set when the codecs are timed, the components then use these instead of the cached codecs */
+		TSharedPtr<FTimedVoiceEncoder> Encoder;
+		TSharedPtr<FTimedVoiceDecoder> Decoder;
+		/** Packets encoded by Talker during the current step */
+		TArray<FVoiceChatPacketPtr> Outbox;
+		TArray<uint8> PlaybackSink;
+	};
+
+	/** Codec frames simulated before measuring, lets the jitter buffers prebuffer and the pools fill */
+	static const int32 PipelineWarmupFrames = 50;
+
+	static void ShutdownPipelineStreams(TArray<FPipelineStream>& Streams)
+	{
+		for (FPipelineStream& Stream : Streams)
+		{
+			// The device cache gets the real codecs back, not the timing wrappers
+			if (Stream.Talker)
+			{
+				if (Stream.Encoder.IsValid())
+				{
+					Stream.Talker->VoiceEncoder = Stream.Encoder->Inner;
+				}
+				Stream.Talker->Shutdown();
+			}
+			if (Stream.Listener)
+			{
+				if (Stream.Decoder.IsValid())
+				{
+					Stream.Listener->VoiceDecoder = Stream.Decoder->Inner;
+				}
+				Stream.Listener->Shutdown();
+			}
+		}
+	}
+
+	static void RunPipelineBenchmark(const TArray<FString>& Args)
+	{
+		const int32 NumStreams = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 1;
+		const double Seconds = Args.Num() > 1 ? FMath::Max(0.1f, FCString::Atof(*Args[1])) : 2.0;
+		const EVoiceChatProfile Profile = (EVoiceChatProfile)(Args.Num() > 2 ? FMath::Clamp(FCString::Atoi(*Args[2]), 0, (int32)EVoiceChatProfile::Mono16k) : 0);
+
+		TArray<FPipelineStream> Streams;
+		Streams.SetNum(NumStreams);
+		for (FPipelineStream& Stream : Streams)
+		{
+			// Not registered with a world: nothing ticks them, the steps below call what TickComponent and PlayVoiceChatAudio call
+			Stream.Talker = NewObject<UVoiceChatComponent>(GetTransientPackage());
+			Stream.Talker->VoiceProfile = Profile;
+			Stream.Talker->bEnableVoiceActivityDetection = false;
+			Stream.Talker->ApplyVoiceProfile();
+			Stream.Capture = MakeShared<FVoiceChatSyntheticCapture>(Stream.Talker->CaptureSampleRate, Stream.Talker->NumCaptureChannels);
+			Stream.Talker->InitVoiceCapture(Stream.Capture);
+			const TSharedPtr<IVoiceEncoder> Encoder = FVoiceChatDeviceCache::Get().AcquireEncoder(Stream.Talker->InputSampleRate, Stream.Talker->NumInChannels, Stream.Talker->EncodeHint);
+			if (Encoder.IsValid())
+			{
+				Stream.Encoder = MakeShared<FTimedVoiceEncoder>(Encoder.ToSharedRef());
+				Stream.Talker->InitVoiceEncoder(Stream.Encoder);
+			}
+
+			TArray<FVoiceChatPacketPtr>* Outbox = &Stream.Outbox;
+			Stream.Talker->OnVoicePacketCaptured.AddLambda([Outbox](const FVoiceChatPacketRef& Packet)
+			{
+				Outbox->Add(Packet);
+			});
+
+			Stream.Listener = NewObject<UVoiceChatComponent>(GetTransientPackage());
+			Stream.Listener->VoiceProfile = Profile;
+			Stream.Listener->ApplyVoiceProfile();
+			const TSharedPtr<IVoiceDecoder> Decoder = FVoiceChatDeviceCache::Get().AcquireDecoder(Stream.Listener->InputSampleRate, Stream.Listener->NumInChannels);
+			if (Decoder.IsValid())
+			{
+				Stream.Decoder = MakeShared<FTimedVoiceDecoder>(Decoder.ToSharedRef());
+				Stream.Listener->InitVoiceDecoder(Stream.Decoder);
+			}
+
+			if (!Stream.Talker->VoiceEncoder.IsValid() || !Stream.Listener->VoiceDecoder.IsValid())
+			{
+				UE_LOG(LogVoice, Warning, TEXT("VoiceChat pipeline benchmark: no codec available, is voice enabled in the engine config?"));
+				ShutdownPipelineStreams(Streams);
+				return;
+			}
+		}
+
+		const UVoiceChatComponent* Format = Streams[0].Talker;
+		const int32 CaptureFramesPerStep = Format->CaptureSampleRate / 50;
+		const uint32 PlaybackBytesPerStep = Format->OutputSampleRate / 50 * Format->NumOutChannels * sizeof(int16);
+		for (FPipelineStream& Stream : Streams)
+		{
+			Stream.PlaybackSink.AddUninitialized(PlaybackBytesPerStep);
+		}
+
+		uint64 CaptureCycles = 0;
+		uint64 ReceiveCycles = 0;
+		uint64 QueueCycles = 0;
+		uint64 PlayedBytes = 0;
+		uint64 MeasuredFrames = 0;
+		uint64 FirstPoolAllocations = 0;
+		uint64 FirstUsedPhysical = 0;
+
+		// Each step is one 20ms codec frame of simulated time, run as fast as possible
+		double SimulatedTime = 0.0;
+		const double EndTime = FPlatformTime::Seconds() + Seconds;
+		for (int32 Step = 0; Step < PipelineWarmupFrames || FPlatformTime::Seconds() < EndTime; ++Step)
+		{
+			const bool bMeasure = Step >= PipelineWarmupFrames;
+			if (Step == PipelineWarmupFrames)
+			{
+				// Codec time before this point belongs to the warmup
+				for (FPipelineStream& Stream : Streams)
+				{
+					Stream.Encoder->Cycles = 0;
+					Stream.Decoder->Cycles = 0;
+				}
+				FirstPoolAllocations = VoiceChatStats::GetThreadPoolAllocations();
+				FirstUsedPhysical = FPlatformMemory::GetStats().UsedPhysical;
+			}
+
+			for (FPipelineStream& Stream : Streams)
+			{
+				Stream.Capture->Advance(CaptureFramesPerStep);
+
+				const uint64 CaptureStart = FPlatformTime::Cycles64();
+				Stream.Talker->ProcessCapture();
+				const uint64 ReceiveStart = FPlatformTime::Cycles64();
+				for (const FVoiceChatPacketPtr& Packet : Stream.Outbox)
+				{
+					Stream.Listener->InsertIncomingPacket(INDEX_NONE, Packet->Data, SimulatedTime);
+				}
+				Stream.Listener->ServiceJitterBuffer();
+				const uint64 QueueStart = FPlatformTime::Cycles64();
+				const uint32 Played = Stream.Listener->UncompressedDataQueue.Pop(Stream.PlaybackSink.GetData(), PlaybackBytesPerStep);
+				const uint64 End = FPlatformTime::Cycles64();
+
+				Stream.Outbox.Reset();
+				if (bMeasure)
+				{
+					CaptureCycles += ReceiveStart - CaptureStart;
+					ReceiveCycles += QueueStart - ReceiveStart;
+					QueueCycles += End - QueueStart;
+					PlayedBytes += Played;
+				}
+			}
+
+			if (bMeasure)
+			{
+				++MeasuredFrames;
+			}
+			SimulatedTime += 0.02;
+		}
+
+		const uint64 PoolAllocations = VoiceChatStats::GetThreadPoolAllocations() - FirstPoolAllocations;
+		const int64 MemoryGrowth = (int64)FPlatformMemory::GetStats().UsedPhysical - (int64)FirstUsedPhysical;
+
+		// The codecs run inside ProcessCapture and ServiceJitterBuffer, take them out of the stages around them
+		uint64 EncodeCycles = 0;
+		uint64 DecodeCycles = 0;
+		for (const FPipelineStream& Stream : Streams)
+		{
+			EncodeCycles += Stream.Encoder->Cycles;
+			DecodeCycles += Stream.Decoder->Cycles;
+		}
+		ShutdownPipelineStreams(Streams);
+
+		const double StreamFrames = (double)FMath::Max<uint64>(MeasuredFrames * NumStreams, 1);
+		const double NsPerCycle = FPlatformTime::GetSecondsPerCycle64() * 1e9;
+		const double EncodeNs = EncodeCycles * NsPerCycle / StreamFrames;
+		const double DecodeNs = DecodeCycles * NsPerCycle / StreamFrames;
+		const double CaptureNs = FMath::Max(CaptureCycles * NsPerCycle / StreamFrames - EncodeNs, 0.0);
+		const double JitterNs = FMath::Max(ReceiveCycles * NsPerCycle / StreamFrames - DecodeNs, 0.0);
+		const double QueueNs = QueueCycles * NsPerCycle / StreamFrames;
+		const double TalkerNs = CaptureNs + EncodeNs;
+		const double ListenerNs = JitterNs + DecodeNs + QueueNs;
+		const double TotalNs = TalkerNs + ListenerNs;
+		const double PlayedRatio = PlayedBytes / (StreamFrames * PlaybackBytesPerStep);
+
+		// A core keeps up with as many streams as fit their per frame cost into 20ms
+		UE_LOG(LogVoice, Display, TEXT("VoiceChat pipeline benchmark: %d streams, profile %d, %llu frames of 20ms measured"), NumStreams, (int32)Profile, MeasuredFrames);
+		UE_LOG(LogVoice, Display, TEXT("  Capture:       %.0f ns/frame (read, convert, process, VAD and packetize)"), CaptureNs);
+		UE_LOG(LogVoice, Display, TEXT("  Encode:        %.0f ns/frame (%.0f talkers per core)"), EncodeNs, TalkerNs > 0.0 ? 2e7 / TalkerNs : 0.0);
+		UE_LOG(LogVoice, Display, TEXT("  Jitter buffer: %.0f ns/frame (insert, playout and queue push)"), JitterNs);
+		UE_LOG(LogVoice, Display, TEXT("  Decode:        %.0f ns/frame (%.0f listeners per core)"), DecodeNs, ListenerNs > 0.0 ? 2e7 / ListenerNs : 0.0);
+		UE_LOG(LogVoice, Display, TEXT("  Queue pop:     %.0f ns/frame"), QueueNs);
+		UE_LOG(LogVoice, Display, TEXT("  End to end:    %.0f ns/frame, %.0f streams per core, %.0f%% of playback filled"),
+			TotalNs, TotalNs > 0.0 ? 2e7 / TotalNs : 0.0, PlayedRatio * 100.0);
+		UE_LOG(LogVoice, Display, TEXT("  Memory:        %.2f pool allocations per frame, process memory grew %.1f KB while measuring"),
+			PoolAllocations / StreamFrames, MemoryGrowth / 1024.0);
+	}
+
+	static FAutoConsoleCommand PipelineBenchmarkCommand(
+		TEXT("voicechat.Bench.Pipeline"),
+		TEXT("Runs capture, encode, decode and playback on synthetic audio without audio hardware. Usage: voicechat.Bench.Pipeline [NumStreams=1] [Seconds=2] [Profile=0]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunPipelineBenchmark));
+}
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FVoiceChatPipelineTest, "UE4VoiceChat.Pipeline.SyntheticRoundTrip",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/** Runs the voicechat.Bench.Pipeline setup for a fixed number of steps and checks audio makes it from capture to playback */
+bool FVoiceChatPipelineTest::RunTest(const FString& Parameters)
+{
+	using namespace VoiceChatBenchmark;
+
+	const int32 MeasuredSteps = 100;
+
+	TArray<FPipelineStream> Streams;
+	Streams.SetNum(1);
+	FPipelineStream& Stream = Streams[0];
+	Stream.Talker = NewObject<UVoiceChatComponent>(GetTransientPackage());
+	Stream.Talker->bEnableVoiceActivityDetection = false;
+	Stream.Talker->ApplyVoiceProfile();
+	Stream.Capture = MakeShared<FVoiceChatSyntheticCapture>(Stream.Talker->CaptureSampleRate, Stream.Talker->NumCaptureChannels);
+	Stream.Talker->InitVoiceCapture(Stream.Capture);
+	Stream.Talker->InitVoiceEncoder();
+
+	int32 NumPackets = 0;
+	Stream.Talker->OnVoicePacketCaptured.AddLambda([&Stream, &NumPackets](const FVoiceChatPacketRef& Packet)
+	{
+		Stream.Outbox.Add(Packet);
+		++NumPackets;
+	});
+
+	Stream.Listener = NewObject<UVoiceChatComponent>(GetTransientPackage());
+	Stream.Listener->ApplyVoiceProfile();
+	Stream.Listener->InitVoiceDecoder();
+
+	if (!Stream.Talker->VoiceEncoder.IsValid() || !Stream.Listener->VoiceDecoder.IsValid())
+	{
+		AddError(TEXT("No voice codec available, is voice enabled in the engine config?"));
+		ShutdownPipelineStreams(Streams);
+		return false;
+	}
+
+	const int32 CaptureFramesPerStep = Stream.Talker->CaptureSampleRate / 50;
+	const uint32 PlaybackBytesPerStep = Stream.Talker->OutputSampleRate / 50 * Stream.Talker->NumOutChannels * sizeof(int16);
+	Stream.PlaybackSink.AddUninitialized(PlaybackBytesPerStep);
+
+	// Same steps as the benchmark, one 20ms codec frame of simulated time each, the warmup lets the jitter buffer prebuffer
+	uint64 PlayedBytes = 0;
+	int32 Peak = 0;
+	double SimulatedTime = 0.0;
+	const int32 NumSteps = PipelineWarmupFrames + MeasuredSteps;
+	for (int32 Step = 0; Step < NumSteps; ++Step)
+	{
+		Stream.Capture->Advance(CaptureFramesPerStep);
+		Stream.Talker->ProcessCapture();
+		for (const FVoiceChatPacketPtr& Packet : Stream.Outbox)
+		{
+			Stream.Listener->InsertIncomingPacket(INDEX_NONE, Packet->Data, SimulatedTime);
+		}
+		Stream.Outbox.Reset();
+		Stream.Listener->ServiceJitterBuffer();
+		const uint32 Played = Stream.Listener->UncompressedDataQueue.Pop(Stream.PlaybackSink.GetData(), PlaybackBytesPerStep);
+
+		if (Step >= PipelineWarmupFrames)
+		{
+			PlayedBytes += Played;
+			Peak = FMath::Max(Peak, VoiceChatDSP::ComputePeak((const int16*)Stream.PlaybackSink.GetData(), Played / sizeof(int16)));
+		}
+		SimulatedTime += 0.02;
+	}
+
+	// Every step captures one codec frame, packets carry PacketIntervalMs worth of them
+	const int32 ExpectedPackets = NumSteps / FMath::Max(FMath::RoundToInt(Stream.Talker->PacketIntervalMs / 20.0f), 1);
+	const int32 ReceivedPackets = Stream.Listener->ReceiveStream.GetStats().ReceivedCount;
+	ShutdownPipelineStreams(Streams);
+
+	const double PlayedRatio = PlayedBytes / ((double)MeasuredSteps * PlaybackBytesPerStep);
+	TestEqual(TEXT("Packets encoded"), NumPackets, ExpectedPackets);
+	TestEqual(TEXT("Packets received"), ReceivedPackets, NumPackets);
+	TestTrue(FString::Printf(TEXT("Playback filled (%.0f%%)"), PlayedRatio * 100.0), PlayedRatio > 0.0);
+	TestTrue(TEXT("Played audio is not silent"), Peak > 0);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FVoiceChatSenderOnlyTest, "UE4VoiceChat.Pipeline.SenderOnlyTick",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/** Ticks a sender only component without sidetone, it has no sound wave and must still capture and send */
+bool FVoiceChatSenderOnlyTest::RunTest(const FString& Parameters)
+{
+	using namespace VoiceChatBenchmark;
+
+	const int32 NumSteps = 50;
+
+	// What InitAsSender does, with the synthetic capture in place of the microphone
+	UVoiceChatComponent* Sender = NewObject<UVoiceChatComponent>(GetTransientPackage());
+	Sender->bEnableVoiceActivityDetection = false;
+	Sender->bSidetone = false;
+	Sender->ApplyVoiceProfile();
+	Sender->bSenderOnly = true;
+	TSharedPtr<FVoiceChatSyntheticCapture> Capture = MakeShared<FVoiceChatSyntheticCapture>(Sender->CaptureSampleRate, Sender->NumCaptureChannels);
+	Sender->InitVoiceCapture(Capture);
+	Sender->InitVoiceEncoder();
+
+	if (!Sender->VoiceEncoder.IsValid())
+	{
+		AddError(TEXT("No voice codec available, is voice enabled in the engine config?"));
+		Sender->Shutdown();
+		return false;
+	}
+
+	int32 NumPackets = 0;
+	Sender->OnVoicePacketCaptured.AddLambda([&NumPackets](const FVoiceChatPacketRef& Packet)
+	{
+		++NumPackets;
+	});
+
+	const int32 CaptureFramesPerStep = Sender->CaptureSampleRate / 50;
+	for (int32 Step = 0; Step < NumSteps; ++Step)
+	{
+		Capture->Advance(CaptureFramesPerStep);
+		Sender->TickVoice();
+	}
+
+	const bool bHasSoundWave = Sender->SoundStreaming != nullptr;
+	const int32 ExpectedPackets = NumSteps / FMath::Max(FMath::RoundToInt(Sender->PacketIntervalMs / 20.0f), 1);
+	Sender->Shutdown();
+
+	TestFalse(TEXT("Sender without sidetone has no sound wave"), bHasSoundWave);
+	TestEqual(TEXT("Packets broadcast"), NumPackets, ExpectedPackets);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FVoiceChatDecimatorTest, "UE4VoiceChat.DSP.DecimatorRejectsAliases",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/** Converts 48 kHz tones to the 16 kHz profile rate, one below and one above the new Nyquist frequency */
+bool FVoiceChatDecimatorTest::RunTest(const FString& Parameters)
+{
+	const int32 InputRate = 48000;
+	const int32 OutputRate = 16000;
+	const int32 BlockFrames = InputRate / 50;
+	const int32 NumBlocks = 25;
+	const float Amplitude = 16000.0f;
+
+	// Peak of the converted tone once the filter settled, fed in 20ms blocks like the capture path does
+	auto ConvertTone = [&](float Frequency)
+	{
+		FVoiceChatFormatConverter Converter;
+		Converter.Init(InputRate, 1, OutputRate, 1);
+
+		TArray<int16> Block;
+		Block.SetNumUninitialized(BlockFrames);
+		TArray<int16> Converted;
+		int32 Peak = 0;
+		for (int32 BlockIndex = 0; BlockIndex < NumBlocks; ++BlockIndex)
+		{
+			for (int32 Frame = 0; Frame < BlockFrames; ++Frame)
+			{
+				const int32 Time = BlockIndex * BlockFrames + Frame;
+				Block[Frame] = (int16)FMath::RoundToInt(Amplitude * FMath::Sin(2.0f * PI * Frequency * (Time % InputRate) / InputRate));
+			}
+
+			const int32 NumOutFrames = Converter.Convert(Block.GetData(), BlockFrames, Converted);
+			TestTrue(TEXT("Output fits GetMaxOutputFrames"), NumOutFrames <= Converter.GetMaxOutputFrames(BlockFrames));
+			if (BlockIndex > 0)
+			{
+				Peak = FMath::Max(Peak, VoiceChatDSP::ComputePeak(Converted.GetData(), NumOutFrames));
+			}
+		}
+		return Peak;
+	};
+
+	const int32 PassedPeak = ConvertTone(1000.0f);
+	const int32 AliasPeak = ConvertTone(12000.0f);
+
+	// Linear interpolation alone would fold the 12 kHz tone to 4 kHz at nearly full level
+	TestTrue(FString::Printf(TEXT("1 kHz tone passes (peak %d)"), PassedPeak), PassedPeak > Amplitude * 0.9f);
+	TestTrue(FString::Printf(TEXT("12 kHz tone is attenuated by 40 dB (peak %d)"), AliasPeak), AliasPeak < Amplitude * 0.01f);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FVoiceChatRingBufferWrapTest, "UE4VoiceChat.RingBuffer.FlushSurvivesIndexWrap",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/** Streams more than 2^32 elements through a queue flushed once at the start, the old flush point must never apply again */
+bool FVoiceChatRingBufferWrapTest::RunTest(const FString& Parameters)
+{
+	const uint32 ChunkSize = 32 * 1024;
+	const uint64 NumElements = (1ull << 32) + (1ull << 20);
+
+	TVoiceChatRingBuffer<uint8> Queue(2 * ChunkSize);
+	TArray<uint8> In;
+	In.AddZeroed(ChunkSize);
+	TArray<uint8> Out;
+	Out.AddZeroed(ChunkSize);
+
+	Queue.Push(In.GetData(), 100);
+	Queue.Flush();
+	TestEqual(TEXT("Flush empties the queue"), (int32)Queue.Num(), 0);
+
+	// Stamp every chunk so a read index jumping back shows as stale data, stop at the first failure
+	uint8 Stamp = 0;
+	for (uint64 Pushed = 0; Pushed < NumElements; Pushed += ChunkSize, ++Stamp)
+	{
+		In[0] = Stamp;
+		In[ChunkSize - 1] = Stamp;
+		if (!TestTrue(TEXT("Push fits"), Queue.Push(In.GetData(), ChunkSize)) ||
+			!TestEqual(FString::Printf(TEXT("Queued elements after %llu pushed"), Pushed), (int32)Queue.Num(), (int32)ChunkSize))
+		{
+			return false;
+		}
+
+		const uint32 Popped = Queue.Pop(Out.GetData(), ChunkSize);
+		if (!TestTrue(FString::Printf(TEXT("Pop returns the chunk pushed after %llu"), Pushed), Popped == ChunkSize && Out[0] == Stamp && Out[ChunkSize - 1] == Stamp))
+		{
+			return false;
+		}
+	}
+
+	// Flushing still works with the indices wrapped
+	Queue.Push(In.GetData(), 10);
+	Queue.Flush();
+	Queue.Push(In.GetData(), 5);
+	TestEqual(TEXT("Only data pushed after the flush is queued"), (int32)Queue.Num(), 5);
+	TestEqual(TEXT("Pop returns only data pushed after the flush"), (int32)Queue.Pop(Out.GetData(), ChunkSize), 5);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FVoiceChatRelayChannelTest, "UE4VoiceChat.Relay.RejectsForbiddenChannels",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/** The channel byte comes from the client, the relay must neither fold invalid channels onto valid ones nor relay channels the sender may not use */
+bool FVoiceChatRelayChannelTest::RunTest(const FString& Parameters)
+{
+	const int32 Sender = 0;
+	const int32 Receiver = 1;
+	const uint8 TeamChannel = 1;
+	const uint8 OtherTeamChannel = 2;
+
+	FVoiceChatRelay Relay;
+	int32 NumReceived = 0;
+	Relay.AddParticipant(Sender, FOnVoiceChatRelayPacket());
+	Relay.AddParticipant(Receiver, FOnVoiceChatRelayPacket::CreateLambda([&NumReceived](int32 SenderId, const FVoiceChatPacketRef& Packet)
+	{
+		++NumReceived;
+	}));
+	Relay.SetParticipantSendChannels(Sender, VoiceChatChannelBit(0) | VoiceChatChannelBit(TeamChannel));
+
+	auto RelayOnChannel = [&Relay](uint8 Channel)
+	{
+		uint8 Data[FVoiceChatPacketHeader::Size];
+		FVoiceChatPacketHeader Header;
+		Header.Flags = EVoiceChatPacketFlags::Silence;
+		Header.Write(Data);
+		Data[9] = Channel;
+		return Relay.Relay(Sender, Relay.AcquirePacket(TArrayView<const uint8>(Data, FVoiceChatPacketHeader::Size)));
+	};
+
+	TestEqual(TEXT("Relayed on an allowed channel"), RelayOnChannel(TeamChannel), 1);
+	TestEqual(TEXT("Not relayed on a channel the sender may not send on"), RelayOnChannel(OtherTeamChannel), 0);
+	TestEqual(TEXT("Channel 65 is not read as channel 1"), RelayOnChannel(VOICE_MAX_CHANNELS + TeamChannel), 0);
+	TestEqual(TEXT("Packets received"), NumReceived, 1);
+
+	uint8 Channel = 0;
+	uint8 Data[FVoiceChatPacketHeader::Size] = {};
+	Data[9] = VOICE_MAX_CHANNELS;
+	FVoiceChatPacketHeader Header;
+	TestFalse(TEXT("ReadChannel rejects an invalid channel"), FVoiceChatPacketHeader::ReadChannel(Data, FVoiceChatPacketHeader::Size, Channel));
+	TestFalse(TEXT("Read rejects an invalid channel"), Header.Read(Data, FVoiceChatPacketHeader::Size));
+
+	Relay.Empty();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FVoiceChatJitterBufferStragglerTest, "UE4VoiceChat.JitterBuffer.StragglerAfterSilenceIsLate",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/** A packet of a finished talk spurt arriving after its silence marker must be dropped, not restart playback with old audio */
+bool FVoiceChatJitterBufferStragglerTest::RunTest(const FString& Parameters)
+{
+	const int32 SampleRate = 48000;
+	const uint16 FrameSamples = 960;
+
+	FVoiceChatJitterBuffer Buffer;
+	Buffer.Configure(SampleRate, 20.0f, 20.0f, 200.0f);
+
+	const uint8 Payload[4] = {};
+	auto Insert = [&](uint16 Sequence, bool bSilence)
+	{
+		FVoiceChatPacketHeader Header;
+		Header.Flags = bSilence ? EVoiceChatPacketFlags::Silence : EVoiceChatPacketFlags::None;
+		Header.Sequence = Sequence;
+		Header.Timestamp = Sequence * FrameSamples;
+		Header.NumSamples = bSilence ? 0 : FrameSamples;
+		return Buffer.Insert(Header, Payload, bSilence ? 0 : (int32)sizeof(Payload), Sequence * 0.02);
+	};
+
+	FVoiceChatPacketHeader Header;
+	TArray<uint8> OutPayload;
+	int32 NumLost = 0;
+	double ArrivalTime = 0.0;
+
+	// Packet 1 is held up in the network, the talk spurt ends with the silence marker 2 before it arrives
+	Insert(0, false);
+	Insert(2, true);
+	TestTrue(TEXT("Talk spurt starts"), Buffer.Pop(0.0f, Header, OutPayload, NumLost, ArrivalTime) && Header.Sequence == 0);
+	TestTrue(TEXT("Silence marker ends it"), Buffer.Pop(0.0f, Header, OutPayload, NumLost, ArrivalTime) && Header.Sequence == 2);
+	TestFalse(TEXT("Talk spurt is over"), Buffer.IsPlaying());
+
+	TestFalse(TEXT("Straggler is dropped"), Insert(1, false));
+	TestEqual(TEXT("Straggler counts as late"), Buffer.GetLateCount(), 1);
+	TestFalse(TEXT("Nothing to play"), Buffer.Pop(0.0f, Header, OutPayload, NumLost, ArrivalTime));
+
+	// The next talk spurt continues the sequence and plays without concealing anything
+	TestTrue(TEXT("Next talk spurt is accepted"), Insert(3, false));
+	TestTrue(TEXT("Next talk spurt starts"), Buffer.Pop(0.0f, Header, OutPayload, NumLost, ArrivalTime) && Header.Sequence == 3);
+	TestEqual(TEXT("Nothing lost at the start of the next talk spurt"), NumLost, 0);
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
+
+#endif // !UE_BUILD_SHIPPING
@@ -0,0 +1,125 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatBitrate.h"
+
+/** Time between two evaluations of the encoder settings */
+#define VOICE_BITRATE_UPDATE_SECONDS 1.0
+/** Listeners that did not report for this long are left out, e.g. after they left or stopped hearing the talker */
+#define VOICE_BITRATE_REPORT_TIMEOUT_SECONDS 5.0
+/** Loss above which the bitrate is cut, and below which it may grow again */
+#define VOICE_BITRATE_HIGH_LOSS 0.08f
+#define VOICE_BITRATE_LOW_LOSS 0.02f
+/** Jitter above which the bitrate is held, a sign of queues building up along the path */
+#define VOICE_BITRATE_HIGH_JITTER_MS 40.0f
+/** Multiplicative decrease and additive increase per evaluation */
+#define VOICE_BITRATE_DECREASE 0.75f
+#define VOICE_BITRATE_INCREASE 2000
+/** Share of real time spent encoding above which complexity is lowered, and below which it may be raised again */
+#define VOICE_BITRATE_HIGH_ENCODE_LOAD 0.05
+#define VOICE_BITRATE_LOW_ENCODE_LOAD 0.015
+
+FVoiceChatBitrateController::FVoiceChatBitrateController() :
+	MinBitrate(0),
+	MaxBitrate(0),
+	MaxComplexity(0),
+	Budget(0),
+	EncodeSeconds(0.0),
+	EncodedAudioSeconds(0.0),
+	LastUpdateTime(0.0)
+{
+}
+
+void FVoiceChatBitrateController::Configure(int32 InMinBitrate, int32 InMaxBitrate, int32 InMaxComplexity)
+{
+	MinBitrate = FMath::Max(InMinBitrate, 1);
+	MaxBitrate = FMath::Max(InMaxBitrate, MinBitrate);
+	MaxComplexity = FMath::Max(InMaxComplexity, 0);
+
+	// Start in the middle and let the first reports move it, rather than flooding a link that is already congested
+	Settings.Bitrate = (MinBitrate + MaxBitrate) / 2;
+	Settings.bVBR = true;
+	Settings.Complexity = MaxComplexity;
+
+	Listeners.Empty();
+	EncodeSeconds = 0.0;
+	EncodedAudioSeconds = 0.0;
+	LastUpdateTime = 0.0;
+}
+
+void FVoiceChatBitrateController::AddReport(int32 ListenerId, const FVoiceChatReceiverReport& Report, double Now)
+{
+	Listeners.Add(ListenerId, { Report, Now });
+}
+
+void FVoiceChatBitrateController::AddEncodeTime(double InEncodeSeconds, double AudioSeconds)
+{
+	EncodeSeconds += InEncodeSeconds;
+	EncodedAudioSeconds += AudioSeconds;
+}
+
+bool FVoiceChatBitrateController::Update(double Now)
+{
+	if (Now - LastUpdateTime < VOICE_BITRATE_UPDATE_SECONDS || MaxBitrate <= 0)
+	{
+		return false;
+	}
+	LastUpdateTime = Now;
+
+	// One stream serves every listener, it has to get through to the worst of them
+	float Loss = 0.0f;
+	float Jitter = 0.0f;
+	int32 Cap = MaxBitrate;
+	for (auto It = Listeners.CreateIterator(); It; ++It)
+	{
+		if (Now - It.Value().Time > VOICE_BITRATE_REPORT_TIMEOUT_SECONDS)
+		{
+			It.RemoveCurrent();
+			continue;
+		}
+
+		const FVoiceChatReceiverReport& Report = It.Value().Report;
+		Loss = FMath::Max(Loss, Report.LossFraction);
+		Jitter = FMath::Max(Jitter, Report.JitterMs);
+		if (Report.MaxBitrate > 0)
+		{
+			Cap = FMath::Min(Cap, Report.MaxBitrate);
+		}
+	}
+	if (Budget > 0)
+	{
+		Cap = FMath::Min(Cap, Budget);
+	}
+	Cap = FMath::Max(Cap, MinBitrate);
+
+	const FVoiceChatEncoderSettings Previous = Settings;
+
+	int32 Bitrate = Settings.Bitrate;
+	if (Loss > VOICE_BITRATE_HIGH_LOSS)
+	{
+		Bitrate = FMath::RoundToInt(Bitrate * VOICE_BITRATE_DECREASE);
+	}
+	else if (Loss <= VOICE_BITRATE_LOW_LOSS && Jitter <= VOICE_BITRATE_HIGH_JITTER_MS)
+	{
+		Bitrate += VOICE_BITRATE_INCREASE;
+	}
+	Settings.Bitrate = FMath::Clamp(Bitrate, MinBitrate, Cap);
+	Settings.bVBR = Loss <= VOICE_BITRATE_LOW_LOSS && Settings.Bitrate < Cap;
+
+	if (EncodedAudioSeconds > 0.0)
+	{
+		const double EncodeLoad = EncodeSeconds / EncodedAudioSeconds;
+		if (EncodeLoad > VOICE_BITRATE_HIGH_ENCODE_LOAD)
+		{
+			Settings.Complexity = FMath::Max(Settings.Complexity - 2, 0);
+		}
+		else if (EncodeLoad < VOICE_BITRATE_LOW_ENCODE_LOAD)
+		{
+			Settings.Complexity = FMath::Min(Settings.Complexity + 1, MaxComplexity);
+		}
+		EncodeSeconds = 0.0;
+		EncodedAudioSeconds = 0.0;
+	}
+
+	return Settings.Bitrate != Previous.Bitrate || Settings.bVBR != Previous.bVBR || Settings.Complexity != Previous.Complexity;
+}
@@ -3,32 +3,53 @@
 
 #include "VoiceChatComponent.h"
 #include "VoiceModule.h"
-#include "Kismet/KismetSystemLibrary.h"
+#include "VoiceChatStats.h"
 #include "AudioDeviceManager.h"
 #include "Sound/SoundClass.h"
+#include "Sound/SoundAttenuation.h"
+#include "GameFramework/PlayerController.h"
+#include "Engine/World.h"
+#include "GameFramework/GameStateBase.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectIterator.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Async/Async.h"
+#include "VoiceChatDeviceCache.h"
 
 #define VOICE_BUFFER_CHECK(Buffer, Size) \
 	check(Buffer.Num() >= (int32)(Size))
 
+/** Playback running dry is filled for at most this long, after that the talker is assumed gone */
+#define VOICE_MAX_UNDERFLOW_FILL_MS 500
+/** Length of the fade from the last played audio into the underflow fill */
+#define VOICE_UNDERFLOW_FADE_MS 5
+
 UVoiceChatComponent::UVoiceChatComponent() :
 	SoundStreaming(nullptr),
 	VoiceCapture(nullptr),
 	VoiceEncoder(nullptr),
 	VoiceDecoder(nullptr),
+	bCaptureFromCache(false),
+	InitSerial(0),
+	bIsInitializing(false),
 	EncodeHint(UVOIPStatics::GetAudioEncodingHint()),
 	InputSampleRate(UVOIPStatics::GetVoiceSampleRate()),
 	OutputSampleRate(UVOIPStatics::GetVoiceSampleRate()),
 	NumInChannels(UVOIPStatics::GetVoiceNumChannels()),
 	NumOutChannels(UVOIPStatics::GetVoiceNumChannels()),
+	CaptureSampleRate(UVOIPStatics::GetVoiceSampleRate()),
+	NumCaptureChannels(UVOIPStatics::GetVoiceNumChannels()),
 	bLastWasPlaying(false),
 	StarvedDataCount(0),
 	MaxRawCaptureDataSize(0),
 	MaxCompressedDataSize(0),
 	MaxUncompressedDataSize(0),
-	CurrentUncompressedDataQueueSize(0),
 	MaxUncompressedDataQueueSize(0),
-	MaxRemainderSize(0),
-	LastRemainderSize(0),
+	bIsTransmitting(false),
+	OutgoingSequence(0),
+	OutgoingTimestamp(0),
+	CaptureReadOffset(0),
+	CaptureWriteOffset(0),
 	CachedSampleCount(0),
 	bZeroInput(false),
 	bUseDecompressed(true),
@@ -36,16 +57,34 @@ UVoiceChatComponent::UVoiceChatComponent() :
 {
 	PrimaryComponentTick.bStartWithTickEnabled = true;
 	PrimaryComponentTick.bCanEverTick = true;
+
+	IncomingPackets.SetCapacity(VOICE_MAX_PENDING_PACKETS);
+	CapturedPackets.SetCapacity(VOICE_MAX_PENDING_PACKETS);
+	PendingLatencyMarks.SetCapacity(VOICE_MAX_PENDING_PACKETS);
+	PlayedLatencyMarks.SetCapacity(VOICE_MAX_PENDING_PACKETS);
+	IncomingReports.SetCapacity(VOICE_MAX_PENDING_PACKETS);
+	ClockOffsetMicroseconds.Store(0);
+	BitrateBudget.Store(0);
+	bEncoderTuned = false;
+	RecordingSpeakerId = INDEX_NONE;
+	UnderflowCount.Store(0);
+	StarvedFrameCount.Store(0);
+	FilledFramesSinceAudio = 0;
+	FMemory::Memzero(LastPlayedFrame);
+	NoiseSeed = 1;
+	ActivePlaybackReads.Store(0);
+	bPlaybackQueueOpen.Store(false);
+	bSenderOnly = false;
+	SubscribedChannels = VOICE_ALL_CHANNELS;
 }
 
 bool UVoiceChatComponent::Init()
 {
 	DeviceName = TEXT("Line 1 (Virtual Audio Cable)");
-	EncodeHint = EAudioEncodeHint::VoiceEncode_Audio;
-	InputSampleRate = 48000;
-	OutputSampleRate = 48000;
-	NumInChannels = 2;
-	NumOutChannels = 2;
+	ApplyVoiceProfile();
+	bSenderOnly = false;
+	++InitSerial;
+	bIsInitializing = false;
 
 	InitVoiceCapture();
 	InitVoiceEncoder();
@@ -57,64 +96,118 @@ bool UVoiceChatComponent::Init()
 bool UVoiceChatComponent::InitWithInputDevice(FName InputDeviceName)
 {
 	DeviceName = InputDeviceName.ToString();
-	EncodeHint = EAudioEncodeHint::VoiceEncode_Audio;
-	InputSampleRate = 48000;
-	OutputSampleRate = 48000;
-	NumInChannels = 2;
-	NumOutChannels = 2;
+	// Picked explicitly, so worth probing again even if it failed a moment ago
+	FVoiceChatDeviceCache::Get().RetryDevice(DeviceName);
+	ApplyVoiceProfile();
+	bSenderOnly = false;
+	++InitSerial;
+	bIsInitializing = false;
 	UE_LOG(LogVoice, Log, TEXT("Initialization started"));
-	UKismetSystemLibrary::PrintString(this, FString("Initialization started "), true, true, FLinearColor::Red, 0.f);
 
 	InitVoiceCapture();
 	UE_LOG(LogVoice, Log, TEXT("Init Voice Capture ended"));
-	UKismetSystemLibrary::PrintString(this, FString("Init Voice Capture ended "), true, true, FLinearColor::Red, 0.f);
 
 	InitVoiceEncoder();
 	UE_LOG(LogVoice, Log, TEXT("Init Voice Encoder ended"));
-	UKismetSystemLibrary::PrintString(this, FString("Init Voice Encoder ended "), true, true, FLinearColor::Red, 0.f);
 
 	InitVoiceDecoder();
 	UE_LOG(LogVoice, Log, TEXT("Init Voice Decoder ended"));
-	UKismetSystemLibrary::PrintString(this, FString("Init Voice Decoder ended "), true, true, FLinearColor::Red, 0.f);
 
+	InitSoundStreaming();
+	InitSoundClass(false);
 
-	USoundWaveProcedural* newSoundStreaming = NewObject<USoundWaveProcedural>();
-	newSoundStreaming->SetSampleRate(OutputSampleRate);
-	newSoundStreaming->NumChannels = NumOutChannels;
-	newSoundStreaming->Duration = INDEFINITELY_LOOPING_DURATION;
-	newSoundStreaming->SoundGroup = SOUNDGROUP_Voice;
-	newSoundStreaming->bLooping = false;
+	return true;
+}
 
-	// Turn off async generation in old audio engine on mac.
-#if PLATFORM_MAC
-	if (!AudioDevice->IsAudioMixerEnabled())
-	{
-		newSoundStreaming->bCanProcessAsync = false;
-	}
-	else
-#endif // #if PLATFORM_MAC
+void UVoiceChatComponent::InitWithInputDeviceAsync(FName InputDeviceName)
+{
+	DeviceName = InputDeviceName.ToString();
+	ApplyVoiceProfile();
+	bSenderOnly = false;
+	UE_LOG(LogVoice, Log, TEXT("Asynchronous initialization started"));
+
+	const int32 Serial = ++InitSerial;
+	bIsInitializing = true;
+
+	// Also loads the Voice module, which has to happen on the game thread before the worker opens anything
+	FVoiceChatDeviceCache::Get().RetryDevice(DeviceName);
+
+	TWeakObjectPtr<UVoiceChatComponent> WeakThis(this);
+	const FString CaptureDeviceName = DeviceName;
+	const int32 CaptureRate = CaptureSampleRate;
+	const int32 CaptureChannels = NumCaptureChannels;
+	const int32 CodecRate = InputSampleRate;
+	const int32 CodecChannels = NumInChannels;
+	const EAudioEncodeHint CodecHint = EncodeHint;
+
+	// Opening a device blocks, run it on the thread pool rather than on the task graph workers the pipelines use
+	Async(EAsyncExecution::ThreadPool, [WeakThis, Serial, CaptureDeviceName, CaptureRate, CaptureChannels, CodecRate, CodecChannels, CodecHint]()
 	{
-		newSoundStreaming->bCanProcessAsync = true;
-	}
+		FVoiceChatDeviceCache& Cache = FVoiceChatDeviceCache::Get();
+		TSharedPtr<IVoiceCapture> Capture = Cache.AcquireCapture(CaptureDeviceName, CaptureRate, CaptureChannels);
+		if (Capture.IsValid())
+		{
+			Capture->Start();
+		}
+		TSharedPtr<IVoiceEncoder> Encoder = Cache.AcquireEncoder(CodecRate, CodecChannels, CodecHint);
+		TSharedPtr<IVoiceDecoder> Decoder = Cache.AcquireDecoder(CodecRate, CodecChannels);
 
-	Sound = newSoundStreaming;
-	bIsUISound = false;
-	bAllowSpatialization = true;
-	SetVolumeMultiplier(1.5f);
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Serial, Capture, Encoder, Decoder, CaptureDeviceName, CaptureRate, CaptureChannels, CodecRate, CodecChannels, CodecHint]()
+		{
+			UVoiceChatComponent* This = WeakThis.Get();
+			if (!This || This->InitSerial != Serial)
+			{
+				// Destroyed, shut down or initialized again meanwhile, leave everything to the next component
+				FVoiceChatDeviceCache& Cache = FVoiceChatDeviceCache::Get();
+				Cache.ReleaseCapture(Capture, CaptureDeviceName, CaptureRate, CaptureChannels);
+				Cache.ReleaseEncoder(Encoder, CodecRate, CodecChannels, CodecHint);
+				Cache.ReleaseDecoder(Decoder, CodecRate, CodecChannels);
+				return;
+			}
 
-	const FSoftObjectPath VoiPSoundClassName = GetDefault<UAudioSettings>()->VoiPSoundClass;
-	if (VoiPSoundClassName.IsValid())
-	{
-		SoundClassOverride = LoadObject<USoundClass>(nullptr, *VoiPSoundClassName.ToString());
-	}
+			This->bIsInitializing = false;
+			This->InitVoiceCapture(Capture);
+			This->bCaptureFromCache = Capture.IsValid();
+			This->InitVoiceEncoder(Encoder);
+			This->InitVoiceDecoder(Decoder);
+			This->InitSoundStreaming();
+			This->InitSoundClass(true);
+
+			UE_LOG(LogVoice, Log, TEXT("Asynchronous initialization ended"));
+			This->OnInitialized.Broadcast(Capture.IsValid() && Encoder.IsValid() && Decoder.IsValid());
+		});
+	});
+}
 
-	return true;
+void UVoiceChatComponent::FlushDeviceCache()
+{
+	FVoiceChatDeviceCache::Get().Flush();
+}
+
+void UVoiceChatComponent::ApplyVoiceProfile()
+{
+	const FVoiceChatCodecFormat Format = FVoiceChatCodecFormat::FromProfile(VoiceProfile);
+	EncodeHint = Format.EncodeHint;
+	InputSampleRate = Format.SampleRate;
+	NumInChannels = Format.NumChannels;
+
+	CaptureSampleRate = VOICE_DEVICE_SAMPLE_RATE;
+	NumCaptureChannels = VOICE_DEVICE_NUM_CHANNELS;
+	OutputSampleRate = VOICE_DEVICE_SAMPLE_RATE;
+	NumOutChannels = VOICE_DEVICE_NUM_CHANNELS;
 }
 
 void UVoiceChatComponent::InitVoiceCapture()
+{
+	InitVoiceCapture(FVoiceChatDeviceCache::Get().AcquireCapture(DeviceName, CaptureSampleRate, NumCaptureChannels));
+	bCaptureFromCache = VoiceCapture.IsValid();
+}
+
+void UVoiceChatComponent::InitVoiceCapture(const TSharedPtr<IVoiceCapture>& InVoiceCapture)
 {
 	ensure(!VoiceCapture.IsValid());
-	VoiceCapture = FVoiceModule::Get().CreateVoiceCapture(DeviceName, InputSampleRate, NumInChannels);
+	VoiceCapture = InVoiceCapture;
+	bCaptureFromCache = false;
 	if (VoiceCapture.IsValid())
 	{
 		MaxRawCaptureDataSize = VoiceCapture->GetBufferSize();
@@ -122,415 +215,1582 @@ void UVoiceChatComponent::InitVoiceCapture()
 		RawCaptureData.Empty(MaxRawCaptureDataSize);
 		RawCaptureData.AddUninitialized(MaxRawCaptureDataSize);
 
-		VoiceCapture->Start();
+		CaptureConverter.Init(CaptureSampleRate, NumCaptureChannels, InputSampleRate, NumInChannels);
+
+		// Captures opened by InitWithInputDeviceAsync were already started on the worker
+		if (!VoiceCapture->IsCapturing())
+		{
+			VoiceCapture->Start();
+		}
 		UE_LOG(LogVoice, Log, TEXT("Voice Capture started"));
-		UKismetSystemLibrary::PrintString(this, FString("Voice Capture started "), true, true, FLinearColor::Red, 0.f);
 	}
 }
 
 void UVoiceChatComponent::InitVoiceEncoder()
+{
+	InitVoiceEncoder(FVoiceChatDeviceCache::Get().AcquireEncoder(InputSampleRate, NumInChannels, EncodeHint));
+}
+
+void UVoiceChatComponent::InitVoiceEncoder(const TSharedPtr<IVoiceEncoder>& InVoiceEncoder)
 {
 	ensure(!VoiceEncoder.IsValid());
-	VoiceEncoder = FVoiceModule::Get().CreateVoiceEncoder(InputSampleRate, NumInChannels, EncodeHint);
+	VoiceEncoder = InVoiceEncoder;
 	if (VoiceEncoder.IsValid())
 	{
-		MaxRemainderSize = VOICE_STARTING_REMAINDER_SIZE;
-		LastRemainderSize = 0;
+		CaptureReadOffset = 0;
+		CaptureWriteOffset = 0;
 		MaxCompressedDataSize = VOICE_MAX_COMPRESSED_BUFFER;
 
-		CompressedData.Empty(MaxCompressedDataSize);
-		CompressedData.AddUninitialized(MaxCompressedDataSize);
+		VAD.Configure(InputSampleRate, VoiceActivityThresholdDb, VoiceActivityHangoverMs, VoiceActivityMaxZeroCrossingRate);
+		bIsTransmitting = false;
+		ApplyCaptureProcessing();
+
+		BitrateController.Configure(MinBitrate, MaxBitrate, MaxEncoderComplexity);
+		bEncoderTuned = false;
+		if (bAdaptiveBitrate)
+		{
+			ApplyEncoderSettings();
+		}
 
-		Remainder.Empty(MaxRemainderSize);
-		Remainder.AddUninitialized(MaxRemainderSize);
+		LoopbackConverter.Init(InputSampleRate, NumInChannels, OutputSampleRate, NumOutChannels);
 
 		UE_LOG(LogVoice, Log, TEXT("Voice Encoder started"));
-		UKismetSystemLibrary::PrintString(this, FString("Voice Encoder started "), true, true, FLinearColor::Red, 0.f);
 	}
 }
 
 void UVoiceChatComponent::InitVoiceDecoder()
+{
+	InitVoiceDecoder(FVoiceChatDeviceCache::Get().AcquireDecoder(InputSampleRate, NumInChannels));
+}
+
+void UVoiceChatComponent::InitVoiceDecoder(const TSharedPtr<IVoiceDecoder>& InVoiceDecoder)
 {
 	ensure(!VoiceDecoder.IsValid());
-	VoiceDecoder = FVoiceModule::Get().CreateVoiceDecoder(OutputSampleRate, NumOutChannels);
+	VoiceDecoder = InVoiceDecoder;
 	if (VoiceDecoder.IsValid())
 	{
-		// Approx 1 sec worth of data
-		MaxUncompressedDataSize = NumOutChannels * OutputSampleRate * sizeof(uint16);
-
-		UncompressedData.Empty(MaxUncompressedDataSize);
-		UncompressedData.AddUninitialized(MaxUncompressedDataSize);
+		InitPlaybackQueue();
 
-		MaxUncompressedDataQueueSize = MaxUncompressedDataSize * 5;
-		{
-			FScopeLock ScopeLock(&QueueLock);
-			UncompressedDataQueue.Empty(MaxUncompressedDataQueueSize);
-		}
+		ReceiveStream.SetLossConcealment(bConcealPacketLoss);
+		ReceiveStream.SetDriftCompensation(bCompensateClockDrift, DriftToleranceMs);
+		ReceiveStream.SetLatencyMarks(&PendingLatencyMarks);
+		ReceiveStream.Init(VoiceDecoder, InputSampleRate, NumInChannels, OutputSampleRate, NumOutChannels, JitterBufferMinDelayMs, JitterBufferMaxDelayMs, MaxPlayoutLatencyMs);
 
 		UE_LOG(LogVoice, Log, TEXT("Voice Decoder started"));
-		UKismetSystemLibrary::PrintString(this, FString("Voice Decoder started "), true, true, FLinearColor::Red, 0.f);
 	}
 }
 
-void UVoiceChatComponent::Shutdown()
+void UVoiceChatComponent::InitPlaybackQueue()
 {
-	RawCaptureData.Empty();
-	CompressedData.Empty();
-	UncompressedData.Empty();
-	Remainder.Empty();
+	// Approx 1 sec worth of data
+	MaxUncompressedDataSize = NumOutChannels * OutputSampleRate * sizeof(uint16);
+
+	// Up to 5 sec, less when the many other queues already take most of the budget. The old storage goes back to the
+	// pool and may be handed to another component at once, no audio thread may still be reading it.
+	FencePlayback();
+	MaxUncompressedDataQueueSize = UncompressedDataQueue.Acquire(MaxUncompressedDataSize * 5, MaxUncompressedDataSize * VOICE_MIN_QUEUE_MS / 1000);
+	bPlaybackQueueOpen.Store(true);
+}
+
+void UVoiceChatComponent::InitSoundStreaming()
+{
+	USoundWaveProcedural* newSoundStreaming = NewObject<USoundWaveProcedural>();
+	newSoundStreaming->SetSampleRate(OutputSampleRate);
+	newSoundStreaming->NumChannels = NumOutChannels;
+	newSoundStreaming->Duration = INDEFINITELY_LOOPING_DURATION;
+	newSoundStreaming->SoundGroup = SOUNDGROUP_Voice;
+	newSoundStreaming->bLooping = false;
+
+	// Turn off async generation in old audio engine on mac.
+#if PLATFORM_MAC
+	FAudioDevice* AudioDevice = GetAudioDevice();
+	if (AudioDevice && !AudioDevice->IsAudioMixerEnabled())
+	{
+		newSoundStreaming->bCanProcessAsync = false;
+	}
+	else
+#endif // #if PLATFORM_MAC
+	{
+		newSoundStreaming->bCanProcessAsync = true;
+	}
 
+	Sound = newSoundStreaming;
+	bIsUISound = false;
+	bAllowSpatialization = true;
+	SetVolumeMultiplier(1.5f);
+}
+
+void UVoiceChatComponent::InitSoundClass(bool bAsync)
+{
+	const FSoftObjectPath VoiPSoundClassName = GetDefault<UAudioSettings>()->VoiPSoundClass;
+	if (!VoiPSoundClassName.IsValid())
+	{
+		return;
+	}
+
+	// Usually already loaded by the first voice component
+	if (USoundClass* SoundClass = Cast<USoundClass>(VoiPSoundClassName.ResolveObject()))
+	{
+		SoundClassOverride = SoundClass;
+	}
+	else if (bAsync)
+	{
+		// Applies from the next Play, voice rarely starts before the load completes
+		TWeakObjectPtr<UVoiceChatComponent> WeakThis(this);
+		LoadPackageAsync(VoiPSoundClassName.GetLongPackageName(), FLoadPackageAsyncDelegate::CreateLambda(
+			[WeakThis, VoiPSoundClassName](const FName& PackageName, UPackage* Package, EAsyncLoadingResult::Type Result)
+		{
+			if (WeakThis.IsValid() && Result == EAsyncLoadingResult::Succeeded)
+			{
+				WeakThis->SoundClassOverride = Cast<USoundClass>(VoiPSoundClassName.ResolveObject());
+			}
+		}));
+	}
+	else
 	{
-		FScopeLock ScopeLock(&QueueLock);
-		UncompressedDataQueue.Empty();
+		SoundClassOverride = LoadObject<USoundClass>(nullptr, *VoiPSoundClassName.ToString());
 	}
+}
+
+void UVoiceChatComponent::Shutdown()
+{
+	WaitForPipeline();
+
+	// Drop the result of an async init still in flight
+	++InitSerial;
+	bIsInitializing = false;
+
+	RawCaptureData.Empty();
+	CaptureReadOffset = 0;
+	CaptureWriteOffset = 0;
+	RedundantPayload.Empty();
+	ConvertedCapture.Empty();
+	ConvertedLoopback.Empty();
+	CapturePacketPool.Empty();
+	IncomingPacketPool.Empty();
+	Recorder.Reset();
+	SenderMix.Empty();
 
 	CleanupVoice();
 	CleanupAudioComponent();
+
+	// Only release the queue storage once no audio thread can be reading from it any more
+	FencePlayback();
+	UncompressedDataQueue.Release();
+	bMidTalkSpurt = false;
+	UpdateMemoryUsage();
 }
 
 void UVoiceChatComponent::CleanupVoice()
 {
+	// Devices and codecs go back to the cache for the next component instead of being closed
+	FVoiceChatDeviceCache& Cache = FVoiceChatDeviceCache::Get();
 	if (VoiceCapture.IsValid())
 	{
-		VoiceCapture->Shutdown();
+		if (bCaptureFromCache)
+		{
+			Cache.ReleaseCapture(VoiceCapture, DeviceName, CaptureSampleRate, NumCaptureChannels);
+		}
+		else
+		{
+			VoiceCapture->Shutdown();
+		}
 		VoiceCapture = nullptr;
 	}
+	bCaptureFromCache = false;
 
+	// Reset keeps the bitrate, VBR and complexity, an encoder tuned for this talker's network is not one to share
+	if (!bEncoderTuned)
+	{
+		Cache.ReleaseEncoder(VoiceEncoder, InputSampleRate, NumInChannels, EncodeHint);
+	}
 	VoiceEncoder = nullptr;
+	bEncoderTuned = false;
+	ReceiveStream.Shutdown();
+	Cache.ReleaseDecoder(VoiceDecoder, InputSampleRate, NumInChannels);
 	VoiceDecoder = nullptr;
+
+	for (TPair<int32, TUniquePtr<FVoiceChatSender>>& Pair : Senders)
+	{
+		TSharedPtr<IVoiceDecoder> Decoder = Pair.Value->Stream.GetDecoder();
+		Pair.Value->Stream.Shutdown();
+		Cache.ReleaseDecoder(Decoder, InputSampleRate, NumInChannels);
+	}
+	Senders.Empty();
+	for (const TSharedPtr<IVoiceDecoder>& Decoder : IdleDecoders)
+	{
+		Cache.ReleaseDecoder(Decoder, InputSampleRate, NumInChannels);
+	}
+	IdleDecoders.Empty();
 }
 
 void UVoiceChatComponent::CleanupAudioComponent()
 {
 	Stop();
 
-	SoundStreaming->OnSoundWaveProceduralUnderflow.Unbind();
-	SoundStreaming = nullptr;
+	// Never bound if the component was shut down before its first tick
+	if (SoundStreaming)
+	{
+		SoundStreaming->OnSoundWaveProceduralUnderflow.Unbind();
+		SoundStreaming = nullptr;
+	}
 
 	bLastWasPlaying = false;
 }
 
 void UVoiceChatComponent::CleanupQueue()
 {
-	FScopeLock ScopeLock(&QueueLock);
-	UncompressedDataQueue.Reset();
+	UncompressedDataQueue.Flush();
 }
 
-void UVoiceChatComponent::GenerateData(USoundWaveProcedural* InProceduralWave, int32 SamplesRequired)
+void UVoiceChatComponent::FencePlayback()
 {
-	const int32 SampleSize = sizeof(uint16) * NumOutChannels;
-
+	// Pairs with GenerateData announcing itself before it checks the flag, one of the two always sees the other
+	bPlaybackQueueOpen.Store(false);
+	while (ActivePlaybackReads.Load() > 0)
 	{
-		FScopeLock ScopeLock(&QueueLock);
-		CurrentUncompressedDataQueueSize = UncompressedDataQueue.Num();
-		const int32 AvailableSamples = CurrentUncompressedDataQueueSize / SampleSize;
-		if (AvailableSamples >= SamplesRequired)
-		{
-			InProceduralWave->QueueAudio(UncompressedDataQueue.GetData(), AvailableSamples * SampleSize);
-			UncompressedDataQueue.RemoveAt(0, AvailableSamples * SampleSize, false);
-			CurrentUncompressedDataQueueSize -= (AvailableSamples * SampleSize);
-		}
+		// At most the rest of one callback
+		FPlatformProcess::Yield();
 	}
 }
 
-void UVoiceChatComponent::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+void UVoiceChatComponent::UpdateClockOffset()
 {
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	UWorld* World = GetWorld();
+	AGameStateBase* GameState = World ? World->GetGameState() : nullptr;
+	if (!GameState)
+	{
+		return;
+	}
+
+	// Server world time only advances once per frame, smooth it so stamps taken mid frame do not jitter by a frame time
+	const int64 Target = (int64)((GameState->GetServerWorldTimeSeconds() - FPlatformTime::Seconds()) * 1e6);
+	const int64 Current = ClockOffsetMicroseconds.Load();
+	const int64 Delta = Target - Current;
+	ClockOffsetMicroseconds.Store(FMath::Abs(Delta) > 1000000 ? Target : Current + Delta / 16);
+}
 
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_FTestVoice_Tick);
+double UVoiceChatComponent::GetClockOffsetSeconds() const
+{
+	return ClockOffsetMicroseconds.Load() / 1e6;
+}
 
-	UKismetSystemLibrary::PrintString(this, FString("Voicechat Ticking"), true, true, FLinearColor::Red, 0.f);
+void UVoiceChatComponent::ResolveLatencyMarks(uint32 PlayedPosition, uint32 PlayedBytes)
+{
+	const double Now = FPlatformTime::Seconds();
 
-	if (!IsRunningDedicatedServer() && IsValid(Sound))
+	const FVoiceChatLatencyMark* First;
+	const FVoiceChatLatencyMark* Second;
+	uint32 FirstNum, SecondNum;
+	while (PendingLatencyMarks.Peek(First, FirstNum, Second, SecondNum) > 0)
 	{
-		/*VoiceComp = CreateVoiceAudioComponent(OutputSampleRate, NumOutChannels);
-		VoiceComp->AddToRoot();*/
-		SoundStreaming = CastChecked<USoundWaveProcedural>(Sound);
-		if (SoundStreaming)
+		const int32 Offset = (int32)(First->QueuePosition - PlayedPosition);
+		if (Offset >= (int32)PlayedBytes)
 		{
-			// Bind the GenerateData callback with FOnSoundWaveProceduralUnderflow object
-			SoundStreaming->OnSoundWaveProceduralUnderflow = FOnSoundWaveProceduralUnderflow::CreateUObject(this, &UVoiceChatComponent::GenerateData);
+			// Not played yet
+			break;
 		}
-	}
 
-	if (!SoundStreaming)
-	{
-		UKismetSystemLibrary::PrintString(this, FString("SoundStreaming is not valid"), true, true, FLinearColor::Red, 0.f);
-		return;
-	}
-	//check(SoundStreaming);
+		FVoiceChatLatencyMark Mark = *First;
+		PendingLatencyMarks.Consume(1);
 
-	bool bIsPlaying = IsPlaying();
-	if (bIsPlaying != bLastWasPlaying)
-	{
-		UE_LOG(LogVoice, Log, TEXT("VOIP audio component %s playing!"), bIsPlaying ? TEXT("is") : TEXT("is not"));
-		bLastWasPlaying = bIsPlaying;
+		// Audio before PlayedPosition was flushed without being played
+		if (Offset >= 0)
+		{
+			Mark.PlayoutTime = Now;
+			PlayedLatencyMarks.Enqueue(MoveTemp(Mark));
+		}
 	}
+}
 
-	StarvedDataCount = (!bIsPlaying || (SoundStreaming->GetAvailableAudioByteCount() != 0)) ? 0 : (StarvedDataCount + 1);
-	if (StarvedDataCount > 1)
+float UVoiceChatComponent::ComputeAudibleVolume() const
+{
+	const FSoundAttenuationSettings* AttenuationSettings = bAllowSpatialization ? GetAttenuationSettingsToApply() : nullptr;
+	if (!AttenuationSettings || !AttenuationSettings->bAttenuate)
 	{
-		UE_LOG(LogVoice, Log, TEXT("VOIP audio component starved %d frames!"), StarvedDataCount);
+		return 1.0f;
 	}
 
-	if (VoiceCapture.IsValid())
+	UWorld* World = GetWorld();
+	APlayerController* PlayerController = World ? World->GetFirstPlayerController() : nullptr;
+	if (!PlayerController)
 	{
-		UE_LOG(LogVoice, Log, TEXT("Ciizas"));
-
-		bool bDoWork = false;
-		uint32 TotalVoiceBytes = 0;
-
-
-		uint32 NewVoiceDataBytes = 0;
-		EVoiceCaptureState::Type MicState = VoiceCapture->GetCaptureState(NewVoiceDataBytes);
-		if (MicState == EVoiceCaptureState::Ok && NewVoiceDataBytes > 0)
-		{
-			//UE_LOG(LogVoice, Log, TEXT("Getting data! %d"), NewVoiceDataBytes);
-			if (LastRemainderSize > 0)
-			{
-				// Add back any data from the previous frame
-				VOICE_BUFFER_CHECK(RawCaptureData, LastRemainderSize);
-				FMemory::Memcpy(RawCaptureData.GetData(), Remainder.GetData(), LastRemainderSize);
-			}
-
-			// Add new data at the beginning of the last frame
-			uint64 SampleCount;
-			MicState = VoiceCapture->GetVoiceData(RawCaptureData.GetData() + LastRemainderSize, NewVoiceDataBytes, NewVoiceDataBytes, SampleCount);
-			TotalVoiceBytes = NewVoiceDataBytes + LastRemainderSize;
-
-			UKismetSystemLibrary::PrintString(this, FString("New voice data bytes: ").Append(FString::FromInt(NewVoiceDataBytes)), true, true, FLinearColor::Red, 0.f);
-
-			// Check to make sure this buffer has a valid, chronological buffer count.
-			if (SampleCount <= CachedSampleCount)
-			{
-				UE_LOG(LogVoice, Log, TEXT("Out of order or ambiguous sample count detected! This sample count: %lu Previous sample count: %lu"), SampleCount, CachedSampleCount);
-			}
-
-			CachedSampleCount = SampleCount;
-
-			//VOICE_BUFFER_CHECK(RawCaptureData, TotalVoiceBytes);
-			UKismetSystemLibrary::PrintString(this, FString("RawCaptureData, TotalVoiceBytes: MicState: ").Append(FString::FromInt(TotalVoiceBytes)).Append(" ").Append(FString::FromInt(RawCaptureData.Num())).Append(" ").Append(EVoiceCaptureState::ToString(MicState)), true, true, FLinearColor::Red, 0.f);
-			bDoWork = (MicState == EVoiceCaptureState::Ok);
-		}
-
-
-		if (bDoWork && TotalVoiceBytes > 0)
-		{
-			// At this point, we know that we have some valid data in our hands that is ready to play
-			UKismetSystemLibrary::PrintString(this, FString("TotalVoiceBytes: ").Append(FString::FromInt(TotalVoiceBytes)), true, true, FLinearColor::Red, 0.f);
-
-			// COMPRESSION BEGIN
-			uint32 CompressedDataSize = 0;
-			if (VoiceEncoder.IsValid())
-			{
-				CompressedDataSize = MaxCompressedDataSize;
-				LastRemainderSize = VoiceEncoder->Encode(RawCaptureData.GetData(), TotalVoiceBytes, CompressedData.GetData(), CompressedDataSize);
-				VOICE_BUFFER_CHECK(RawCaptureData, CompressedDataSize);
+		return 1.0f;
+	}
 
-				if (LastRemainderSize > 0)
-				{
-					if (LastRemainderSize > MaxRemainderSize)
-					{
-						UE_LOG(LogVoice, Verbose, TEXT("Overflow!"));
-						Remainder.AddUninitialized(LastRemainderSize - MaxRemainderSize);
-						MaxRemainderSize = Remainder.Num();
-					}
-
-					VOICE_BUFFER_CHECK(Remainder, LastRemainderSize);
-					FMemory::Memcpy(Remainder.GetData(), RawCaptureData.GetData() + (TotalVoiceBytes - LastRemainderSize), LastRemainderSize);
-				}
-			}
-			// COMPRESSION END
+	FVector ListenerLocation, ListenerFront, ListenerRight;
+	PlayerController->GetAudioListenerPosition(ListenerLocation, ListenerFront, ListenerRight);
+	return AttenuationSettings->Evaluate(GetComponentTransform(), ListenerLocation) * VolumeMultiplier;
+}
 
-			UKismetSystemLibrary::PrintString(this, FString("Data compressed: ArraySize: ").Append(FString::FromInt(CompressedData.Num())).Append("CompressedDataSize").Append(FString::FromInt(CompressedDataSize)), true, true, FLinearColor::Red, 0.f);
+void UVoiceChatComponent::UpdateCulling()
+{
+	AudibleVolume = ComputeAudibleVolume();
 
-			// After the compressed data is placed on the buffer, place it on a clean array to transmit the size with the array and reduce the network weight (Lots of data is irrelevant)
-			TArray<uint8> CompressedCulledData;
-			CompressedCulledData.AddUninitialized(CompressedDataSize);
-			FMemory::Memcpy(CompressedCulledData.GetData(), CompressedData.GetData(), CompressedDataSize);
+	// Twice the threshold to come back, a talker hovering at the edge would otherwise resync every few frames
+	const bool bShouldCull = bEnableDistanceCulling && AudibleVolume < (bIsCulled ? CullingVolumeThreshold * 2.0f : CullingVolumeThreshold);
+	if (bShouldCull == bIsCulled)
+	{
+		return;
+	}
 
-			UKismetSystemLibrary::PrintString(this, FString("Data compressed: ArraySize: ").Append(FString::FromInt(CompressedCulledData.Num())).Append("CompressedDataSize").Append(FString::FromInt(CompressedDataSize)), true, true, FLinearColor::Red, 0.f);
+	VOICECHAT_DEBUG_LOG(TEXT("Voice %s, volume at listener %f"), bShouldCull ? TEXT("culled") : TEXT("back in range"), AudibleVolume);
+	bIsCulled = bShouldCull;
 
-			OnAudioCaptureCompleted.Broadcast(CompressedCulledData, true);
+	// Entering: nothing received from now on reaches the decoders. Leaving: start over from the next packet, the
+	// decoders and jitter buffers must not continue from the audio before culling.
+	ResyncReceive();
+}
 
-			//return;
+void UVoiceChatComponent::ResyncReceive()
+{
+	WaitForPipeline();
 
-			// DECOMPRESSION BEGIN
-			uint32 UncompressedDataSize = 0;
-			if (VoiceDecoder.IsValid() && CompressedDataSize > 0)
-			{
-				UKismetSystemLibrary::PrintString(this, FString("Decompressing Data"), true, true, FLinearColor::Red, 0.f);
+	// The pipeline is idle, so the game thread may consume in its place
+	FIncomingVoicePacket Incoming;
+	while (IncomingPackets.Dequeue(Incoming))
+	{
+		Incoming.Packet.Reset();
+	}
 
-				UncompressedDataSize = MaxUncompressedDataSize;
-				VoiceDecoder->Decode(CompressedData.GetData(), CompressedDataSize,
-					UncompressedData.GetData(), UncompressedDataSize);
-				VOICE_BUFFER_CHECK(UncompressedData, UncompressedDataSize);
-				UKismetSystemLibrary::PrintString(this, FString("Data uncompressed: CompressedArraySize: ").Append(FString::FromInt(CompressedDataSize)).Append("UncompressedDataSize").Append(FString::FromInt(UncompressedDataSize)), true, true, FLinearColor::Red, 0.f);
-			}
-			// DECOMPRESSION END
+	ReceiveStream.Reset();
+	for (TPair<int32, TUniquePtr<FVoiceChatSender>>& Pair : Senders)
+	{
+		ReleaseSender(*Pair.Value);
+	}
+	Senders.Empty();
 
-			const uint8* VoiceDataPtr = nullptr;
-			uint32 VoiceDataSize = 0;
+	CleanupQueue();
+	JitterStats = ReceiveStream.GetStats();
+}
 
-			if (bUseDecompressed)
-			{
-				if (UncompressedDataSize > 0)
-				{
-					//UE_LOG(LogVoice, Log, TEXT("Queuing uncompressed data! %d"), UncompressedDataSize);
-					if (bZeroOutput)
-					{
-						FMemory::Memzero((uint8*)UncompressedData.GetData(), UncompressedDataSize);
-					}
-
-					VoiceDataSize = UncompressedDataSize;
-					VoiceDataPtr = UncompressedData.GetData();
-				}
-			}
-			else
-			{
-				//UE_LOG(LogVoice, Log, TEXT("Queuing original data! %d"), UncompressedDataSize);
-				VoiceDataPtr = RawCaptureData.GetData();
-				VoiceDataSize = (TotalVoiceBytes - LastRemainderSize);
-			}
+bool UVoiceChatComponent::EnqueueUncompressedData(const uint8* VoiceDataPtr, uint32 VoiceDataSize)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoiceChat_Queue);
 
-			if (VoiceDataPtr && VoiceDataSize > 0)
-			{
-				FScopeLock ScopeLock(&QueueLock);
+	if (!UncompressedDataQueue.Push(VoiceDataPtr, VoiceDataSize))
+	{
+		INC_DWORD_STAT(STAT_VoiceChat_Overflows);
+		VOICECHAT_DEBUG_LOG(TEXT("UncompressedDataQueue Overflow!"));
+		return false;
+	}
 
-				const int32 OldSize = UncompressedDataQueue.Num();
-				const int32 AmountToBuffer = (OldSize + (int32)VoiceDataSize);
-				if (AmountToBuffer <= MaxUncompressedDataQueueSize)
-				{
-					UncompressedDataQueue.AddUninitialized(VoiceDataSize);
+	INC_DWORD_STAT_BY(STAT_VoiceChat_BytesQueued, VoiceDataSize);
+	return true;
+}
 
-					VOICE_BUFFER_CHECK(UncompressedDataQueue, AmountToBuffer);
-					FMemory::Memcpy(UncompressedDataQueue.GetData() + OldSize, VoiceDataPtr, VoiceDataSize);
-					CurrentUncompressedDataQueueSize += VoiceDataSize;
-				}
-				else
-				{
-					UE_LOG(LogVoice, Warning, TEXT("UncompressedDataQueue Overflow!"));
-				}
-			}
+float UVoiceChatComponent::GetQueuedPlaybackMs() const
+{
+	const int32 BytesPerSecond = sizeof(uint16) * NumOutChannels * OutputSampleRate;
+	if (BytesPerSecond <= 0)
+	{
+		return 0.0f;
+	}
 
-			// Wait for approx 1 sec worth of data before playing
-			if (!bIsPlaying && (CurrentUncompressedDataQueueSize > (MaxUncompressedDataSize / 2)))
-			{
-				UE_LOG(LogVoice, Log, TEXT("Playback started"));
-				UKismetSystemLibrary::PrintString(this, FString("Playback started"), true, true, FLinearColor::Red, 0.f);
-				Play();
-			}
-		}
+	int32 QueuedBytes = UncompressedDataQueue.Num();
+	if (SoundStreaming)
+	{
+		QueuedBytes += SoundStreaming->GetAvailableAudioByteCount();
 	}
+	return QueuedBytes * 1000.0f / BytesPerSecond;
 }
 
-void UVoiceChatComponent::PlayVoiceChatAudio(TArray<uint8> VoiceData, bool IsCompressed)
+void UVoiceChatComponent::ServiceJitterBuffer()
 {
-	UKismetSystemLibrary::PrintString(this, FString("Data received: ArraySize: ").Append(FString::FromInt(VoiceData.Num())), true, true, FLinearColor::Red, 0.f);
+	ReceiveStream.Service(UncompressedDataQueue, GetQueuedPlaybackMs());
 
-	TArray<uint8> AudioToPlay;
-
-	uint32 UncompressedDataSize = 0;
+	if (Senders.Num() > 0)
+	{
+		ServiceSenders();
+	}
 
-	const uint8* VoiceDataPtr = nullptr;
-	uint32 VoiceDataSize = 0;
-	if (true)
+	// Components without a decoder are fed by a mixer or play sidetone, they never fill underflows on their own
+	if (VoiceDecoder.IsValid() || Senders.Num() > 0)
 	{
-		// DECOMPRESSION BEGIN
-		if (VoiceDecoder.IsValid() && VoiceData.Num() > 0)
+		bool bTalking = !ReceiveStream.IsSilent();
+		for (const TPair<int32, TUniquePtr<FVoiceChatSender>>& Pair : Senders)
 		{
-			AudioToPlay.AddUninitialized(MaxUncompressedDataSize);
-			UncompressedDataSize = MaxUncompressedDataSize;
-			VoiceDecoder->Decode(VoiceData.GetData(), VoiceData.Num(),
-				AudioToPlay.GetData(), UncompressedDataSize);
-			VOICE_BUFFER_CHECK(AudioToPlay, UncompressedDataSize);
-
-			VoiceDataSize = UncompressedDataSize;
-			VoiceDataPtr = AudioToPlay.GetData();
-
-			UKismetSystemLibrary::PrintString(this, FString("Decompressed data: ArraySize: ").Append(FString::FromInt(UncompressedDataSize)), true, true, FLinearColor::Red, 0.f);
+			bTalking |= !Pair.Value->Stream.IsSilent();
 		}
-		// DECOMPRESSION END
+		bMidTalkSpurt = bTalking;
 	}
-	else
+}
+
+void UVoiceChatComponent::ProcessIncomingPackets()
+{
+	FIncomingVoicePacket Incoming;
+	while (IncomingPackets.Dequeue(Incoming))
 	{
-		AudioToPlay = VoiceData;
-		VoiceDataPtr = AudioToPlay.GetData();
-		VoiceDataSize = AudioToPlay.Num();
+		InsertIncomingPacket(Incoming.SenderId, Incoming.Packet->Data, Incoming.ArrivalTime);
+		Incoming.Packet.Reset();
 	}
+}
 
-	if (VoiceDataPtr && VoiceDataSize > 0)
+void UVoiceChatComponent::InsertIncomingPacket(int32 SenderId, TArrayView<const uint8> Packet, double ArrivalTime)
+{
+	if (SenderId == INDEX_NONE)
 	{
-		FScopeLock ScopeLock(&QueueLock);
-
-		const int32 OldSize = UncompressedDataQueue.Num();
-		const int32 AmountToBuffer = (OldSize + (int32)VoiceDataSize);
-		if (AmountToBuffer <= MaxUncompressedDataQueueSize)
-		{
-			UncompressedDataQueue.AddUninitialized(VoiceDataSize);
-
-			VOICE_BUFFER_CHECK(UncompressedDataQueue, AmountToBuffer);
-			FMemory::Memcpy(UncompressedDataQueue.GetData() + OldSize, VoiceDataPtr, VoiceDataSize);
-			CurrentUncompressedDataQueueSize += VoiceDataSize;
-		}
-		else
-		{
-			UE_LOG(LogVoice, Warning, TEXT("UncompressedDataQueue Overflow!"));
-		}
+		ReceiveStream.InsertPacket(Packet, ArrivalTime);
 	}
-
-	// Wait for approx 1 sec worth of data before playing
-	// TODO: This should be much lower: MaxUncompressedDataSize / 2 equals 1 sec
-	// TODO: What happens if an amount that is smaller is sent?
-	// TODO: If it is already playing, we will forget about this current bunch. We should store it
-	if (!IsPlaying() && (CurrentUncompressedDataQueueSize > (MaxUncompressedDataSize / 4)))
+	else if (FVoiceChatSender* Sender = FindOrAddSender(SenderId, ArrivalTime))
 	{
-		UE_LOG(LogVoice, Log, TEXT("Playback started"));
-		Play();
+		Sender->LastPacketTime = ArrivalTime;
+		Sender->Stream.InsertPacket(Packet, ArrivalTime);
 	}
 }
 
-void UVoiceChatComponent::InitAsListener()
+FVoiceChatSender* UVoiceChatComponent::FindOrAddSender(int32 SenderId, double Now)
 {
-	EncodeHint = EAudioEncodeHint::VoiceEncode_Audio;
-	InputSampleRate = 48000;
-	OutputSampleRate = 48000;
-	NumInChannels = 2;
-	NumOutChannels = 2;
-
-	InitVoiceDecoder();
+	if (TUniquePtr<FVoiceChatSender>* Existing = Senders.Find(SenderId))
+	{
+		return Existing->Get();
+	}
 
-	USoundWaveProcedural* newSoundStreaming = NewObject<USoundWaveProcedural>();
-	newSoundStreaming->SetSampleRate(OutputSampleRate);
-	newSoundStreaming->NumChannels = NumOutChannels;
-	newSoundStreaming->Duration = INDEFINITELY_LOOPING_DURATION;
-	newSoundStreaming->SoundGroup = SOUNDGROUP_Voice;
-	newSoundStreaming->bLooping = false;
+	if (Senders.Num() >= FMath::Max(MaxSenderDecoders, 1))
+	{
+		// Evict the least recently heard sender, its decoder goes to the newcomer
+		int32 OldestId = INDEX_NONE;
+		double OldestTime = Now;
+		for (const TPair<int32, TUniquePtr<FVoiceChatSender>>& Pair : Senders)
+		{
+			if (OldestId == INDEX_NONE || Pair.Value->LastPacketTime < OldestTime)
+			{
+				OldestId = Pair.Key;
+				OldestTime = Pair.Value->LastPacketTime;
+			}
+		}
+
+		UE_LOG(LogVoice, Log, TEXT("Sender decoder cache full, evicting sender %d for sender %d"), OldestId, SenderId);
+		ReleaseSender(*Senders.FindChecked(OldestId));
+		Senders.Remove(OldestId);
+	}
+
+	TSharedPtr<IVoiceDecoder> Decoder;
+	if (IdleDecoders.Num() > 0)
+	{
+		Decoder = IdleDecoders.Pop(false);
+	}
+	else
+	{
+		Decoder = FVoiceChatDeviceCache::Get().AcquireDecoder(InputSampleRate, NumInChannels);
+		if (!Decoder.IsValid())
+		{
+			UE_LOG(LogVoice, Warning, TEXT("Failed to create a decoder for sender %d"), SenderId);
+			return nullptr;
+		}
+	}
+
+	TUniquePtr<FVoiceChatSender> Sender = MakeUnique<FVoiceChatSender>();
+	Sender->Stream.SetLossConcealment(bConcealPacketLoss);
+	Sender->Stream.SetDriftCompensation(bCompensateClockDrift, DriftToleranceMs);
+	Sender->Stream.Init(Decoder, InputSampleRate, NumInChannels, OutputSampleRate, NumOutChannels, JitterBufferMinDelayMs, JitterBufferMaxDelayMs, MaxPlayoutLatencyMs);
+	// Approx 1 sec worth of data, the jitter buffer keeps the sender queue well below that
+	const uint32 BytesPerSecond = NumOutChannels * OutputSampleRate * sizeof(int16);
+	Sender->Queue.Acquire(BytesPerSecond, BytesPerSecond * VOICE_MIN_QUEUE_MS / 1000);
+	Sender->LastPacketTime = Now;
+
+	FVoiceChatSender* Result = Sender.Get();
+	Senders.Add(SenderId, MoveTemp(Sender));
+	return Result;
+}
+
+void UVoiceChatComponent::ReleaseSender(FVoiceChatSender& Sender)
+{
+	// Opus decoders carry state from the previous stream, reset before handing it to another sender
+	TSharedPtr<IVoiceDecoder> Decoder = Sender.Stream.GetDecoder();
+	Sender.Stream.Shutdown();
+	if (Decoder.IsValid() && IdleDecoders.Num() < MaxSenderDecoders)
+	{
+		Decoder->Reset();
+		IdleDecoders.Add(Decoder);
+	}
+	else
+	{
+		// More than this component keeps, other components may still use it
+		FVoiceChatDeviceCache::Get().ReleaseDecoder(Decoder, InputSampleRate, NumInChannels);
+	}
+}
+
+void UVoiceChatComponent::UpdateMemoryUsage()
+{
+	// Scratch buffers are shared by every component on the same thread, they show in their own stat instead
+	int64 Usage = RawCaptureData.GetAllocatedSize() + ConvertedCapture.GetAllocatedSize() + ConvertedLoopback.GetAllocatedSize()
+		+ RedundantPayload.GetAllocatedSize() + UncompressedDataQueue.Capacity();
+	for (const TPair<int32, TUniquePtr<FVoiceChatSender>>& Pair : Senders)
+	{
+		Usage += Pair.Value->Queue.Capacity();
+	}
+
+	const int32 NewUsage = (int32)FMath::Min<int64>(Usage, MAX_int32);
+	if (NewUsage > MemoryUsage)
+	{
+		INC_MEMORY_STAT_BY(STAT_VoiceChat_ComponentMemory, NewUsage - MemoryUsage);
+	}
+	else
+	{
+		DEC_MEMORY_STAT_BY(STAT_VoiceChat_ComponentMemory, MemoryUsage - NewUsage);
+	}
+	MemoryUsage = NewUsage;
+}
+
+void UVoiceChatComponent::GetResourceSizeEx(FResourceSizeEx& CumulativeResourceSize)
+{
+	Super::GetResourceSizeEx(CumulativeResourceSize);
+
+	CumulativeResourceSize.AddDedicatedSystemMemoryBytes(MemoryUsage);
+}
+
+void UVoiceChatComponent::ServiceSenders()
+{
+	const double Now = FPlatformTime::Seconds();
+	const float QueuedMs = GetQueuedPlaybackMs();
+	const float BytesPerMs = NumOutChannels * sizeof(int16) * OutputSampleRate / 1000.0f;
+
+	int32 AvailableFrames = 0;
+	for (auto It = Senders.CreateIterator(); It; ++It)
+	{
+		FVoiceChatSender& Sender = *It.Value();
+		if (Now - Sender.LastPacketTime > SenderTimeoutSeconds)
+		{
+			UE_LOG(LogVoice, Log, TEXT("Sender %d timed out"), It.Key());
+			ReleaseSender(Sender);
+			It.RemoveCurrent();
+			continue;
+		}
+
+		// Audio of this sender already mixed into the playback queue is still ahead of playback
+		Sender.Stream.Service(Sender.Queue, Sender.Queue.Num() / BytesPerMs + QueuedMs);
+		AvailableFrames = FMath::Max(AvailableFrames, FVoiceChatMixBuffer::GetQueuedFrames(Sender.Queue, NumOutChannels));
+	}
+
+	// Mix just far enough ahead for playback to start and ride out a late tick, senders short of audio are padded with silence
+	const int32 NumFrames = FMath::Min(AvailableFrames, FMath::CeilToInt((JitterBufferMaxDelayMs - QueuedMs) * OutputSampleRate / 1000.0f));
+	if (NumFrames <= 0)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_VoiceChat_Mix);
+
+	SenderMix.Begin(NumFrames, NumOutChannels);
+	for (const TPair<int32, TUniquePtr<FVoiceChatSender>>& Pair : Senders)
+	{
+		SenderMix.Add(Pair.Value->Queue, 1.0f);
+	}
+	EnqueueUncompressedData(SenderMix.Finish(), SenderMix.GetNumBytes());
+}
+
+void UVoiceChatComponent::EmitSilenceMarker()
+{
+	FVoiceChatPacketHeader Header;
+	Header.Flags = EVoiceChatPacketFlags::Silence;
+	Header.Sequence = OutgoingSequence++;
+	Header.Timestamp = OutgoingTimestamp;
+	Header.Channel = GetOutgoingChannel();
+
+	FVoiceChatPacketRef Packet = CapturePacketPool.Acquire(FVoiceChatPacketHeader::Size);
+	Header.Write(Packet->Data.GetData());
+	EmitPacket(Packet);
+
+	// The next talk spurt starts fresh, there is nothing worth recovering across the silence
+	RedundantPayload.Reset();
+}
+
+void UVoiceChatComponent::EmitPacket(const FVoiceChatPacketRef& Packet)
+{
+	if (IsInGameThread())
+	{
+		BroadcastPacket(Packet);
+	}
+	else if (!CapturedPackets.Enqueue(FVoiceChatPacketPtr(Packet)))
+	{
+		UE_LOG(LogVoice, Warning, TEXT("Captured packet queue overflow, the game thread is not keeping up"));
+	}
+}
+
+void UVoiceChatComponent::BroadcastPacket(const FVoiceChatPacketRef& Packet)
+{
+	if (Recorder.IsValid())
+	{
+		Recorder->RecordPacket(RecordingSpeakerId, Packet->Data, InputSampleRate, NumInChannels);
+	}
+
+	OnVoicePacketCaptured.Broadcast(Packet);
+	if (OnAudioCaptureCompleted.IsBound())
+	{
+		OnAudioCaptureCompleted.Broadcast(Packet->Data, true);
+	}
+}
+
+void UVoiceChatComponent::BroadcastCapturedPackets()
+{
+	FVoiceChatPacketPtr Packet;
+	while (CapturedPackets.Dequeue(Packet))
+	{
+		BroadcastPacket(Packet.ToSharedRef());
+		Packet.Reset();
+	}
+}
+
+void UVoiceChatComponent::WaitForPipeline()
+{
+	if (PipelineTask.IsValid())
+	{
+		FTaskGraphInterface::Get().WaitUntilTaskCompletes(PipelineTask);
+		PipelineTask = nullptr;
+	}
+}
+
+void UVoiceChatComponent::UpdatePlayback()
+{
+	if (!IsPlaying() && UncompressedDataQueue.Num() > 0 && GetQueuedPlaybackMs() >= JitterStats.TargetDelayMs)
+	{
+		UE_LOG(LogVoice, Log, TEXT("Playback started"));
+		Play();
+	}
+}
+
+void UVoiceChatComponent::GenerateData(USoundWaveProcedural* InProceduralWave, int32 SamplesRequired)
+{
+	// Audio render thread, consumer side of UncompressedDataQueue
+	SCOPE_CYCLE_COUNTER(STAT_VoiceChat_GenerateData);
+
+	// The game thread may be releasing the queue, see FencePlayback
+	++ActivePlaybackReads;
+	if (!bPlaybackQueueOpen.Load())
+	{
+		--ActivePlaybackReads;
+		return;
+	}
+	GenerateQueuedData(InProceduralWave, SamplesRequired);
+	--ActivePlaybackReads;
+}
+
+void UVoiceChatComponent::GenerateQueuedData(USoundWaveProcedural* InProceduralWave, int32 SamplesRequired)
+{
+
+	const int32 SampleSize = sizeof(uint16) * NumOutChannels;
+	// Audio handed over by earlier callbacks and not played yet counts towards this request
+	const int32 WaveFrames = InProceduralWave->GetAvailableAudioByteCount() / SampleSize;
+
+	const uint8* FirstRegion;
+	const uint8* SecondRegion;
+	uint32 FirstRegionSize, SecondRegionSize;
+	const uint32 AvailableBytes = UncompressedDataQueue.Peek(FirstRegion, FirstRegionSize, SecondRegion, SecondRegionSize);
+	const uint32 PlayedPosition = UncompressedDataQueue.GetPoppedCount();
+
+	// Hand over everything there is, even short of the request. Holding a partial request back until the next
+	// callback would play a dropout now and add its length to the latency afterwards.
+	const int32 AvailableFrames = AvailableBytes / SampleSize;
+	if (AvailableFrames > 0)
+	{
+		const uint32 BytesToQueue = AvailableFrames * SampleSize;
+		const uint32 FromFirstRegion = FMath::Min(BytesToQueue, FirstRegionSize);
+		InProceduralWave->QueueAudio(FirstRegion, FromFirstRegion);
+		if (BytesToQueue > FromFirstRegion)
+		{
+			InProceduralWave->QueueAudio(SecondRegion, BytesToQueue - FromFirstRegion);
+		}
+
+		// Remember the last frame for the fade out of a following underflow, it may straddle the two regions
+		uint8* LastFrame = (uint8*)LastPlayedFrame;
+		for (int32 Byte = 0; Byte < FMath::Min(SampleSize, (int32)sizeof(LastPlayedFrame)); ++Byte)
+		{
+			const uint32 Position = BytesToQueue - SampleSize + Byte;
+			LastFrame[Byte] = Position < FirstRegionSize ? FirstRegion[Position] : SecondRegion[Position - FirstRegionSize];
+		}
+
+		UncompressedDataQueue.Consume(BytesToQueue);
+		ResolveLatencyMarks(PlayedPosition, BytesToQueue);
+		FilledFramesSinceAudio = 0;
+	}
+
+	// Only fill in the middle of a talk spurt, and not forever when the talker went away without a silence marker
+	const int32 MissingFrames = SamplesRequired / NumOutChannels - WaveFrames - AvailableFrames;
+	const int32 MaxFillFrames = OutputSampleRate * VOICE_MAX_UNDERFLOW_FILL_MS / 1000;
+	if (MissingFrames > 0 && bMidTalkSpurt && FilledFramesSinceAudio < MaxFillFrames)
+	{
+		FillUnderflow(InProceduralWave, MissingFrames);
+
+		UnderflowCount.Store(UnderflowCount.Load() + 1);
+		StarvedFrameCount.Store(StarvedFrameCount.Load() + MissingFrames);
+		INC_DWORD_STAT(STAT_VoiceChat_Underflows);
+		INC_DWORD_STAT_BY(STAT_VoiceChat_StarvedSamples, MissingFrames);
+	}
+}
+
+void UVoiceChatComponent::FillUnderflow(USoundWaveProcedural* InProceduralWave, int32 NumFrames)
+{
+	const int32 NumChannels = FMath::Min(NumOutChannels, VOICE_MAX_OUTPUT_CHANNELS);
+	const int32 FadeFrames = FMath::Max(OutputSampleRate * VOICE_UNDERFLOW_FADE_MS / 1000, 1);
+	const float NoiseAmplitude = ComfortNoiseLevelDb > -96.0f ? 32767.0f * FMath::Pow(10.0f, ComfortNoiseLevelDb / 20.0f) : 0.0f;
+
+	UnderflowFill.SetNumUninitialized(NumFrames * NumOutChannels, false);
+	int16* Out = UnderflowFill.GetData();
+	for (int32 Frame = 0; Frame < NumFrames; ++Frame, ++FilledFramesSinceAudio)
+	{
+		const float Fade = FMath::Max(1.0f - (float)FilledFramesSinceAudio / FadeFrames, 0.0f);
+		for (int32 Channel = 0; Channel < NumOutChannels; ++Channel)
+		{
+			// Plain LCG, white noise is all comfort noise needs
+			NoiseSeed = NoiseSeed * 1664525u + 1013904223u;
+			const float Noise = ((int32)(NoiseSeed >> 16) - 32768) / 32768.0f * NoiseAmplitude;
+			const float Last = Channel < NumChannels ? LastPlayedFrame[Channel] * Fade : 0.0f;
+			*Out++ = (int16)FMath::Clamp(FMath::RoundToInt(Last + Noise), -32768, 32767);
+		}
+	}
+
+	InProceduralWave->QueueAudio((const uint8*)UnderflowFill.GetData(), UnderflowFill.Num() * sizeof(int16));
+}
+
+void UVoiceChatComponent::OnUnregister()
+{
+	WaitForPipeline();
+
+	Super::OnUnregister();
+}
+
+void UVoiceChatComponent::BeginDestroy()
+{
+	// Components destroyed without a Shutdown would otherwise stay in the stat
+	DEC_MEMORY_STAT_BY(STAT_VoiceChat_ComponentMemory, MemoryUsage);
+	MemoryUsage = 0;
+
+	// Nor give the queue storage back to the pool from the destructor while an audio thread may still read it
+	FencePlayback();
+	UncompressedDataQueue.Release();
+
+	Super::BeginDestroy();
+}
+
+void UVoiceChatComponent::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	TickVoice();
+}
+
+void UVoiceChatComponent::TickVoice()
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoiceChat_Tick);
+
+	if (!IsRunningDedicatedServer() && IsValid(Sound))
+	{
+		/*VoiceComp = CreateVoiceAudioComponent(OutputSampleRate, NumOutChannels);
+		VoiceComp->AddToRoot();*/
+		SoundStreaming = CastChecked<USoundWaveProcedural>(Sound);
+		if (SoundStreaming)
+		{
+			// Bind the GenerateData callback with FOnSoundWaveProceduralUnderflow object
+			SoundStreaming->OnSoundWaveProceduralUnderflow = FOnSoundWaveProceduralUnderflow::CreateUObject(this, &UVoiceChatComponent::GenerateData);
+		}
+	}
+
+	// Sender only components have no sound wave unless they play sidetone, they still capture and send
+	if (!SoundStreaming && !VoiceCapture.IsValid())
+	{
+		VOICECHAT_DEBUG_LOG(TEXT("SoundStreaming is not valid"));
+		return;
+	}
+	//check(SoundStreaming);
+
+	UpdateClockOffset();
+
+	if (SoundStreaming)
+	{
+		bool bIsPlaying = IsPlaying();
+		if (bIsPlaying != bLastWasPlaying)
+		{
+			UE_LOG(LogVoice, Log, TEXT("VOIP audio component %s playing!"), bIsPlaying ? TEXT("is") : TEXT("is not"));
+			bLastWasPlaying = bIsPlaying;
+		}
+
+		StarvedDataCount = (!bIsPlaying || !bMidTalkSpurt || (SoundStreaming->GetAvailableAudioByteCount() != 0)) ? 0 : (StarvedDataCount + 1);
+		if (StarvedDataCount > 1)
+		{
+			VOICECHAT_DEBUG_LOG(TEXT("VOIP audio component starved %d frames!"), StarvedDataCount);
+		}
+
+		UpdateCulling();
+
+		FVoiceChatLatencyMark PlayedMark;
+		while (PlayedLatencyMarks.Dequeue(PlayedMark))
+		{
+			LatencyTracker.Record(PlayedMark, GetClockOffsetSeconds());
+		}
+	}
+
+	if (bUseThreadedPipeline)
+	{
+		// A frame that finds the previous run still busy simply skips its own, the next run picks up everything that accumulated
+		if (!PipelineTask.IsValid() || PipelineTask->IsComplete())
+		{
+			JitterStats = ReceiveStream.GetStats();
+			UpdateMemoryUsage();
+
+			// Talkers close to the listener are decoded first when the workers are busy
+			const ENamedThreads::Type Thread = AudibleVolume >= VOICE_HIGH_PRIORITY_VOLUME ? ENamedThreads::AnyBackgroundHiPriTask : ENamedThreads::AnyBackgroundThreadNormalTask;
+			PipelineTask = FFunctionGraphTask::CreateAndDispatchWhenReady([this]()
+			{
+				ProcessIncomingPackets();
+				ServiceJitterBuffer();
+				ProcessCapture();
+			}, TStatId(), nullptr, Thread);
+		}
+	}
+	else
+	{
+		// The pipeline may have been switched off while a run was still in flight
+		WaitForPipeline();
+
+		// Received packets become due as the already decoded audio drains
+		ProcessIncomingPackets();
+		ServiceJitterBuffer();
+		ProcessCapture();
+
+		JitterStats = ReceiveStream.GetStats();
+		UpdateMemoryUsage();
+	}
+
+	BroadcastCapturedPackets();
+	if (SoundStreaming)
+	{
+		UpdatePlayback();
+	}
+}
+
+void UVoiceChatComponent::ProcessCapture()
+{
+	if (bAdaptiveBitrate && VoiceEncoder.IsValid())
+	{
+		UpdateBitrate();
+	}
+
+	if (VoiceCapture.IsValid())
+	{
+		bool bDoWork = false;
+		uint32 NewVoiceDataBytes = 0;
+		double CaptureEndTime = 0.0;
+
+		EVoiceCaptureState::Type MicState = VoiceCapture->GetCaptureState(NewVoiceDataBytes);
+		if (MicState == EVoiceCaptureState::Ok && NewVoiceDataBytes > 0)
+		{
+			//UE_LOG(LogVoice, Log, TEXT("Getting data! %d"), NewVoiceDataBytes);
+
+			// Captured straight behind the audio left over from the previous tick, or converted there from the device format in scratch memory
+			FVoiceChatScratchScope Scratch;
+			const bool bConvertCapture = !CaptureConverter.IsPassthrough();
+			uint8* CaptureTarget;
+			if (bConvertCapture)
+			{
+				NewVoiceDataBytes = FMath::Min<uint32>(NewVoiceDataBytes, MaxRawCaptureDataSize);
+				CaptureTarget = Scratch.Allocate(NewVoiceDataBytes).GetData();
+			}
+			else
+			{
+				CaptureTarget = ReserveCaptureSpace(NewVoiceDataBytes);
+			}
+
+			uint64 SampleCount;
+			{
+				SCOPE_CYCLE_COUNTER(STAT_VoiceChat_Capture);
+				MicState = VoiceCapture->GetVoiceData(CaptureTarget, NewVoiceDataBytes, NewVoiceDataBytes, SampleCount);
+			}
+			// The newest sample handed out was captured about now, older ones are dated back from it
+			CaptureEndTime = FPlatformTime::Seconds();
+
+			if (bConvertCapture && MicState == EVoiceCaptureState::Ok)
+			{
+				// Downmix and resample to the codec format
+				const int32 NumCapturedFrames = NewVoiceDataBytes / (sizeof(uint16) * NumCaptureChannels);
+				CaptureConverter.Convert((const int16*)CaptureTarget, NumCapturedFrames, ConvertedCapture);
+				NewVoiceDataBytes = ConvertedCapture.Num() * sizeof(int16);
+				FMemory::Memcpy(ReserveCaptureSpace(NewVoiceDataBytes), ConvertedCapture.GetData(), NewVoiceDataBytes);
+			}
+
+			// In place on the new audio, so the VAD, the encoder and the sidetone all get the processed signal
+			if (MicState == EVoiceCaptureState::Ok && !CaptureProcessors.IsEmpty())
+			{
+				CaptureProcessors.Process((int16*)(RawCaptureData.GetData() + CaptureWriteOffset), NewVoiceDataBytes / (sizeof(uint16) * NumInChannels));
+			}
+			INC_DWORD_STAT_BY(STAT_VoiceChat_BytesCaptured, NewVoiceDataBytes);
+
+			VOICECHAT_DEBUG_LOG(TEXT("New voice data bytes: %d"), NewVoiceDataBytes);
+
+			// Check to make sure this buffer has a valid, chronological buffer count.
+			if (SampleCount <= CachedSampleCount)
+			{
+				UE_LOG(LogVoice, Log, TEXT("Out of order or ambiguous sample count detected! This sample count: %lu Previous sample count: %lu"), SampleCount, CachedSampleCount);
+			}
+
+			CachedSampleCount = SampleCount;
+
+			VOICECHAT_DEBUG_LOG(TEXT("RawCaptureData, NewVoiceDataBytes: MicState: %d %d %s"), NewVoiceDataBytes, RawCaptureData.Num(), EVoiceCaptureState::ToString(MicState));
+			bDoWork = (MicState == EVoiceCaptureState::Ok && NewVoiceDataBytes > 0);
+		}
+
+		if (bDoWork && bEnableVoiceActivityDetection &&
+			!VAD.Process((const int16*)(RawCaptureData.GetData() + CaptureWriteOffset), NewVoiceDataBytes / sizeof(int16), NumInChannels))
+		{
+			// Discontinuous transmission: nobody is talking, drop the block without encoding it
+			if (bIsTransmitting)
+			{
+				EmitSilenceMarker();
+				bIsTransmitting = false;
+			}
+
+			OutgoingTimestamp += (CaptureWriteOffset + NewVoiceDataBytes - CaptureReadOffset) / (sizeof(uint16) * NumInChannels);
+			CaptureReadOffset = 0;
+			CaptureWriteOffset = 0;
+			bDoWork = false;
+		}
+
+		if (bDoWork)
+		{
+			bIsTransmitting = true;
+			CaptureWriteOffset += NewVoiceDataBytes;
+
+			// Cut the captured audio into packets of PacketIntervalMs, whatever the frame rate. Without an interval every whole codec frame captured so far goes into one packet.
+			const uint32 SampleSize = sizeof(uint16) * NumInChannels;
+			const uint32 FrameBytes = (InputSampleRate / 50) * SampleSize;
+			const uint32 AvailableBytes = CaptureWriteOffset - CaptureReadOffset;
+			const uint32 PacketBytes = PacketIntervalMs > 0 ? GetPacketIntervalSamples() * SampleSize : AvailableBytes / FrameBytes * FrameBytes;
+			const double BytesPerSecond = (double)SampleSize * InputSampleRate;
+
+			VOICECHAT_DEBUG_LOG(TEXT("Buffered voice bytes: %d"), AvailableBytes);
+
+			// The encoder reads whole packets in place, a partial frame simply stays in the buffer until the next tick completes it
+			while (PacketBytes > 0 && (uint32)(CaptureWriteOffset - CaptureReadOffset) >= PacketBytes)
+			{
+				const double CaptureTime = CaptureEndTime - (CaptureWriteOffset - CaptureReadOffset) / BytesPerSecond;
+				const uint32 PacketEncodedBytes = EncodePacket(RawCaptureData.GetData() + CaptureReadOffset, PacketBytes, CaptureTime);
+				if (PacketEncodedBytes == 0)
+				{
+					break;
+				}
+				CaptureReadOffset += PacketEncodedBytes;
+			}
+		}
+	}
+}
+
+uint8* UVoiceChatComponent::ReserveCaptureSpace(uint32 Size)
+{
+	if (CaptureReadOffset == CaptureWriteOffset)
+	{
+		// Everything was encoded, start over at the front for free
+		CaptureReadOffset = 0;
+		CaptureWriteOffset = 0;
+	}
+	else if (CaptureWriteOffset + (int32)Size > RawCaptureData.Num())
+	{
+		// Out of room at the end: slide the partial packet still waiting to be encoded back to the front.
+		// It is less than a packet, and the buffer holds a second of capture, so this happens about once a second.
+		const int32 PendingBytes = CaptureWriteOffset - CaptureReadOffset;
+		FMemory::Memmove(RawCaptureData.GetData(), RawCaptureData.GetData() + CaptureReadOffset, PendingBytes);
+		CaptureReadOffset = 0;
+		CaptureWriteOffset = PendingBytes;
+	}
+
+	if (CaptureWriteOffset + (int32)Size > RawCaptureData.Num())
+	{
+		// Only when the device hands out more than its buffer size, or converts to a higher rate than it captures at
+		VOICECHAT_DEBUG_LOG(TEXT("Capture buffer overflow!"));
+		RawCaptureData.AddUninitialized(CaptureWriteOffset + Size - RawCaptureData.Num());
+		MaxRawCaptureDataSize = RawCaptureData.Num();
+	}
+
+	VOICE_BUFFER_CHECK(RawCaptureData, CaptureWriteOffset + Size);
+	return RawCaptureData.GetData() + CaptureWriteOffset;
+}
+
+uint32 UVoiceChatComponent::EncodePacket(const uint8* VoiceData, uint32 VoiceDataSize, double CaptureTime)
+{
+	// Encode and loopback decode buffers are only needed until the packet is out, every component encoding on this thread shares them
+	FVoiceChatScratchScope Scratch;
+	const TArrayView<uint8> CompressedData = Scratch.Allocate(MaxCompressedDataSize);
+
+	// COMPRESSION BEGIN
+	uint32 CompressedDataSize = 0;
+	uint32 PacketRemainderSize = VoiceDataSize;
+	if (VoiceEncoder.IsValid())
+	{
+		CompressedDataSize = MaxCompressedDataSize;
+		const uint64 EncodeStartCycles = FPlatformTime::Cycles64();
+		{
+			SCOPE_CYCLE_COUNTER(STAT_VoiceChat_Encode);
+			PacketRemainderSize = VoiceEncoder->Encode(VoiceData, VoiceDataSize, CompressedData.GetData(), CompressedDataSize);
+		}
+		if (bAdaptiveBitrate)
+		{
+			const double AudioSeconds = (double)(VoiceDataSize - PacketRemainderSize) / (sizeof(uint16) * NumInChannels * InputSampleRate);
+			BitrateController.AddEncodeTime(FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - EncodeStartCycles), AudioSeconds);
+		}
+		VOICE_BUFFER_CHECK(CompressedData, CompressedDataSize);
+		INC_DWORD_STAT_BY(STAT_VoiceChat_BytesEncoded, CompressedDataSize);
+	}
+	// COMPRESSION END
+
+	VOICECHAT_DEBUG_LOG(TEXT("Data compressed: ArraySize: %d CompressedDataSize %d"), CompressedData.Num(), CompressedDataSize);
+
+	const uint32 EncodedBytes = VoiceDataSize - PacketRemainderSize;
+	const uint32 EncodedSamples = EncodedBytes / (sizeof(uint16) * NumInChannels);
+	if (CompressedDataSize > 0)
+	{
+		FVoiceChatPacketHeader Header;
+		Header.Sequence = OutgoingSequence++;
+		Header.Timestamp = OutgoingTimestamp;
+		Header.NumSamples = EncodedSamples;
+		Header.Channel = GetOutgoingChannel();
+		if (bTraceLatency)
+		{
+			const double ClockOffset = GetClockOffsetSeconds();
+			Header.Flags |= EVoiceChatPacketFlags::Traced;
+			Header.CaptureTimeMs = FVoiceChatLatencyTracker::ToSharedMs(CaptureTime, ClockOffset);
+			Header.SendDelayMs = (uint16)FMath::Clamp(FMath::RoundToInt((FPlatformTime::Seconds() - CaptureTime) * 1000.0), 0, (int32)MAX_uint16);
+		}
+
+		const bool bRedundant = bSendRedundantAudio && RedundantPayload.Num() > 0;
+		const int32 RedundantSize = bRedundant ? 2 + RedundantPayload.Num() : 0;
+		if (bRedundant)
+		{
+			Header.Flags |= EVoiceChatPacketFlags::Redundant;
+		}
+
+		// After the compressed data is placed on the buffer, place it on a right sized pooled packet to transmit the size with the array and reduce the network weight (Lots of data is irrelevant)
+		FVoiceChatPacketRef Packet = CapturePacketPool.Acquire(Header.GetSize() + RedundantSize + CompressedDataSize);
+		uint8* PacketData = Packet->Data.GetData();
+		Header.Write(PacketData);
+		PacketData += Header.GetSize();
+		if (bRedundant)
+		{
+			PacketData[0] = (uint8)(RedundantPayload.Num());
+			PacketData[1] = (uint8)(RedundantPayload.Num() >> 8);
+			FMemory::Memcpy(PacketData + 2, RedundantPayload.GetData(), RedundantPayload.Num());
+			PacketData += RedundantSize;
+		}
+		FMemory::Memcpy(PacketData, CompressedData.GetData(), CompressedDataSize);
 
-	// Turn off async generation in old audio engine on mac.
-#if PLATFORM_MAC
-	if (!AudioDevice->IsAudioMixerEnabled())
+		EmitPacket(Packet);
+
+		RedundantPayload.Reset();
+		if (bSendRedundantAudio && CompressedDataSize <= MAX_uint16)
+		{
+			RedundantPayload.Append(CompressedData.GetData(), CompressedDataSize);
+		}
+	}
+	OutgoingTimestamp += EncodedSamples;
+
+	if (bSenderOnly)
 	{
-		newSoundStreaming->bCanProcessAsync = false;
+		// Sidetone plays the raw capture, there is nothing else to do locally
+		if (bSidetone)
+		{
+			QueueLoopback(VoiceData, EncodedBytes);
+		}
+		return EncodedBytes;
+	}
+
+	// DECOMPRESSION BEGIN
+	uint32 UncompressedDataSize = 0;
+	TArrayView<uint8> UncompressedData;
+	if (VoiceDecoder.IsValid() && CompressedDataSize > 0)
+	{
+		UncompressedData = Scratch.Allocate(MaxUncompressedDataSize);
+		UncompressedDataSize = MaxUncompressedDataSize;
+		{
+			SCOPE_CYCLE_COUNTER(STAT_VoiceChat_Decode);
+			VoiceDecoder->Decode(CompressedData.GetData(), CompressedDataSize,
+				UncompressedData.GetData(), UncompressedDataSize);
+		}
+		VOICE_BUFFER_CHECK(UncompressedData, UncompressedDataSize);
+		VOICECHAT_DEBUG_LOG(TEXT("Data uncompressed: CompressedArraySize: %d UncompressedDataSize %d"), CompressedDataSize, UncompressedDataSize);
+	}
+	// DECOMPRESSION END
+
+	const uint8* VoiceDataPtr = nullptr;
+	uint32 LoopbackDataSize = 0;
+
+	if (bUseDecompressed)
+	{
+		if (UncompressedDataSize > 0)
+		{
+			if (bZeroOutput)
+			{
+				FMemory::Memzero((uint8*)UncompressedData.GetData(), UncompressedDataSize);
+			}
+
+			LoopbackDataSize = UncompressedDataSize;
+			VoiceDataPtr = UncompressedData.GetData();
+		}
 	}
 	else
-#endif // #if PLATFORM_MAC
 	{
-		newSoundStreaming->bCanProcessAsync = true;
+		VoiceDataPtr = VoiceData;
+		LoopbackDataSize = EncodedBytes;
 	}
 
-	Sound = newSoundStreaming;
-	bIsUISound = false;
-	bAllowSpatialization = true;
-	SetVolumeMultiplier(1.5f);
+	if (VoiceDataPtr && LoopbackDataSize > 0)
+	{
+		QueueLoopback(VoiceDataPtr, LoopbackDataSize);
+	}
 
-	const FSoftObjectPath VoiPSoundClassName = GetDefault<UAudioSettings>()->VoiPSoundClass;
-	if (VoiPSoundClassName.IsValid())
+	return EncodedBytes;
+}
+
+void UVoiceChatComponent::QueueLoopback(const uint8* VoiceData, uint32 VoiceDataSize)
+{
+	if (!LoopbackConverter.IsPassthrough())
 	{
-		SoundClassOverride = LoadObject<USoundClass>(nullptr, *VoiPSoundClassName.ToString());
+		const int32 NumOutFrames = LoopbackConverter.Convert((const int16*)VoiceData, VoiceDataSize / (sizeof(uint16) * NumInChannels), ConvertedLoopback);
+		VoiceData = (const uint8*)ConvertedLoopback.GetData();
+		VoiceDataSize = NumOutFrames * NumOutChannels * sizeof(uint16);
+	}
+
+	EnqueueUncompressedData(VoiceData, VoiceDataSize);
+}
+
+uint32 UVoiceChatComponent::GetPacketIntervalSamples() const
+{
+	// The codec works on 20ms frames, round the interval to a whole number of them
+	const int32 FrameSamples = InputSampleRate / 50;
+	const int32 NumFrames = FMath::Max(FMath::RoundToInt(PacketIntervalMs / 20.0f), 1);
+	return FrameSamples * NumFrames;
+}
+
+void UVoiceChatComponent::PlayVoiceChatAudio(const TArray<uint8>& VoiceData, bool IsCompressed)
+{
+	VOICECHAT_DEBUG_LOG(TEXT("Data received: ArraySize: %d"), VoiceData.Num());
+
+	PlayVoiceChatPacket(VoiceData);
+}
+
+void UVoiceChatComponent::PlayVoiceChatPacket(TArrayView<const uint8> Packet)
+{
+	PlayVoiceChatPacketFromSender(INDEX_NONE, Packet);
+}
+
+void UVoiceChatComponent::PlayVoiceChatAudioFromSender(int32 SenderId, const TArray<uint8>& VoiceData)
+{
+	PlayVoiceChatPacketFromSender(SenderId, VoiceData);
+}
+
+void UVoiceChatComponent::PlayVoiceChatPacketFromSender(int32 SenderId, TArrayView<const uint8> Packet)
+{
+	// Sender only components have no decoder or playback, received audio belongs on a listener
+	if (bSenderOnly)
+	{
+		return;
+	}
+
+	// Audio this listener must not hear costs a single byte read
+	uint8 Channel;
+	if (!FVoiceChatPacketHeader::ReadChannel(Packet.GetData(), Packet.Num(), Channel) || !(SubscribedChannels & VoiceChatChannelBit(Channel)))
+	{
+		return;
+	}
+
+	// Recorded even when culled, a report must contain what was said and not only what this listener heard
+	if (Recorder.IsValid())
+	{
+		Recorder->RecordPacket(SenderId, Packet, InputSampleRate, NumInChannels);
+	}
+
+	if (bIsCulled)
+	{
+		INC_DWORD_STAT(STAT_VoiceChat_CulledPackets);
+		return;
+	}
+
+	if (bUseThreadedPipeline)
+	{
+		// Inserted and decoded by the next pipeline run
+		FIncomingVoicePacket Incoming;
+		Incoming.Packet = IncomingPacketPool.Acquire(Packet.Num());
+		FMemory::Memcpy(Incoming.Packet->Data.GetData(), Packet.GetData(), Packet.Num());
+		Incoming.ArrivalTime = FPlatformTime::Seconds();
+		Incoming.SenderId = SenderId;
+		if (!IncomingPackets.Enqueue(MoveTemp(Incoming)))
+		{
+			UE_LOG(LogVoice, Warning, TEXT("Incoming packet queue overflow, the voice pipeline is not keeping up"));
+		}
+		return;
+	}
+
+	// Anything already due is decoded right away, the rest is released from TickComponent
+	WaitForPipeline();
+	InsertIncomingPacket(SenderId, Packet, FPlatformTime::Seconds());
+	ServiceJitterBuffer();
+	JitterStats = ReceiveStream.GetStats();
+	UpdatePlayback();
+}
+
+void UVoiceChatComponent::SubscribeToChannel(int32 Channel)
+{
+	if (Channel >= 0 && Channel < VOICE_MAX_CHANNELS)
+	{
+		SubscribedChannels |= VoiceChatChannelBit((uint8)Channel);
+	}
+}
+
+void UVoiceChatComponent::UnsubscribeFromChannel(int32 Channel)
+{
+	if (Channel >= 0 && Channel < VOICE_MAX_CHANNELS)
+	{
+		SubscribedChannels &= ~VoiceChatChannelBit((uint8)Channel);
+	}
+}
+
+bool UVoiceChatComponent::IsSubscribedToChannel(int32 Channel) const
+{
+	return Channel >= 0 && Channel < VOICE_MAX_CHANNELS && (SubscribedChannels & VoiceChatChannelBit((uint8)Channel)) != 0;
+}
+
+uint8 UVoiceChatComponent::GetOutgoingChannel() const
+{
+	return (uint8)FMath::Clamp(VoiceChannel, 0, VOICE_MAX_CHANNELS - 1);
+}
+
+void UVoiceChatComponent::RemoveSender(int32 SenderId)
+{
+	WaitForPipeline();
+
+	TUniquePtr<FVoiceChatSender> Sender;
+	if (Senders.RemoveAndCopyValue(SenderId, Sender))
+	{
+		ReleaseSender(*Sender);
+	}
+}
+
+float UVoiceChatComponent::GetJitterBufferDepthMs() const
+{
+	return JitterStats.DepthMs;
+}
+
+float UVoiceChatComponent::GetJitterBufferTargetDelayMs() const
+{
+	return JitterStats.TargetDelayMs;
+}
+
+int32 UVoiceChatComponent::GetLatePacketCount() const
+{
+	return JitterStats.LateCount;
+}
+
+int32 UVoiceChatComponent::GetLostPacketCount() const
+{
+	return JitterStats.LostCount;
+}
+
+int32 UVoiceChatComponent::GetConcealedFrameCount() const
+{
+	return JitterStats.ConcealedCount;
+}
+
+int32 UVoiceChatComponent::GetRecoveredPacketCount() const
+{
+	return JitterStats.RecoveredCount;
+}
+
+float UVoiceChatComponent::GetPlayoutRate() const
+{
+	return JitterStats.PlayoutRate;
+}
+
+int32 UVoiceChatComponent::GetSkippedFrameCount() const
+{
+	return JitterStats.SkippedCount;
+}
+
+int32 UVoiceChatComponent::GetUnderflowCount() const
+{
+	return UnderflowCount.Load();
+}
+
+float UVoiceChatComponent::GetStarvedMs() const
+{
+	return OutputSampleRate > 0 ? StarvedFrameCount.Load() * 1000.0f / OutputSampleRate : 0.0f;
+}
+
+bool UVoiceChatComponent::GetReceiverReport(int32 SenderId, TArray<uint8>& OutReport)
+{
+	// The streams are serviced by the pipeline
+	WaitForPipeline();
+
+	FVoiceChatReceiverReport Report;
+	if (SenderId == INDEX_NONE)
+	{
+		if (!VoiceDecoder.IsValid())
+		{
+			return false;
+		}
+		const FVoiceChatJitterBufferStats Stats = ReceiveStream.GetStats();
+		Report = FVoiceChatReceiverReport::FromStats(Stats, ReportedStats, ReceiveBitrateBudget);
+		ReportedStats = Stats;
+	}
+	else
+	{
+		TUniquePtr<FVoiceChatSender>* Sender = Senders.Find(SenderId);
+		if (!Sender)
+		{
+			return false;
+		}
+		const FVoiceChatJitterBufferStats Stats = (*Sender)->Stream.GetStats();
+		Report = FVoiceChatReceiverReport::FromStats(Stats, (*Sender)->ReportedStats, ReceiveBitrateBudget / Senders.Num());
+		(*Sender)->ReportedStats = Stats;
+	}
+
+	OutReport.SetNumUninitialized(FVoiceChatReceiverReport::Size);
+	Report.Write(OutReport.GetData());
+	return true;
+}
+
+void UVoiceChatComponent::ReceiveReport(int32 ListenerId, const TArray<uint8>& Report)
+{
+	FIncomingReceiverReport Incoming;
+	if (!Incoming.Report.Read(Report.GetData(), Report.Num()))
+	{
+		UE_LOG(LogVoice, Warning, TEXT("Ignoring malformed receiver report of %d bytes from listener %d"), Report.Num(), ListenerId);
+		return;
+	}
+
+	Incoming.ListenerId = ListenerId;
+	Incoming.ArrivalTime = FPlatformTime::Seconds();
+	if (!IncomingReports.Enqueue(MoveTemp(Incoming)))
+	{
+		VOICECHAT_DEBUG_LOG(TEXT("Receiver report queue full, dropping report of listener %d"), ListenerId);
+	}
+}
+
+void UVoiceChatComponent::SetBitrateBudget(int32 BitsPerSecond)
+{
+	BitrateBudget.Store(FMath::Max(BitsPerSecond, 0));
+}
+
+int32 UVoiceChatComponent::GetEncoderBitrate() const
+{
+	return bAdaptiveBitrate && VoiceEncoder.IsValid() ? BitrateController.GetSettings().Bitrate : 0;
+}
+
+void UVoiceChatComponent::UpdateBitrate()
+{
+	FIncomingReceiverReport Incoming;
+	while (IncomingReports.Dequeue(Incoming))
+	{
+		BitrateController.AddReport(Incoming.ListenerId, Incoming.Report, Incoming.ArrivalTime);
+	}
+
+	BitrateController.SetBudget(BitrateBudget.Load());
+	if (BitrateController.Update(FPlatformTime::Seconds()))
+	{
+		ApplyEncoderSettings();
+	}
+}
+
+void UVoiceChatComponent::ApplyEncoderSettings()
+{
+	const FVoiceChatEncoderSettings& Settings = BitrateController.GetSettings();
+	VoiceEncoder->SetBitrate(Settings.Bitrate);
+	VoiceEncoder->SetVBR(Settings.bVBR);
+	VoiceEncoder->SetComplexity(Settings.Complexity);
+	bEncoderTuned = true;
+
+	VOICECHAT_DEBUG_LOG(TEXT("Encoder settings: %d bps, VBR %d, complexity %d"), Settings.Bitrate, Settings.bVBR, Settings.Complexity);
+}
+
+float UVoiceChatComponent::GetLatencyPercentileMs(EVoiceChatLatencyStage Stage, float Percentile) const
+{
+	return LatencyTracker.GetPercentileMs(Stage, Percentile);
+}
+
+int32 UVoiceChatComponent::GetLatencySampleCount() const
+{
+	return LatencyTracker.GetNumSamples();
+}
+
+void UVoiceChatComponent::ResetLatencyStats()
+{
+	LatencyTracker.Reset();
+}
+
+bool UVoiceChatComponent::StartRecording(const FString& Filename, int32 LocalSpeakerId)
+{
+	TSharedPtr<FVoiceChatRecorder, ESPMode::ThreadSafe> NewRecorder = MakeShared<FVoiceChatRecorder, ESPMode::ThreadSafe>();
+	if (!NewRecorder->Open(Filename, InputSampleRate, NumInChannels))
+	{
+		return false;
+	}
+
+	SetRecorder(NewRecorder, LocalSpeakerId);
+	return true;
+}
+
+void UVoiceChatComponent::StopRecording()
+{
+	// The last component to let go closes the file
+	Recorder.Reset();
+}
+
+void UVoiceChatComponent::SetRecorder(const TSharedPtr<FVoiceChatRecorder, ESPMode::ThreadSafe>& InRecorder, int32 LocalSpeakerId)
+{
+	Recorder = InRecorder;
+	RecordingSpeakerId = LocalSpeakerId;
+}
+
+void UVoiceChatComponent::ApplyCaptureProcessing()
+{
+	// The chain runs on the pipeline task
+	WaitForPipeline();
+
+	CaptureProcessors.Empty();
+	if (bHighPassFilter)
+	{
+		CaptureProcessors.Add(MakeShared<FVoiceChatHighPassFilter>(HighPassCutoffHz));
+	}
+	// Gate before the automatic gain, which would otherwise raise the noise the gate is meant to cut
+	if (bNoiseGate)
+	{
+		CaptureProcessors.Add(MakeShared<FVoiceChatNoiseGate>(NoiseGateThresholdDb));
+	}
+	if (bAutomaticGainControl)
+	{
+		CaptureProcessors.Add(MakeShared<FVoiceChatAutomaticGain>(AutomaticGainTargetDb, AutomaticGainMaxDb));
+	}
+	for (const TSharedRef<IVoiceChatProcessor>& Processor : CustomCaptureProcessors)
+	{
+		CaptureProcessors.Add(Processor);
+	}
+	if (bLimiter)
+	{
+		CaptureProcessors.Add(MakeShared<FVoiceChatLimiter>(LimiterCeilingDb));
+	}
+	CaptureProcessors.Configure(InputSampleRate, NumInChannels);
+}
+
+void UVoiceChatComponent::AddCaptureProcessor(const TSharedRef<IVoiceChatProcessor>& Processor)
+{
+	CustomCaptureProcessors.Add(Processor);
+	ApplyCaptureProcessing();
+}
+
+void UVoiceChatComponent::RemoveCaptureProcessor(const TSharedRef<IVoiceChatProcessor>& Processor)
+{
+	CustomCaptureProcessors.Remove(Processor);
+	ApplyCaptureProcessing();
+}
+
+#if !UE_BUILD_SHIPPING
+static FAutoConsoleCommand VoiceChatProcessingCommand(
+	TEXT("voicechat.Processing"),
+	TEXT("Logs the time spent in every capture processing stage of every voice chat component, per second of audio. Pass Reset to clear it afterwards."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const bool bReset = Args.Num() > 0 && Args[0] == TEXT("Reset");
+		for (TObjectIterator<UVoiceChatComponent> It; It; ++It)
+		{
+			if (!It->CaptureProcessors.IsEmpty())
+			{
+				It->WaitForPipeline();
+				UE_LOG(LogVoice, Display, TEXT("%s: %s"), *It->GetPathName(), *It->CaptureProcessors.ToString());
+				if (bReset)
+				{
+					It->CaptureProcessors.ResetStats();
+				}
+			}
+		}
+	}));
+
+static FAutoConsoleCommand VoiceChatMemoryCommand(
+	TEXT("voicechat.Memory"),
+	TEXT("Logs the buffer memory held by every voice chat component, the shared scratch arenas and the queue pool. Pass Trim to free the idle queues first."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		if (Args.Num() > 0 && Args[0] == TEXT("Trim"))
+		{
+			FVoiceChatQueuePool::Get().Trim();
+		}
+
+		int64 Total = 0;
+		for (TObjectIterator<UVoiceChatComponent> It; It; ++It)
+		{
+			if (It->GetVoiceMemoryUsage() > 0)
+			{
+				UE_LOG(LogVoice, Display, TEXT("%s: %.1f KB"), *It->GetPathName(), It->GetVoiceMemoryUsage() / 1024.0f);
+				Total += It->GetVoiceMemoryUsage();
+			}
+		}
+		UE_LOG(LogVoice, Display, TEXT("Components %.1f KB, scratch arenas %.1f KB, %s"), Total / 1024.0, FVoiceChatScratchScope::GetTotalArenaSize() / 1024.0,
+			*FVoiceChatQueuePool::Get().ToString());
+	}));
+
+static FAutoConsoleCommand VoiceChatLatencyCommand(
+	TEXT("voicechat.Latency"),
+	TEXT("Logs the capture to playout latency percentiles of every voice chat component that received traced packets. Pass Reset to clear them afterwards."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const bool bReset = Args.Num() > 0 && Args[0] == TEXT("Reset");
+		for (TObjectIterator<UVoiceChatComponent> It; It; ++It)
+		{
+			if (It->GetLatencySampleCount() > 0)
+			{
+				UE_LOG(LogVoice, Display, TEXT("%s: %s, %d underflows, %.0f ms starved"), *It->GetPathName(), *It->LatencyTracker.ToString(),
+					It->GetUnderflowCount(), It->GetStarvedMs());
+			}
+			if (bReset)
+			{
+				It->ResetLatencyStats();
+			}
+		}
+	}));
+#endif
+
+void UVoiceChatComponent::InitAsListener()
+{
+	ApplyVoiceProfile();
+	bSenderOnly = false;
+
+	InitVoiceDecoder();
+	InitSoundStreaming();
+	InitSoundClass(false);
+}
+
+void UVoiceChatComponent::InitAsSender()
+{
+	ApplyVoiceProfile();
+	bSenderOnly = true;
+
+	InitVoiceCapture();
+	InitVoiceEncoder();
+
+	if (bSidetone)
+	{
+		// No decode buffer, and a short queue keeps the sidetone close to the voice
+		const uint32 QueueSize = NumOutChannels * OutputSampleRate * sizeof(uint16) / 2;
+		FencePlayback();
+		MaxUncompressedDataQueueSize = UncompressedDataQueue.Acquire(QueueSize, QueueSize);
+		bPlaybackQueueOpen.Store(true);
+
+		InitSoundStreaming();
+		InitSoundClass(false);
 	}
 }
 
+void UVoiceChatComponent::InitAsMixBus()
+{
+	OutputSampleRate = VOICE_DEVICE_SAMPLE_RATE;
+	NumOutChannels = VOICE_DEVICE_NUM_CHANNELS;
+
+	InitPlaybackQueue();
+	InitSoundStreaming();
+	InitSoundClass(false);
+
+	// Buses play a mix of several talkers, they only become spatialized once moved to a single talker's location
+	bAllowSpatialization = false;
+	// UVoiceChatMixerSubsystem decides which talkers are relevant. Culling the bus would flush the mix of every talker
+	// on it whenever its spatialization changes, e.g. when a nearby talker joins a bus placed at a distant one.
+	bEnableDistanceCulling = false;
+}
+
 //bool UVoiceChatComponent::Exec(UWorld* InWorld, const TCHAR* Cmd, FOutputDevice& Ar)
 //{
 //	bool bWasHandled = false;
@@ -0,0 +1,306 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatDSP.h"
+
+#if PLATFORM_ENABLE_VECTORINTRINSICS && PLATFORM_CPU_X86_FAMILY
+#include <emmintrin.h>
+#define VOICECHAT_DSP_SSE2 1
+#else
+#define VOICECHAT_DSP_SSE2 0
+#endif
+
+namespace VoiceChatDSP
+{
+	void ComputeEnergyAndZeroCrossings(const int16* Samples, int32 NumSamples, int32 NumChannels, uint64& OutEnergy, int32& OutZeroCrossings)
+	{
+		uint64 Energy = 0;
+		int32 ZeroCrossings = 0;
+		int32 Index = 0;
+
+#if VOICECHAT_DSP_SSE2
+		const __m128i Zero = _mm_setzero_si128();
+		__m128i EnergyAccumulator = _mm_setzero_si128();
+
+		// The first frame has no predecessor, start the vector loop where Samples[Index - NumChannels] is valid
+		for (; Index < NumChannels && Index < NumSamples; ++Index)
+		{
+			Energy += (uint64)((int32)Samples[Index] * (int32)Samples[Index]);
+		}
+
+		for (; Index + 8 <= NumSamples; Index += 8)
+		{
+			const __m128i Current = _mm_loadu_si128((const __m128i*)(Samples + Index));
+			const __m128i Previous = _mm_loadu_si128((const __m128i*)(Samples + Index - NumChannels));
+
+			// Pairwise products fit in 32 bits unsigned (at most 2 * 32768^2 = 2^31), widen to 64 bit before accumulating
+			const __m128i Squares = _mm_madd_epi16(Current, Current);
+			EnergyAccumulator = _mm_add_epi64(EnergyAccumulator, _mm_unpacklo_epi32(Squares, Zero));
+			EnergyAccumulator = _mm_add_epi64(EnergyAccumulator, _mm_unpackhi_epi32(Squares, Zero));
+
+			// Sign masks differ exactly where a crossing happened, each 16 bit lane sets two bits of the byte mask
+			const __m128i SignChange = _mm_xor_si128(_mm_srai_epi16(Current, 15), _mm_srai_epi16(Previous, 15));
+			ZeroCrossings += FPlatformMath::CountBits((uint64)_mm_movemask_epi8(SignChange)) / 2;
+		}
+
+		alignas(16) uint64 EnergyLanes[2];
+		_mm_store_si128((__m128i*)EnergyLanes, EnergyAccumulator);
+		Energy += EnergyLanes[0] + EnergyLanes[1];
+#endif
+
+		for (; Index < NumSamples; ++Index)
+		{
+			const int32 Sample = Samples[Index];
+			Energy += (uint64)(Sample * Sample);
+			if (Index >= NumChannels && ((Sample < 0) != (Samples[Index - NumChannels] < 0)))
+			{
+				++ZeroCrossings;
+			}
+		}
+
+		OutEnergy = Energy;
+		OutZeroCrossings = ZeroCrossings;
+	}
+
+	void MixInt16(const int16* Samples, float Gain, float* Accumulator, int32 NumSamples)
+	{
+		int32 Index = 0;
+
+#if VOICECHAT_DSP_SSE2
+		const __m128 GainVector = _mm_set1_ps(Gain);
+		for (; Index + 8 <= NumSamples; Index += 8)
+		{
+			const __m128i Input = _mm_loadu_si128((const __m128i*)(Samples + Index));
+
+			// Sign extend to 32 bit by placing each sample in the upper half of a lane and shifting back down
+			const __m128 Low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(Input, Input), 16));
+			const __m128 High = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(Input, Input), 16));
+
+			_mm_storeu_ps(Accumulator + Index, _mm_add_ps(_mm_loadu_ps(Accumulator + Index), _mm_mul_ps(Low, GainVector)));
+			_mm_storeu_ps(Accumulator + Index + 4, _mm_add_ps(_mm_loadu_ps(Accumulator + Index + 4), _mm_mul_ps(High, GainVector)));
+		}
+#endif
+
+		for (; Index < NumSamples; ++Index)
+		{
+			Accumulator[Index] += Samples[Index] * Gain;
+		}
+	}
+
+	void Int16ToFloat(const int16* In, float* Out, int32 NumSamples)
+	{
+		int32 Index = 0;
+
+#if VOICECHAT_DSP_SSE2
+		for (; Index + 8 <= NumSamples; Index += 8)
+		{
+			const __m128i Input = _mm_loadu_si128((const __m128i*)(In + Index));
+			_mm_storeu_ps(Out + Index, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(Input, Input), 16)));
+			_mm_storeu_ps(Out + Index + 4, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(Input, Input), 16)));
+		}
+#endif
+
+		for (; Index < NumSamples; ++Index)
+		{
+			Out[Index] = In[Index];
+		}
+	}
+
+	void FloatToInt16(const float* In, int16* Out, int32 NumSamples)
+	{
+		int32 Index = 0;
+
+#if VOICECHAT_DSP_SSE2
+		// Clamp before converting, out of range floats would convert to INT_MIN and saturate to the wrong end
+		const __m128 Min = _mm_set1_ps(-32768.0f);
+		const __m128 Max = _mm_set1_ps(32767.0f);
+		for (; Index + 8 <= NumSamples; Index += 8)
+		{
+			const __m128i Low = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(In + Index), Min), Max));
+			const __m128i High = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(In + Index + 4), Min), Max));
+			_mm_storeu_si128((__m128i*)(Out + Index), _mm_packs_epi32(Low, High));
+		}
+#endif
+
+		for (; Index < NumSamples; ++Index)
+		{
+			// Half way values round to even like the SSE conversion does in the default rounding mode
+			Out[Index] = (int16)FMath::Clamp((int32)FMath::RoundHalfToEven(In[Index]), -32768, 32767);
+		}
+	}
+
+	void DownmixToMono(const int16* In, int16* Out, int32 NumFrames, int32 NumChannels)
+	{
+		int32 Frame = 0;
+
+		if (NumChannels == 2)
+		{
+#if VOICECHAT_DSP_SSE2
+			// madd against ones sums each left/right pair into a 32 bit lane, halve and pack back to 16 bit
+			const __m128i Ones = _mm_set1_epi16(1);
+			for (; Frame + 8 <= NumFrames; Frame += 8)
+			{
+				const __m128i Low = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(In + Frame * 2)), Ones), 1);
+				const __m128i High = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(In + Frame * 2 + 8)), Ones), 1);
+				_mm_storeu_si128((__m128i*)(Out + Frame), _mm_packs_epi32(Low, High));
+			}
+#endif
+
+			for (; Frame < NumFrames; ++Frame)
+			{
+				Out[Frame] = (int16)(((int32)In[Frame * 2] + (int32)In[Frame * 2 + 1]) >> 1);
+			}
+			return;
+		}
+
+		for (; Frame < NumFrames; ++Frame)
+		{
+			int32 Sum = 0;
+			for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+			{
+				Sum += In[Frame * NumChannels + Channel];
+			}
+			Out[Frame] = (int16)(Sum / NumChannels);
+		}
+	}
+
+	void UpmixFromMono(const int16* In, int16* Out, int32 NumFrames, int32 NumChannels)
+	{
+		int32 Frame = 0;
+
+		if (NumChannels == 2)
+		{
+#if VOICECHAT_DSP_SSE2
+			// Interleaving a vector with itself duplicates every sample into a left/right pair
+			for (; Frame + 8 <= NumFrames; Frame += 8)
+			{
+				const __m128i Input = _mm_loadu_si128((const __m128i*)(In + Frame));
+				_mm_storeu_si128((__m128i*)(Out + Frame * 2), _mm_unpacklo_epi16(Input, Input));
+				_mm_storeu_si128((__m128i*)(Out + Frame * 2 + 8), _mm_unpackhi_epi16(Input, Input));
+			}
+#endif
+
+			for (; Frame < NumFrames; ++Frame)
+			{
+				Out[Frame * 2] = In[Frame];
+				Out[Frame * 2 + 1] = In[Frame];
+			}
+			return;
+		}
+
+		for (; Frame < NumFrames; ++Frame)
+		{
+			for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+			{
+				Out[Frame * NumChannels + Channel] = In[Frame];
+			}
+		}
+	}
+
+	void FirDecimate(const int16* In, int16* Out, int32 NumOut, int32 Factor, const int16* Taps, int32 NumTaps)
+	{
+		check(NumTaps % 8 == 0);
+
+		for (int32 Index = 0; Index < NumOut; ++Index)
+		{
+			const int16* Window = In + Index * Factor;
+			int32 Sum = 0;
+
+#if VOICECHAT_DSP_SSE2
+			// Products of 16 bit samples and Q15 taps summed pairwise into 32 bit lanes, exact like the scalar loop
+			__m128i Accumulator = _mm_setzero_si128();
+			for (int32 Tap = 0; Tap < NumTaps; Tap += 8)
+			{
+				const __m128i Samples = _mm_loadu_si128((const __m128i*)(Window + Tap));
+				Accumulator = _mm_add_epi32(Accumulator, _mm_madd_epi16(Samples, _mm_loadu_si128((const __m128i*)(Taps + Tap))));
+			}
+			Accumulator = _mm_add_epi32(Accumulator, _mm_shuffle_epi32(Accumulator, _MM_SHUFFLE(1, 0, 3, 2)));
+			Accumulator = _mm_add_epi32(Accumulator, _mm_shuffle_epi32(Accumulator, _MM_SHUFFLE(2, 3, 0, 1)));
+			Sum = _mm_cvtsi128_si32(Accumulator);
+#else
+			for (int32 Tap = 0; Tap < NumTaps; ++Tap)
+			{
+				Sum += (int32)Window[Tap] * (int32)Taps[Tap];
+			}
+#endif
+
+			Out[Index] = (int16)FMath::Clamp((Sum + (1 << 14)) >> 15, -32768, 32767);
+		}
+	}
+
+	void ApplyGainRamp(int16* Samples, int32 NumSamples, float StartGain, float EndGain)
+	{
+		if (NumSamples <= 0)
+		{
+			return;
+		}
+
+		const float Step = (EndGain - StartGain) / NumSamples;
+		int32 Index = 0;
+
+#if VOICECHAT_DSP_SSE2
+		// Lane k holds the gain of sample Index + k, computed like the scalar loop rather than accumulated so both agree
+		const __m128 Start = _mm_set1_ps(StartGain);
+		const __m128 StepVector = _mm_set1_ps(Step);
+		const __m128 LowLanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		const __m128 HighLanes = _mm_set_ps(7.0f, 6.0f, 5.0f, 4.0f);
+		for (; Index + 8 <= NumSamples; Index += 8)
+		{
+			const __m128i Input = _mm_loadu_si128((const __m128i*)(Samples + Index));
+			const __m128 Low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(Input, Input), 16));
+			const __m128 High = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(Input, Input), 16));
+
+			const __m128 Base = _mm_set1_ps((float)Index);
+			const __m128 LowGain = _mm_add_ps(Start, _mm_mul_ps(StepVector, _mm_add_ps(Base, LowLanes)));
+			const __m128 HighGain = _mm_add_ps(Start, _mm_mul_ps(StepVector, _mm_add_ps(Base, HighLanes)));
+			const __m128i ScaledLow = _mm_cvtps_epi32(_mm_mul_ps(Low, LowGain));
+			const __m128i ScaledHigh = _mm_cvtps_epi32(_mm_mul_ps(High, HighGain));
+
+			// Gains stay far below the range where the 32 bit conversion overflows, the pack saturates to 16 bit
+			_mm_storeu_si128((__m128i*)(Samples + Index), _mm_packs_epi32(ScaledLow, ScaledHigh));
+		}
+#endif
+
+		for (; Index < NumSamples; ++Index)
+		{
+			Samples[Index] = (int16)FMath::Clamp((int32)FMath::RoundHalfToEven(Samples[Index] * (StartGain + Step * (float)Index)), -32768, 32767);
+		}
+	}
+
+	int32 ComputePeak(const int16* Samples, int32 NumSamples)
+	{
+		int32 Max = 0;
+		int32 Min = 0;
+		int32 Index = 0;
+
+#if VOICECHAT_DSP_SSE2
+		__m128i MaxVector = _mm_setzero_si128();
+		__m128i MinVector = _mm_setzero_si128();
+		for (; Index + 8 <= NumSamples; Index += 8)
+		{
+			const __m128i Input = _mm_loadu_si128((const __m128i*)(Samples + Index));
+			MaxVector = _mm_max_epi16(MaxVector, Input);
+			MinVector = _mm_min_epi16(MinVector, Input);
+		}
+
+		alignas(16) int16 MaxLanes[8];
+		alignas(16) int16 MinLanes[8];
+		_mm_store_si128((__m128i*)MaxLanes, MaxVector);
+		_mm_store_si128((__m128i*)MinLanes, MinVector);
+		for (int32 Lane = 0; Lane < 8; ++Lane)
+		{
+			Max = FMath::Max<int32>(Max, MaxLanes[Lane]);
+			Min = FMath::Min<int32>(Min, MinLanes[Lane]);
+		}
+#endif
+
+		for (; Index < NumSamples; ++Index)
+		{
+			Max = FMath::Max<int32>(Max, Samples[Index]);
+			Min = FMath::Min<int32>(Min, Samples[Index]);
+		}
+
+		// Tracked as separate extremes since -32768 has no 16 bit absolute value
+		return FMath::Max(Max, -Min);
+	}
+}
@@ -0,0 +1,203 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatDeviceCache.h"
+#include "Misc/ScopeLock.h"
+#include "HAL/IConsoleManager.h"
+
+/** A device that failed to open is probed again after this long, it may have been busy or plugged in since */
+#define VOICE_FAILED_DEVICE_RETRY_SECONDS 10.0
+
+namespace
+{
+	TUniquePtr<FVoiceChatDeviceCache> GDeviceCache;
+
+	uint64 GetCodecKey(int32 SampleRate, int32 NumChannels, EAudioEncodeHint EncodeHint)
+	{
+		return ((uint64)(uint32)SampleRate << 32) | ((uint64)(uint32)NumChannels << 8) | (uint64)EncodeHint;
+	}
+
+	template<typename T>
+	TSharedPtr<T> PopIdle(TArray<TSharedPtr<T>>* Idle)
+	{
+		return Idle && Idle->Num() > 0 ? Idle->Pop(false) : nullptr;
+	}
+}
+
+FVoiceChatDeviceCache& FVoiceChatDeviceCache::Get()
+{
+	if (!GDeviceCache.IsValid())
+	{
+		check(IsInGameThread());
+		GDeviceCache.Reset(new FVoiceChatDeviceCache());
+	}
+	return *GDeviceCache;
+}
+
+void FVoiceChatDeviceCache::Destroy()
+{
+	if (GDeviceCache.IsValid())
+	{
+		GDeviceCache->Flush();
+		GDeviceCache.Reset();
+	}
+}
+
+FVoiceChatDeviceCache::FVoiceChatDeviceCache() :
+	VoiceModule(FVoiceModule::Get())
+{
+}
+
+TSharedPtr<IVoiceCapture> FVoiceChatDeviceCache::AcquireCapture(const FString& DeviceName, int32 SampleRate, int32 NumChannels)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (const double* FailedTime = FailedDevices.Find(DeviceName))
+		{
+			if (FPlatformTime::Seconds() - *FailedTime < VOICE_FAILED_DEVICE_RETRY_SECONDS)
+			{
+				return nullptr;
+			}
+			FailedDevices.Remove(DeviceName);
+		}
+		if (TSharedPtr<IVoiceCapture> Capture = PopIdle(IdleCaptures.Find(GetCaptureKey(DeviceName, SampleRate, NumChannels))))
+		{
+			return Capture;
+		}
+	}
+
+	// The slow part, opened outside the lock so other formats are not held up
+	TSharedPtr<IVoiceCapture> Capture = VoiceModule.CreateVoiceCapture(DeviceName, SampleRate, NumChannels);
+	if (!Capture.IsValid())
+	{
+		UE_LOG(LogVoice, Warning, TEXT("Failed to open voice capture device '%s', not trying it again for %.0f seconds"), *DeviceName, VOICE_FAILED_DEVICE_RETRY_SECONDS);
+
+		FScopeLock ScopeLock(&Lock);
+		FailedDevices.Add(DeviceName, FPlatformTime::Seconds());
+	}
+	return Capture;
+}
+
+void FVoiceChatDeviceCache::ReleaseCapture(const TSharedPtr<IVoiceCapture>& Capture, const FString& DeviceName, int32 SampleRate, int32 NumChannels)
+{
+	if (!Capture.IsValid())
+	{
+		return;
+	}
+
+	Capture->Stop();
+
+	FScopeLock ScopeLock(&Lock);
+	TArray<TSharedPtr<IVoiceCapture>>& Idle = IdleCaptures.FindOrAdd(GetCaptureKey(DeviceName, SampleRate, NumChannels));
+	if (Idle.Num() < VOICE_MAX_IDLE_CODECS)
+	{
+		Idle.Add(Capture);
+	}
+	else
+	{
+		Capture->Shutdown();
+	}
+}
+
+TSharedPtr<IVoiceEncoder> FVoiceChatDeviceCache::AcquireEncoder(int32 SampleRate, int32 NumChannels, EAudioEncodeHint EncodeHint)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (TSharedPtr<IVoiceEncoder> Encoder = PopIdle(IdleEncoders.Find(GetCodecKey(SampleRate, NumChannels, EncodeHint))))
+		{
+			return Encoder;
+		}
+	}
+	return VoiceModule.CreateVoiceEncoder(SampleRate, NumChannels, EncodeHint);
+}
+
+void FVoiceChatDeviceCache::ReleaseEncoder(const TSharedPtr<IVoiceEncoder>& Encoder, int32 SampleRate, int32 NumChannels, EAudioEncodeHint EncodeHint)
+{
+	if (!Encoder.IsValid())
+	{
+		return;
+	}
+
+	// Opus carries state from the previous stream, the next owner must start clean
+	Encoder->Reset();
+
+	FScopeLock ScopeLock(&Lock);
+	TArray<TSharedPtr<IVoiceEncoder>>& Idle = IdleEncoders.FindOrAdd(GetCodecKey(SampleRate, NumChannels, EncodeHint));
+	if (Idle.Num() < VOICE_MAX_IDLE_CODECS)
+	{
+		Idle.Add(Encoder);
+	}
+}
+
+TSharedPtr<IVoiceDecoder> FVoiceChatDeviceCache::AcquireDecoder(int32 SampleRate, int32 NumChannels)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (TSharedPtr<IVoiceDecoder> Decoder = PopIdle(IdleDecoders.Find(GetCodecKey(SampleRate, NumChannels, EAudioEncodeHint::VoiceEncode_Voice))))
+		{
+			return Decoder;
+		}
+	}
+	return VoiceModule.CreateVoiceDecoder(SampleRate, NumChannels);
+}
+
+void FVoiceChatDeviceCache::ReleaseDecoder(const TSharedPtr<IVoiceDecoder>& Decoder, int32 SampleRate, int32 NumChannels)
+{
+	if (!Decoder.IsValid())
+	{
+		return;
+	}
+
+	Decoder->Reset();
+
+	FScopeLock ScopeLock(&Lock);
+	TArray<TSharedPtr<IVoiceDecoder>>& Idle = IdleDecoders.FindOrAdd(GetCodecKey(SampleRate, NumChannels, EAudioEncodeHint::VoiceEncode_Voice));
+	if (Idle.Num() < VOICE_MAX_IDLE_CODECS)
+	{
+		Idle.Add(Decoder);
+	}
+}
+
+bool FVoiceChatDeviceCache::IsDeviceAvailable(const FString& DeviceName) const
+{
+	FScopeLock ScopeLock(&Lock);
+	const double* FailedTime = FailedDevices.Find(DeviceName);
+	return !FailedTime || FPlatformTime::Seconds() - *FailedTime >= VOICE_FAILED_DEVICE_RETRY_SECONDS;
+}
+
+void FVoiceChatDeviceCache::RetryDevice(const FString& DeviceName)
+{
+	FScopeLock ScopeLock(&Lock);
+	FailedDevices.Remove(DeviceName);
+}
+
+void FVoiceChatDeviceCache::Flush()
+{
+	FScopeLock ScopeLock(&Lock);
+	for (TPair<FString, TArray<TSharedPtr<IVoiceCapture>>>& Pair : IdleCaptures)
+	{
+		for (const TSharedPtr<IVoiceCapture>& Capture : Pair.Value)
+		{
+			Capture->Shutdown();
+		}
+	}
+	IdleCaptures.Empty();
+	IdleEncoders.Empty();
+	IdleDecoders.Empty();
+	FailedDevices.Empty();
+}
+
+FString FVoiceChatDeviceCache::GetCaptureKey(const FString& DeviceName, int32 SampleRate, int32 NumChannels)
+{
+	return FString::Printf(TEXT("%s|%d|%d"), *DeviceName, SampleRate, NumChannels);
+}
+
+#if !UE_BUILD_SHIPPING
+static FAutoConsoleCommand VoiceChatFlushDevicesCommand(
+	TEXT("voicechat.FlushDevices"),
+	TEXT("Closes every idle voice capture device and codec and probes failed devices again, e.g. after plugging in a microphone."),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		FVoiceChatDeviceCache::Get().Flush();
+	}));
+#endif
@@ -0,0 +1,213 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatFormatConverter.h"
+#include "VoiceChatDSP.h"
+
+/** Decimator length per unit of decimation factor, 96 taps take 48 kHz to 16 kHz with about 60 dB of alias rejection */
+#define VOICE_DECIMATOR_TAPS_PER_FACTOR 32
+/** Decimator cutoff as a fraction of the output Nyquist frequency, the transition band ends close to Nyquist */
+#define VOICE_DECIMATOR_CUTOFF 0.85
+
+namespace
+{
+	/** Blackman windowed sinc low-pass for decimating by Factor, normalized to unity gain at DC and quantized to Q15 */
+	void DesignDecimatorTaps(int32 Factor, TArray<int16>& OutTaps)
+	{
+		const int32 NumTaps = VOICE_DECIMATOR_TAPS_PER_FACTOR * Factor;
+		const double Cutoff = 0.5 * VOICE_DECIMATOR_CUTOFF / Factor;
+
+		TArray<double> Taps;
+		Taps.SetNumUninitialized(NumTaps);
+		double Sum = 0.0;
+		for (int32 Tap = 0; Tap < NumTaps; ++Tap)
+		{
+			// NumTaps is even, the center falls between two taps and X is never 0
+			const double X = Tap - (NumTaps - 1) * 0.5;
+			const double Sinc = FMath::Sin(2.0 * PI * Cutoff * X) / (PI * X);
+			const double Phase = 2.0 * PI * Tap / (NumTaps - 1);
+			const double Window = 0.42 - 0.5 * FMath::Cos(Phase) + 0.08 * FMath::Cos(2.0 * Phase);
+			Taps[Tap] = Sinc * Window;
+			Sum += Taps[Tap];
+		}
+
+		OutTaps.SetNumUninitialized(NumTaps);
+		for (int32 Tap = 0; Tap < NumTaps; ++Tap)
+		{
+			OutTaps[Tap] = (int16)FMath::RoundToInt((float)(Taps[Tap] / Sum * 32768.0));
+		}
+	}
+}
+
+FVoiceChatFormatConverter::FVoiceChatFormatConverter() :
+	InputSampleRate(48000),
+	InputChannels(2),
+	OutputSampleRate(48000),
+	OutputChannels(2),
+	DecimationFactor(1),
+	BaseStep(1.0),
+	RateRatio(1.0),
+	Step(1.0),
+	Phase(0.0)
+{
+}
+
+void FVoiceChatFormatConverter::Init(int32 InInputSampleRate, int32 InInputChannels, int32 InOutputSampleRate, int32 InOutputChannels)
+{
+	InputSampleRate = FMath::Max(InInputSampleRate, 1);
+	InputChannels = FMath::Max(InInputChannels, 1);
+	OutputSampleRate = FMath::Max(InOutputSampleRate, 1);
+	OutputChannels = FMath::Max(InOutputChannels, 1);
+
+	ensureMsgf(InputChannels == OutputChannels || InputChannels == 1 || OutputChannels == 1,
+		TEXT("Unsupported voice channel conversion %d -> %d"), InputChannels, OutputChannels);
+
+	// Only mono is decimated, no profile downsamples more than one channel and the filter would have to run per channel
+	DecimationFactor = 1;
+	DecimatorTaps.Reset();
+	if (InputSampleRate > OutputSampleRate && InputSampleRate % OutputSampleRate == 0 && FMath::Min(InputChannels, OutputChannels) == 1)
+	{
+		DecimationFactor = InputSampleRate / OutputSampleRate;
+		DesignDecimatorTaps(DecimationFactor, DecimatorTaps);
+	}
+
+	BaseStep = (double)InputSampleRate / ((double)OutputSampleRate * DecimationFactor);
+	RateRatio = 1.0;
+	Step = BaseStep;
+	Reset();
+}
+
+void FVoiceChatFormatConverter::SetRateRatio(double Ratio)
+{
+	const bool bWasPassthrough = IsPassthrough();
+	RateRatio = Ratio;
+	Step = BaseStep * RateRatio;
+
+	// History and phase are stale after passing audio through, start interpolating at the next block
+	if (bWasPassthrough && !IsPassthrough())
+	{
+		Reset();
+	}
+}
+
+void FVoiceChatFormatConverter::Reset()
+{
+	Phase = 0.0;
+	History.Reset();
+	History.AddZeroed(FMath::Min(InputChannels, OutputChannels));
+
+	// The filter starts out on silence, so output begins with the first block instead of NumTaps samples later
+	DecimatorInput.Reset();
+	if (DecimationFactor > 1)
+	{
+		DecimatorInput.AddZeroed(DecimatorTaps.Num() - 1);
+	}
+}
+
+int32 FVoiceChatFormatConverter::GetMaxOutputFrames(int32 NumFrames) const
+{
+	// The decimator may also release the frames it held back from the previous block
+	const int32 NumDecimatedFrames = DecimationFactor > 1 ? NumFrames / DecimationFactor + 1 : NumFrames;
+	return FMath::CeilToInt((NumDecimatedFrames + 1) / Step) + 1;
+}
+
+int32 FVoiceChatFormatConverter::Convert(const int16* In, int32 NumFrames, TArray<int16>& Out)
+{
+	Out.Reset();
+	if (NumFrames <= 0)
+	{
+		return 0;
+	}
+
+	if (IsPassthrough())
+	{
+		Out.Append(In, NumFrames * InputChannels);
+		return NumFrames;
+	}
+
+	// Work on the smaller channel count
+	const int32 WorkChannels = FMath::Min(InputChannels, OutputChannels);
+	const int16* Work = In;
+	if (OutputChannels < InputChannels)
+	{
+		Scratch.SetNumUninitialized(NumFrames, false);
+		VoiceChatDSP::DownmixToMono(In, Scratch.GetData(), NumFrames, InputChannels);
+		Work = Scratch.GetData();
+	}
+
+	int32 NumOutFrames = NumFrames;
+	if (DecimationFactor > 1)
+	{
+		Decimate(Work, NumFrames, Decimated);
+		Work = Decimated.GetData();
+		NumOutFrames = Decimated.Num();
+		if (NumOutFrames == 0)
+		{
+			return 0;
+		}
+	}
+
+	// Whatever the decimator left, usually only the drift trim
+	if (Step != 1.0)
+	{
+		if (OutputChannels > InputChannels)
+		{
+			// Resample into Scratch, the upmix below expands it into Out
+			Scratch.Reset();
+			Resample(Work, NumOutFrames, WorkChannels, Scratch);
+			Work = Scratch.GetData();
+			NumOutFrames = Scratch.Num() / WorkChannels;
+		}
+		else
+		{
+			Resample(Work, NumOutFrames, WorkChannels, Out);
+			return Out.Num() / WorkChannels;
+		}
+	}
+
+	if (OutputChannels > WorkChannels)
+	{
+		Out.SetNumUninitialized(NumOutFrames * OutputChannels, false);
+		VoiceChatDSP::UpmixFromMono(Work, Out.GetData(), NumOutFrames, OutputChannels);
+	}
+	else
+	{
+		Out.Append(Work, NumOutFrames * WorkChannels);
+	}
+	return NumOutFrames;
+}
+
+void FVoiceChatFormatConverter::Resample(const int16* In, int32 NumFrames, int32 Channels, TArray<int16>& Out)
+{
+	// In[-1] is the last frame of the previous block, kept in History, so interpolation runs seamlessly across blocks
+	double Position = Phase;
+	Out.Reserve(Out.Num() + (FMath::CeilToInt((NumFrames + 1) / Step) + 1) * Channels);
+	while (Position < NumFrames - 1)
+	{
+		const int32 Index = FMath::FloorToInt((float)Position);
+		const float Fraction = (float)(Position - Index);
+		const int16* A = Index < 0 ? History.GetData() : In + Index * Channels;
+		const int16* B = In + (Index + 1) * Channels;
+		for (int32 Channel = 0; Channel < Channels; ++Channel)
+		{
+			Out.Add((int16)FMath::RoundToInt(A[Channel] + (B[Channel] - A[Channel]) * Fraction));
+		}
+		Position += Step;
+	}
+
+	Phase = Position - NumFrames;
+	FMemory::Memcpy(History.GetData(), In + (NumFrames - 1) * Channels, Channels * sizeof(int16));
+}
+
+void FVoiceChatFormatConverter::Decimate(const int16* In, int32 NumFrames, TArray<int16>& Out)
+{
+	const int32 NumTaps = DecimatorTaps.Num();
+	DecimatorInput.Append(In, NumFrames);
+
+	const int32 NumOut = DecimatorInput.Num() >= NumTaps ? (DecimatorInput.Num() - NumTaps) / DecimationFactor + 1 : 0;
+	Out.SetNumUninitialized(NumOut, false);
+	VoiceChatDSP::FirDecimate(DecimatorInput.GetData(), Out.GetData(), NumOut, DecimationFactor, DecimatorTaps.GetData(), NumTaps);
+
+	// Keep what the next output still needs, a few dozen samples
+	DecimatorInput.RemoveAt(0, NumOut * DecimationFactor, false);
+}
@@ -0,0 +1,242 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatJitterBuffer.h"
+
+/** Hard limit on the number of packets held, protects against a sender flooding us */
+#define VOICE_JITTER_MAX_PACKETS 64
+/** Target delay is this many times the smoothed jitter estimate */
+#define VOICE_JITTER_TARGET_MULTIPLIER 3.0f
+/** Between talk spurts, a packet further behind than this comes from a sender that restarted its sequence, not a straggler */
+#define VOICE_JITTER_MAX_LATE_SEQUENCE 256
+
+FVoiceChatJitterBuffer::FVoiceChatJitterBuffer() :
+	SampleRate(48000),
+	MinDelayMs(40.0f),
+	MaxDelayMs(80.0f),
+	MaxLatencyMs(200.0f),
+	TargetDelayMs(40.0f),
+	bPlaying(false),
+	NextSequence(0),
+	bHasNextSequence(false),
+	LastTransitMs(0.0),
+	bHasLastTransit(false),
+	JitterMs(0.0f),
+	ReceivedCount(0),
+	LateCount(0),
+	LostCount(0),
+	DroppedCount(0)
+{
+}
+
+void FVoiceChatJitterBuffer::Configure(int32 InSampleRate, float InMinDelayMs, float InMaxDelayMs, float InMaxLatencyMs)
+{
+	SampleRate = FMath::Max(InSampleRate, 1);
+	MinDelayMs = FMath::Max(InMinDelayMs, 0.0f);
+	MaxDelayMs = FMath::Max(InMaxDelayMs, MinDelayMs);
+	MaxLatencyMs = FMath::Max(InMaxLatencyMs, MaxDelayMs);
+
+	Reset();
+	ResetTiming();
+}
+
+void FVoiceChatJitterBuffer::Reset()
+{
+	while (Slots.Num() > 0)
+	{
+		FreePayloads.Add(MoveTemp(Slots.Last().Payload));
+		Slots.Pop(false);
+	}
+	bPlaying = false;
+	bHasNextSequence = false;
+}
+
+void FVoiceChatJitterBuffer::ResetTiming()
+{
+	bHasLastTransit = false;
+	JitterMs = 0.0f;
+	UpdateTargetDelay();
+}
+
+bool FVoiceChatJitterBuffer::Insert(const FVoiceChatPacketHeader& Header, const uint8* Payload, int32 PayloadSize, double ArrivalTime)
+{
+	++ReceivedCount;
+
+	// RFC 3550 style inter-arrival jitter, compares the spacing of arrivals against the spacing of capture timestamps
+	const double TransitMs = ArrivalTime * 1000.0 - (double)Header.Timestamp * 1000.0 / SampleRate;
+	if (bHasLastTransit)
+	{
+		const float Delta = FMath::Abs((float)(TransitMs - LastTransitMs));
+		JitterMs += (Delta - JitterMs) / 16.0f;
+		UpdateTargetDelay();
+	}
+	LastTransitMs = TransitMs;
+	bHasLastTransit = true;
+
+	// Late whether or not a talk spurt is playing, a straggler arriving after its talk spurt's silence marker would
+	// otherwise start the next one with old audio
+	const int32 SequenceDelta = FVoiceChatPacketHeader::SequenceDelta(Header.Sequence, NextSequence);
+	if (bHasNextSequence && SequenceDelta < 0)
+	{
+		if (bPlaying || Slots.Num() > 0 || SequenceDelta >= -VOICE_JITTER_MAX_LATE_SEQUENCE)
+		{
+			++LateCount;
+			return false;
+		}
+		bHasNextSequence = false;
+	}
+
+	// Find the insertion point from the back, packets almost always arrive in order
+	int32 InsertIndex = Slots.Num();
+	while (InsertIndex > 0)
+	{
+		const int32 Delta = FVoiceChatPacketHeader::SequenceDelta(Header.Sequence, Slots[InsertIndex - 1].Header.Sequence);
+		if (Delta == 0)
+		{
+			// Duplicate
+			return false;
+		}
+		if (Delta > 0)
+		{
+			break;
+		}
+		--InsertIndex;
+	}
+
+	if (Slots.Num() >= VOICE_JITTER_MAX_PACKETS)
+	{
+		if (InsertIndex == 0)
+		{
+			++DroppedCount;
+			return false;
+		}
+
+		FreePayloads.Add(MoveTemp(Slots[0].Payload));
+		Slots.RemoveAt(0, 1, false);
+		--InsertIndex;
+		++DroppedCount;
+	}
+
+	FSlot& Slot = Slots.InsertDefaulted_GetRef(InsertIndex);
+	Slot.Header = Header;
+	Slot.ArrivalTime = ArrivalTime;
+	if (FreePayloads.Num() > 0)
+	{
+		Slot.Payload = FreePayloads.Pop(false);
+	}
+	Slot.Payload.Reset();
+	Slot.Payload.Append(Payload, PayloadSize);
+
+	return true;
+}
+
+bool FVoiceChatJitterBuffer::Pop(float QueuedMs, FVoiceChatPacketHeader& OutHeader, TArray<uint8>& OutPayload, int32& OutNumLost, double& OutArrivalTime)
+{
+	OutNumLost = 0;
+
+	if (Slots.Num() == 0)
+	{
+		if (bPlaying && QueuedMs <= 0.0f)
+		{
+			// Talk spurt ended or the stream starved, prebuffer again before resuming
+			bPlaying = false;
+		}
+		return false;
+	}
+
+	if (!bPlaying)
+	{
+		if (GetDepthMs() < TargetDelayMs)
+		{
+			return false;
+		}
+
+		// Slots only holds packets at or after NextSequence, packets lost before a talk spurt are not worth concealing
+		bPlaying = true;
+		NextSequence = Slots[0].Header.Sequence;
+		bHasNextSequence = true;
+	}
+
+	// Keep mouth to ear latency bounded by dropping the oldest audio
+	while (Slots.Num() > 1 && GetDepthMs() + QueuedMs > MaxLatencyMs)
+	{
+		FreePayloads.Add(MoveTemp(Slots[0].Payload));
+		Slots.RemoveAt(0, 1, false);
+		++DroppedCount;
+		NextSequence = Slots[0].Header.Sequence;
+	}
+
+	if (QueuedMs >= TargetDelayMs)
+	{
+		return false;
+	}
+
+	const int32 Gap = FVoiceChatPacketHeader::SequenceDelta(Slots[0].Header.Sequence, NextSequence);
+	if (Gap > 0)
+	{
+		// Wait for the missing packets as long as there is still decoded audio to play
+		const float FrameMs = SamplesToMs(Slots[0].Header.NumSamples);
+		if (QueuedMs > FrameMs && GetDepthMs() < TargetDelayMs)
+		{
+			return false;
+		}
+
+		LostCount += Gap;
+		OutNumLost = Gap;
+	}
+
+	OutArrivalTime = Slots[0].ArrivalTime;
+	RemoveFront(OutHeader, OutPayload);
+	NextSequence = OutHeader.Sequence + 1;
+
+	if (EnumHasAnyFlags(OutHeader.Flags, EVoiceChatPacketFlags::Silence))
+	{
+		// Talk spurt over, prebuffer again before the next one
+		bPlaying = false;
+	}
+	return true;
+}
+
+float FVoiceChatJitterBuffer::GetDepthMs() const
+{
+	int32 NumSamples = 0;
+	for (const FSlot& Slot : Slots)
+	{
+		NumSamples += Slot.Header.NumSamples;
+	}
+	return SamplesToMs(NumSamples);
+}
+
+FVoiceChatJitterBufferStats FVoiceChatJitterBuffer::GetStats() const
+{
+	FVoiceChatJitterBufferStats Stats;
+	Stats.DepthMs = GetDepthMs();
+	Stats.TargetDelayMs = TargetDelayMs;
+	Stats.JitterMs = JitterMs;
+	Stats.ReceivedCount = ReceivedCount;
+	Stats.LateCount = LateCount;
+	Stats.LostCount = LostCount;
+	Stats.DroppedCount = DroppedCount;
+	return Stats;
+}
+
+float FVoiceChatJitterBuffer::SamplesToMs(int32 NumSamples) const
+{
+	return NumSamples * 1000.0f / SampleRate;
+}
+
+void FVoiceChatJitterBuffer::RemoveFront(FVoiceChatPacketHeader& OutHeader, TArray<uint8>& OutPayload)
+{
+	FSlot& Front = Slots[0];
+	OutHeader = Front.Header;
+
+	// Hand the payload over without copying, the caller's previous buffer is recycled in its place
+	Exchange(OutPayload, Front.Payload);
+	FreePayloads.Add(MoveTemp(Front.Payload));
+	Slots.RemoveAt(0, 1, false);
+}
+
+void FVoiceChatJitterBuffer::UpdateTargetDelay()
+{
+	TargetDelayMs = FMath::Clamp(JitterMs * VOICE_JITTER_TARGET_MULTIPLIER, MinDelayMs, MaxDelayMs);
+}
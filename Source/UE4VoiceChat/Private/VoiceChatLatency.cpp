@@ -0,0 +1,95 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatLatency.h"
+
+void FVoiceChatLatencyHistogram::Add(float Ms)
+{
+	if (Bins.Num() == 0)
+	{
+		Bins.AddZeroed(VOICE_LATENCY_NUM_BINS);
+	}
+
+	const int32 Bin = FMath::Clamp(FMath::FloorToInt(Ms / VOICE_LATENCY_BIN_MS), 0, VOICE_LATENCY_NUM_BINS - 1);
+	++Bins[Bin];
+	++Count;
+}
+
+float FVoiceChatLatencyHistogram::GetPercentile(float Percentile) const
+{
+	if (Count == 0)
+	{
+		return 0.0f;
+	}
+
+	const uint64 Target = FMath::Max<uint64>(1, FMath::CeilToInt(FMath::Clamp(Percentile, 0.0f, 100.0f) / 100.0f * Count));
+	uint64 Cumulative = 0;
+	for (int32 Bin = 0; Bin < Bins.Num(); ++Bin)
+	{
+		Cumulative += Bins[Bin];
+		if (Cumulative >= Target)
+		{
+			return (Bin + 1) * VOICE_LATENCY_BIN_MS;
+		}
+	}
+	return VOICE_LATENCY_NUM_BINS * VOICE_LATENCY_BIN_MS;
+}
+
+void FVoiceChatLatencyHistogram::Reset()
+{
+	Bins.Empty();
+	Count = 0;
+}
+
+void FVoiceChatLatencyTracker::Record(const FVoiceChatLatencyMark& Mark, double ClockOffsetSeconds)
+{
+	// Shared clock stamps wrap at 32 bits, only their differences are meaningful
+	const uint32 SentMs = Mark.CaptureTimeMs + Mark.SendDelayMs;
+	const int32 NetworkMs = (int32)(ToSharedMs(Mark.ArrivalTime, ClockOffsetSeconds) - SentMs);
+	const int32 TotalMs = (int32)(ToSharedMs(Mark.PlayoutTime, ClockOffsetSeconds) - Mark.CaptureTimeMs);
+
+	// Clock sync error can make the network time slightly negative, count it as instant rather than dropping the sample
+	Histograms[(int32)EVoiceChatLatencyStage::Send].Add(Mark.SendDelayMs);
+	Histograms[(int32)EVoiceChatLatencyStage::Network].Add(FMath::Max(NetworkMs, 0));
+	Histograms[(int32)EVoiceChatLatencyStage::JitterBuffer].Add((float)((Mark.DecodeTime - Mark.ArrivalTime) * 1000.0));
+	Histograms[(int32)EVoiceChatLatencyStage::Playback].Add((float)((Mark.PlayoutTime - Mark.DecodeTime) * 1000.0));
+	Histograms[(int32)EVoiceChatLatencyStage::Total].Add(FMath::Max(TotalMs, 0));
+}
+
+float FVoiceChatLatencyTracker::GetPercentileMs(EVoiceChatLatencyStage Stage, float Percentile) const
+{
+	return Stage < EVoiceChatLatencyStage::Num ? Histograms[(int32)Stage].GetPercentile(Percentile) : 0.0f;
+}
+
+int32 FVoiceChatLatencyTracker::GetNumSamples() const
+{
+	return Histograms[(int32)EVoiceChatLatencyStage::Total].GetCount();
+}
+
+void FVoiceChatLatencyTracker::Reset()
+{
+	for (FVoiceChatLatencyHistogram& Histogram : Histograms)
+	{
+		Histogram.Reset();
+	}
+}
+
+FString FVoiceChatLatencyTracker::ToString() const
+{
+	static const TCHAR* StageNames[] = { TEXT("Send"), TEXT("Network"), TEXT("JitterBuffer"), TEXT("Playback"), TEXT("Total") };
+	static_assert(UE_ARRAY_COUNT(StageNames) == (int32)EVoiceChatLatencyStage::Num, "Stage names out of date");
+
+	FString Result = FString::Printf(TEXT("%d packets"), GetNumSamples());
+	for (int32 Stage = 0; Stage < (int32)EVoiceChatLatencyStage::Num; ++Stage)
+	{
+		const FVoiceChatLatencyHistogram& Histogram = Histograms[Stage];
+		Result += FString::Printf(TEXT(", %s p50 %.0f p95 %.0f p99 %.0f ms"), StageNames[Stage],
+			Histogram.GetPercentile(50.0f), Histogram.GetPercentile(95.0f), Histogram.GetPercentile(99.0f));
+	}
+	return Result;
+}
+
+uint32 FVoiceChatLatencyTracker::ToSharedMs(double LocalSeconds, double ClockOffsetSeconds)
+{
+	return (uint32)(int64)((LocalSeconds + ClockOffsetSeconds) * 1000.0);
+}
@@ -0,0 +1,241 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatMemory.h"
+#include "VoiceChatStats.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ScopeLock.h"
+
+/** Smallest block a scratch arena allocates, fits the encode and decode buffers of a 48 kHz stereo component */
+#define VOICE_SCRATCH_BLOCK_SIZE 256 * 1024
+#define VOICE_SCRATCH_ALIGNMENT 16
+
+static int32 GVoiceChatQueueBudgetKB = 16 * 1024;
+static FAutoConsoleVariableRef CVarVoiceChatQueueBudgetKB(
+	TEXT("voicechat.QueueBudgetKB"),
+	GVoiceChatQueueBudgetKB,
+	TEXT("Memory all voice chat playback queues may take together, in KB. Queues created while it is exceeded get less audio, 0 for no limit."));
+
+namespace
+{
+	TAtomic<int64> GScratchArenaSize(0);
+
+	/** Blocks of scratch memory owned by one thread, handed out in order and taken back in reverse */
+	struct FScratchArena
+	{
+		struct FBlock
+		{
+			uint8* Data;
+			int32 Size;
+		};
+
+		TArray<FBlock> Blocks;
+		int32 CurrentBlock = 0;
+		int32 CurrentOffset = 0;
+
+		~FScratchArena()
+		{
+			for (const FBlock& Block : Blocks)
+			{
+				FMemory::Free(Block.Data);
+				GScratchArenaSize -= Block.Size;
+				DEC_MEMORY_STAT_BY(STAT_VoiceChat_ScratchMemory, Block.Size);
+			}
+		}
+
+		uint8* Allocate(int32 NumBytes)
+		{
+			NumBytes = Align(FMath::Max(NumBytes, 1), VOICE_SCRATCH_ALIGNMENT);
+
+			// A request that does not fit the rest of a block moves on to the next one, the tail stays unused until the scope ends
+			while (CurrentBlock < Blocks.Num())
+			{
+				FBlock& Block = Blocks[CurrentBlock];
+				if (CurrentOffset + NumBytes <= Block.Size)
+				{
+					uint8* Result = Block.Data + CurrentOffset;
+					CurrentOffset += NumBytes;
+					return Result;
+				}
+				++CurrentBlock;
+				CurrentOffset = 0;
+			}
+
+			const int32 Size = FMath::Max(NumBytes, VOICE_SCRATCH_BLOCK_SIZE);
+			Blocks.Add({ (uint8*)FMemory::Malloc(Size, VOICE_SCRATCH_ALIGNMENT), Size });
+			VoiceChatStats::CountPoolAllocation();
+			GScratchArenaSize += Size;
+			INC_MEMORY_STAT_BY(STAT_VoiceChat_ScratchMemory, Size);
+
+			CurrentBlock = Blocks.Num() - 1;
+			CurrentOffset = NumBytes;
+			return Blocks.Last().Data;
+		}
+	};
+
+	FScratchArena& GetScratchArena()
+	{
+		static thread_local FScratchArena Arena;
+		return Arena;
+	}
+}
+
+FVoiceChatScratchScope::FVoiceChatScratchScope()
+{
+	const FScratchArena& Arena = GetScratchArena();
+	MarkBlock = Arena.CurrentBlock;
+	MarkOffset = Arena.CurrentOffset;
+}
+
+FVoiceChatScratchScope::~FVoiceChatScratchScope()
+{
+	FScratchArena& Arena = GetScratchArena();
+	Arena.CurrentBlock = MarkBlock;
+	Arena.CurrentOffset = MarkOffset;
+}
+
+TArrayView<uint8> FVoiceChatScratchScope::Allocate(int32 NumBytes)
+{
+	return TArrayView<uint8>(GetScratchArena().Allocate(NumBytes), FMath::Max(NumBytes, 0));
+}
+
+int64 FVoiceChatScratchScope::GetTotalArenaSize()
+{
+	return GScratchArenaSize.Load();
+}
+
+FVoiceChatQueuePool& FVoiceChatQueuePool::Get()
+{
+	static FVoiceChatQueuePool Pool;
+	return Pool;
+}
+
+FVoiceChatQueuePool::FVoiceChatQueuePool() :
+	AllocatedBytes(0),
+	UsedBytes(0),
+	bWarnedOverBudget(false)
+{
+}
+
+TArray<uint8> FVoiceChatQueuePool::Acquire(uint32 DesiredBytes, uint32 MinBytes)
+{
+	TArray<uint8> Storage;
+	if (DesiredBytes == 0)
+	{
+		return Storage;
+	}
+
+	uint32 Size = FMath::RoundUpToPowerOfTwo(DesiredBytes);
+	const uint32 MinSize = FMath::Min(FMath::RoundUpToPowerOfTwo(FMath::Max(MinBytes, 1u)), Size);
+
+	FScopeLock ScopeLock(&Lock);
+	const int64 Budget = GetBudget();
+	while (true)
+	{
+		TArray<TArray<uint8>>* IdleOfSize = Idle.Find(Size);
+		if (IdleOfSize && IdleOfSize->Num() > 0)
+		{
+			Storage = IdleOfSize->Pop(false);
+			break;
+		}
+
+		// Idle storage of other sizes is worth less than giving this queue its full depth
+		if (Budget > 0 && AllocatedBytes + Size > Budget)
+		{
+			FreeIdle(AllocatedBytes + Size - Budget);
+		}
+		if (Budget <= 0 || AllocatedBytes + Size <= Budget || Size <= MinSize)
+		{
+			if (Budget > 0 && AllocatedBytes + Size > Budget && !bWarnedOverBudget)
+			{
+				UE_LOG(LogVoice, Warning, TEXT("Voice chat queues exceed voicechat.QueueBudgetKB %d, raise it for this many talkers"), GVoiceChatQueueBudgetKB);
+				bWarnedOverBudget = true;
+			}
+
+			Storage.AddZeroed(Size);
+			AllocatedBytes += Size;
+			VoiceChatStats::CountPoolAllocation();
+			break;
+		}
+		Size /= 2;
+	}
+
+	UsedBytes += Storage.Num();
+	UpdateStats();
+	return Storage;
+}
+
+void FVoiceChatQueuePool::Release(TArray<uint8>&& Storage, uint32 AcquiredBytes)
+{
+	FScopeLock ScopeLock(&Lock);
+	UsedBytes -= AcquiredBytes;
+
+	// Storage the queue did not get from here is simply freed
+	const int64 Budget = GetBudget();
+	if (AcquiredBytes > 0 && Storage.Num() == (int32)AcquiredBytes && (Budget <= 0 || AllocatedBytes <= Budget))
+	{
+		Idle.FindOrAdd(AcquiredBytes).Add(MoveTemp(Storage));
+	}
+	else
+	{
+		AllocatedBytes -= AcquiredBytes;
+		Storage.Empty();
+	}
+	UpdateStats();
+}
+
+void FVoiceChatQueuePool::Trim()
+{
+	FScopeLock ScopeLock(&Lock);
+	FreeIdle(MAX_int64);
+	UpdateStats();
+}
+
+void FVoiceChatQueuePool::FreeIdle(int64 BytesNeeded)
+{
+	int64 Freed = 0;
+	for (auto It = Idle.CreateIterator(); It && Freed < BytesNeeded; ++It)
+	{
+		TArray<TArray<uint8>>& IdleOfSize = It.Value();
+		while (IdleOfSize.Num() > 0 && Freed < BytesNeeded)
+		{
+			Freed += IdleOfSize.Pop(false).Num();
+		}
+		if (IdleOfSize.Num() == 0)
+		{
+			It.RemoveCurrent();
+		}
+	}
+	AllocatedBytes -= Freed;
+}
+
+void FVoiceChatQueuePool::UpdateStats() const
+{
+	SET_MEMORY_STAT(STAT_VoiceChat_QueueMemory, AllocatedBytes);
+	SET_MEMORY_STAT(STAT_VoiceChat_QueueMemoryIdle, AllocatedBytes - UsedBytes);
+}
+
+int64 FVoiceChatQueuePool::GetBudget() const
+{
+	return FMath::Max<int64>(GVoiceChatQueueBudgetKB, 0) * 1024;
+}
+
+int64 FVoiceChatQueuePool::GetAllocatedBytes() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return AllocatedBytes;
+}
+
+int64 FVoiceChatQueuePool::GetUsedBytes() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return UsedBytes;
+}
+
+FString FVoiceChatQueuePool::ToString() const
+{
+	FScopeLock ScopeLock(&Lock);
+	const int64 Budget = GetBudget();
+	return FString::Printf(TEXT("queues %.1f KB in use, %.1f KB idle, budget %s"), UsedBytes / 1024.0, (AllocatedBytes - UsedBytes) / 1024.0,
+		Budget > 0 ? *FString::Printf(TEXT("%.1f KB"), Budget / 1024.0) : TEXT("none"));
+}
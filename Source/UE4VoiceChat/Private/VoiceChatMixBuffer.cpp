@@ -0,0 +1,50 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatMixBuffer.h"
+#include "VoiceChatDSP.h"
+#include "VoiceChatStats.h"
+
+FVoiceChatMixBuffer::FVoiceChatMixBuffer() :
+	NumFrames(0),
+	NumChannels(1)
+{
+}
+
+void FVoiceChatMixBuffer::Begin(int32 InNumFrames, int32 InNumChannels)
+{
+	NumFrames = FMath::Max(InNumFrames, 0);
+	NumChannels = FMath::Max(InNumChannels, 1);
+
+	const int32 NumSamples = NumFrames * NumChannels;
+	Accumulator.Reset(NumSamples);
+	Accumulator.AddZeroed(NumSamples);
+	TalkerBuffer.SetNumUninitialized(NumSamples, false);
+	OutputBuffer.SetNumUninitialized(NumSamples, false);
+}
+
+int32 FVoiceChatMixBuffer::Add(TVoiceChatRingBuffer<uint8>& Queue, float Gain)
+{
+	const uint32 FrameSize = NumChannels * sizeof(int16);
+	const int32 TalkerFrames = Queue.Pop((uint8*)TalkerBuffer.GetData(), NumFrames * FrameSize) / FrameSize;
+	if (TalkerFrames > 0)
+	{
+		VoiceChatDSP::MixInt16(TalkerBuffer.GetData(), Gain, Accumulator.GetData(), TalkerFrames * NumChannels);
+		INC_DWORD_STAT(STAT_VoiceChat_MixedTalkers);
+	}
+	return TalkerFrames;
+}
+
+const uint8* FVoiceChatMixBuffer::Finish()
+{
+	VoiceChatDSP::FloatToInt16(Accumulator.GetData(), OutputBuffer.GetData(), NumFrames * NumChannels);
+	return (const uint8*)OutputBuffer.GetData();
+}
+
+void FVoiceChatMixBuffer::Empty()
+{
+	Accumulator.Empty();
+	TalkerBuffer.Empty();
+	OutputBuffer.Empty();
+	NumFrames = 0;
+}
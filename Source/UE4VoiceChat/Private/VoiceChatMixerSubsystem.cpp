@@ -0,0 +1,324 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatMixerSubsystem.h"
+#include "VoiceChatComponent.h"
+#include "VoiceChatDeviceCache.h"
+#include "VoiceChatStats.h"
+#include "Engine/World.h"
+
+UVoiceChatMixerSubsystem::UVoiceChatMixerSubsystem() :
+	MixAheadMs(60.0f),
+	VoiceProfile(EVoiceChatProfile::Stereo48k),
+	TalkerTimeoutSeconds(10.0f),
+	JitterBufferMinDelayMs(40.0f),
+	JitterBufferMaxDelayMs(80.0f),
+	MaxPlayoutLatencyMs(200.0f),
+	SampleRate(VOICE_DEVICE_SAMPLE_RATE),
+	NumChannels(VOICE_DEVICE_NUM_CHANNELS)
+{
+}
+
+void UVoiceChatMixerSubsystem::Deinitialize()
+{
+	ShutdownMixer();
+
+	Super::Deinitialize();
+}
+
+TStatId UVoiceChatMixerSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UVoiceChatMixerSubsystem, STATGROUP_VoiceChat);
+}
+
+void UVoiceChatMixerSubsystem::InitMixer(int32 NumBuses)
+{
+	UWorld* World = GetWorld();
+	if (!World || IsRunningDedicatedServer())
+	{
+		return;
+	}
+
+	for (UVoiceChatComponent* Bus : Buses)
+	{
+		if (Bus)
+		{
+			Bus->Shutdown();
+			Bus->DestroyComponent();
+		}
+	}
+	Buses.Reset();
+
+	NumBuses = FMath::Max(NumBuses, 1);
+	for (int32 BusIndex = 0; BusIndex < NumBuses; ++BusIndex)
+	{
+		UVoiceChatComponent* Bus = NewObject<UVoiceChatComponent>(this);
+		Bus->InitAsMixBus();
+		Bus->RegisterComponentWithWorld(World);
+		Buses.Add(Bus);
+	}
+
+	for (TPair<int32, TUniquePtr<FTalker>>& Pair : Talkers)
+	{
+		Pair.Value->BusIndex = FMath::Min(Pair.Value->BusIndex, NumBuses - 1);
+	}
+	for (int32 BusIndex = 0; BusIndex < NumBuses; ++BusIndex)
+	{
+		UpdateBusSpatialization(BusIndex);
+	}
+
+	UE_LOG(LogVoice, Log, TEXT("Voice chat mixer initialized with %d buses"), NumBuses);
+}
+
+void UVoiceChatMixerSubsystem::ShutdownMixer()
+{
+	for (TPair<int32, TUniquePtr<FTalker>>& Pair : Talkers)
+	{
+		ReleaseTalker(*Pair.Value);
+	}
+	Talkers.Empty();
+
+	for (UVoiceChatComponent* Bus : Buses)
+	{
+		if (Bus)
+		{
+			Bus->Shutdown();
+			Bus->DestroyComponent();
+		}
+	}
+	Buses.Empty();
+
+	Mix.Empty();
+}
+
+void UVoiceChatMixerSubsystem::PlayTalkerAudio(int32 TalkerId, const TArray<uint8>& VoiceData)
+{
+	PlayTalkerPacket(TalkerId, VoiceData);
+}
+
+void UVoiceChatMixerSubsystem::PlayTalkerPacket(int32 TalkerId, TArrayView<const uint8> Packet)
+{
+	if (FTalker* Talker = FindOrAddTalker(TalkerId))
+	{
+		Talker->LastPacketTime = FPlatformTime::Seconds();
+		Talker->Stream.InsertPacket(Packet, Talker->LastPacketTime);
+	}
+}
+
+void UVoiceChatMixerSubsystem::SetTalkerGain(int32 TalkerId, float Gain)
+{
+	if (FTalker* Talker = FindOrAddTalker(TalkerId))
+	{
+		Talker->Gain = FMath::Max(Gain, 0.0f);
+	}
+}
+
+void UVoiceChatMixerSubsystem::SetTalkerBus(int32 TalkerId, int32 BusIndex)
+{
+	if (FTalker* Talker = FindOrAddTalker(TalkerId))
+	{
+		const int32 OldBusIndex = Talker->BusIndex;
+		Talker->BusIndex = FMath::Clamp(BusIndex, 0, FMath::Max(Buses.Num() - 1, 0));
+		if (Talker->BusIndex != OldBusIndex)
+		{
+			UpdateBusSpatialization(OldBusIndex);
+			UpdateBusSpatialization(Talker->BusIndex);
+		}
+	}
+}
+
+bool UVoiceChatMixerSubsystem::SetTalkerLocation(int32 TalkerId, FVector Location)
+{
+	const TUniquePtr<FTalker>* Talker = Talkers.Find(TalkerId);
+	if (!Talker || !Buses.IsValidIndex((*Talker)->BusIndex))
+	{
+		return false;
+	}
+
+	(*Talker)->Location = Location;
+	(*Talker)->bHasLocation = true;
+	UpdateBusSpatialization((*Talker)->BusIndex);
+	return Buses[(*Talker)->BusIndex]->bAllowSpatialization;
+}
+
+void UVoiceChatMixerSubsystem::RemoveTalker(int32 TalkerId)
+{
+	TUniquePtr<FTalker> Talker;
+	if (Talkers.RemoveAndCopyValue(TalkerId, Talker))
+	{
+		ReleaseTalker(*Talker);
+		UpdateBusTalkSpurt(Talker->BusIndex);
+		UpdateBusSpatialization(Talker->BusIndex);
+	}
+}
+
+UVoiceChatComponent* UVoiceChatMixerSubsystem::GetBus(int32 BusIndex) const
+{
+	return Buses.IsValidIndex(BusIndex) ? Buses[BusIndex] : nullptr;
+}
+
+void UVoiceChatMixerSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoiceChat_Mix);
+
+	const double Now = FPlatformTime::Seconds();
+	bool bTalkerTimedOut = false;
+	for (auto It = Talkers.CreateIterator(); It; ++It)
+	{
+		FTalker& Talker = *It.Value();
+		if (Now - Talker.LastPacketTime > TalkerTimeoutSeconds)
+		{
+			UE_LOG(LogVoice, Log, TEXT("Voice chat talker %d timed out"), It.Key());
+			ReleaseTalker(Talker);
+			It.RemoveCurrent();
+			bTalkerTimedOut = true;
+			continue;
+		}
+
+		// Audio of this talker already mixed into its bus is still ahead of playback
+		const float BusQueuedMs = Buses.IsValidIndex(Talker.BusIndex) ? Buses[Talker.BusIndex]->GetQueuedPlaybackMs() : 0.0f;
+		Talker.Stream.Service(Talker.Queue, BytesToMs(Talker.Queue.Num()) + BusQueuedMs);
+	}
+
+	for (int32 BusIndex = 0; BusIndex < Buses.Num(); ++BusIndex)
+	{
+		UpdateBusTalkSpurt(BusIndex);
+		if (bTalkerTimedOut)
+		{
+			UpdateBusSpatialization(BusIndex);
+		}
+
+		const float QueuedMs = Buses[BusIndex]->GetQueuedPlaybackMs();
+		if (QueuedMs < MixAheadMs)
+		{
+			MixBus(BusIndex, FMath::CeilToInt((MixAheadMs - QueuedMs) * SampleRate / 1000.0f));
+		}
+	}
+}
+
+UVoiceChatMixerSubsystem::FTalker* UVoiceChatMixerSubsystem::FindOrAddTalker(int32 TalkerId)
+{
+	if (TUniquePtr<FTalker>* Existing = Talkers.Find(TalkerId))
+	{
+		return Existing->Get();
+	}
+
+	if (Buses.Num() == 0)
+	{
+		UE_LOG(LogVoice, Warning, TEXT("Voice chat mixer received talker %d before InitMixer"), TalkerId);
+		return nullptr;
+	}
+
+	const FVoiceChatCodecFormat Format = FVoiceChatCodecFormat::FromProfile(VoiceProfile);
+	TSharedPtr<IVoiceDecoder> Decoder = FVoiceChatDeviceCache::Get().AcquireDecoder(Format.SampleRate, Format.NumChannels);
+	if (!Decoder.IsValid())
+	{
+		UE_LOG(LogVoice, Warning, TEXT("Voice chat mixer failed to create a decoder for talker %d"), TalkerId);
+		return nullptr;
+	}
+
+	TUniquePtr<FTalker> Talker = MakeUnique<FTalker>();
+	Talker->Format = Format;
+	Talker->Stream.Init(Decoder, Format.SampleRate, Format.NumChannels, SampleRate, NumChannels, JitterBufferMinDelayMs, JitterBufferMaxDelayMs, MaxPlayoutLatencyMs);
+	// Approx 1 sec worth of data, the jitter buffer keeps the talker queue well below that
+	const uint32 BytesPerSecond = NumChannels * SampleRate * sizeof(int16);
+	Talker->Queue.Acquire(BytesPerSecond, BytesPerSecond * VOICE_MIN_QUEUE_MS / 1000);
+	Talker->LastPacketTime = FPlatformTime::Seconds();
+
+	FTalker* Result = Talker.Get();
+	Talkers.Add(TalkerId, MoveTemp(Talker));
+	UpdateBusSpatialization(Result->BusIndex);
+	return Result;
+}
+
+void UVoiceChatMixerSubsystem::ReleaseTalker(FTalker& Talker)
+{
+	TSharedPtr<IVoiceDecoder> Decoder = Talker.Stream.GetDecoder();
+	Talker.Stream.Shutdown();
+	if (Decoder.IsValid())
+	{
+		FVoiceChatDeviceCache::Get().ReleaseDecoder(Decoder, Talker.Format.SampleRate, Talker.Format.NumChannels);
+	}
+}
+
+void UVoiceChatMixerSubsystem::UpdateBusSpatialization(int32 BusIndex)
+{
+	if (!Buses.IsValidIndex(BusIndex))
+	{
+		return;
+	}
+
+	// A bus is a single sound source, it can only stand for one talker's position
+	const FTalker* OnlyTalker = nullptr;
+	int32 Count = 0;
+	for (const TPair<int32, TUniquePtr<FTalker>>& Pair : Talkers)
+	{
+		if (Pair.Value->BusIndex == BusIndex)
+		{
+			OnlyTalker = Pair.Value.Get();
+			++Count;
+		}
+	}
+
+	UVoiceChatComponent* Bus = Buses[BusIndex];
+	if (Count == 1 && OnlyTalker->bHasLocation)
+	{
+		Bus->bAllowSpatialization = true;
+		Bus->SetWorldLocation(OnlyTalker->Location);
+	}
+	else
+	{
+		Bus->bAllowSpatialization = false;
+	}
+}
+
+int32 UVoiceChatMixerSubsystem::MixBus(int32 BusIndex, int32 NumFrames)
+{
+	// Only mix as far as the talker with the most audio can go, a bus with nobody talking stays idle
+	int32 AvailableFrames = 0;
+	for (const TPair<int32, TUniquePtr<FTalker>>& Pair : Talkers)
+	{
+		if (Pair.Value->BusIndex == BusIndex)
+		{
+			AvailableFrames = FMath::Max(AvailableFrames, FVoiceChatMixBuffer::GetQueuedFrames(Pair.Value->Queue, NumChannels));
+		}
+	}
+	NumFrames = FMath::Min(NumFrames, AvailableFrames);
+	if (NumFrames <= 0)
+	{
+		return 0;
+	}
+
+	// Talkers running short of audio are padded with silence, the jitter buffer rebuffers them
+	Mix.Begin(NumFrames, NumChannels);
+	for (const TPair<int32, TUniquePtr<FTalker>>& Pair : Talkers)
+	{
+		if (Pair.Value->BusIndex == BusIndex)
+		{
+			Mix.Add(Pair.Value->Queue, Pair.Value->Gain);
+		}
+	}
+
+	Buses[BusIndex]->EnqueueUncompressedData(Mix.Finish(), Mix.GetNumBytes());
+	return NumFrames;
+}
+
+void UVoiceChatMixerSubsystem::UpdateBusTalkSpurt(int32 BusIndex)
+{
+	if (!Buses.IsValidIndex(BusIndex))
+	{
+		return;
+	}
+
+	bool bTalking = false;
+	for (const TPair<int32, TUniquePtr<FTalker>>& Pair : Talkers)
+	{
+		bTalking |= Pair.Value->BusIndex == BusIndex && !Pair.Value->Stream.IsSilent();
+	}
+	Buses[BusIndex]->SetMidTalkSpurt(bTalking);
+}
+
+float UVoiceChatMixerSubsystem::BytesToMs(int32 NumBytes) const
+{
+	return NumBytes * 1000.0f / (SampleRate * NumChannels * sizeof(int16));
+}
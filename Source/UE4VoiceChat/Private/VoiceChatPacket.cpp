@@ -0,0 +1,51 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatPacket.h"
+#include "VoiceModule.h"
+#include "VoiceChatStats.h"
+
+FVoiceChatPacketPool::FVoiceChatPacketPool(int32 InMaxPooledPackets) :
+	NextIndex(0),
+	MaxPooledPackets(FMath::Max(InMaxPooledPackets, 1))
+{
+}
+
+FVoiceChatPacketRef FVoiceChatPacketPool::Acquire(int32 Size)
+{
+	for (int32 Offset = 0; Offset < Packets.Num(); ++Offset)
+	{
+		const int32 Index = (NextIndex + Offset) % Packets.Num();
+		if (Packets[Index].IsUnique())
+		{
+			NextIndex = (Index + 1) % Packets.Num();
+
+			FVoiceChatPacketRef Packet = Packets[Index];
+			if (Size > Packet->Data.Max())
+			{
+				VoiceChatStats::CountPoolAllocation();
+			}
+			Packet->Data.SetNumUninitialized(Size, false);
+			return Packet;
+		}
+	}
+
+	FVoiceChatPacketRef Packet = MakeShared<FVoiceChatPacket, ESPMode::ThreadSafe>();
+	Packet->Data.SetNumUninitialized(Size, false);
+	VoiceChatStats::CountPoolAllocation();
+	if (Packets.Num() < MaxPooledPackets)
+	{
+		Packets.Add(Packet);
+	}
+	else
+	{
+		UE_LOG(LogVoice, Verbose, TEXT("Voice packet pool exhausted, listeners are holding on to %d packets"), Packets.Num());
+	}
+	return Packet;
+}
+
+void FVoiceChatPacketPool::Empty()
+{
+	Packets.Empty();
+	NextIndex = 0;
+}
@@ -0,0 +1,278 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatProcessor.h"
+#include "VoiceChatDSP.h"
+#include "VoiceChatStats.h"
+
+/** Sub-block over which the level driven stages measure and change their gain */
+#define VOICE_PROCESSOR_BLOCK_MS 10
+/** Level reported for digital silence */
+#define VOICE_PROCESSOR_FLOOR_DB -96.0f
+/** How fast the automatic gain may fall and rise, in dB per second */
+#define VOICE_AGC_ATTACK_DB_PER_SECOND 30.0f
+#define VOICE_AGC_RELEASE_DB_PER_SECOND 6.0f
+/** Most the automatic gain may attenuate a loud talker */
+#define VOICE_AGC_MIN_GAIN_DB -12.0f
+
+FVoiceChatProcessorChain::FVoiceChatProcessorChain() :
+	SampleRate(0),
+	NumChannels(0)
+{
+}
+
+void FVoiceChatProcessorChain::Add(const TSharedRef<IVoiceChatProcessor>& Processor)
+{
+	if (SampleRate > 0)
+	{
+		Processor->Configure(SampleRate, NumChannels);
+	}
+	Stages.Add({ Processor, 0, 0, 0 });
+}
+
+void FVoiceChatProcessorChain::Remove(const TSharedRef<IVoiceChatProcessor>& Processor)
+{
+	Stages.RemoveAll([&Processor](const FStage& Stage) { return Stage.Processor == Processor; });
+}
+
+void FVoiceChatProcessorChain::Empty()
+{
+	Stages.Empty();
+}
+
+void FVoiceChatProcessorChain::Configure(int32 InSampleRate, int32 InNumChannels)
+{
+	SampleRate = FMath::Max(InSampleRate, 1);
+	NumChannels = FMath::Max(InNumChannels, 1);
+	for (FStage& Stage : Stages)
+	{
+		Stage.Processor->Configure(SampleRate, NumChannels);
+	}
+	ResetStats();
+}
+
+void FVoiceChatProcessorChain::Process(int16* Samples, int32 NumFrames)
+{
+	if (NumFrames <= 0 || SampleRate <= 0)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_VoiceChat_Processing);
+	for (FStage& Stage : Stages)
+	{
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		Stage.Processor->Process(Samples, NumFrames);
+		Stage.Cycles += FPlatformTime::Cycles64() - StartCycles;
+		++Stage.NumBlocks;
+		Stage.NumFrames += NumFrames;
+	}
+}
+
+TArray<FVoiceChatProcessorStats> FVoiceChatProcessorChain::GetStats() const
+{
+	TArray<FVoiceChatProcessorStats> Stats;
+	Stats.Reserve(Stages.Num());
+	for (const FStage& Stage : Stages)
+	{
+		FVoiceChatProcessorStats& StageStats = Stats.AddDefaulted_GetRef();
+		StageStats.Name = Stage.Processor->GetName();
+		StageStats.Milliseconds = FPlatformTime::ToMilliseconds64(Stage.Cycles);
+		StageStats.NumBlocks = Stage.NumBlocks;
+		StageStats.AudioMilliseconds = SampleRate > 0 ? Stage.NumFrames * 1000.0 / SampleRate : 0.0;
+	}
+	return Stats;
+}
+
+void FVoiceChatProcessorChain::ResetStats()
+{
+	for (FStage& Stage : Stages)
+	{
+		Stage.Cycles = 0;
+		Stage.NumBlocks = 0;
+		Stage.NumFrames = 0;
+	}
+}
+
+FString FVoiceChatProcessorChain::ToString() const
+{
+	FString Result;
+	for (const FVoiceChatProcessorStats& Stats : GetStats())
+	{
+		// Cost per second of audio, comparable between stages and machines whatever the capture block size
+		const double MsPerSecond = Stats.AudioMilliseconds > 0.0 ? Stats.Milliseconds * 1000.0 / Stats.AudioMilliseconds : 0.0;
+		Result += FString::Printf(TEXT("%s%s %.3f ms/s over %d blocks"), Result.IsEmpty() ? TEXT("") : TEXT(", "), Stats.Name, MsPerSecond, Stats.NumBlocks);
+	}
+	return Result.IsEmpty() ? TEXT("no processing") : Result;
+}
+
+FVoiceChatHighPassFilter::FVoiceChatHighPassFilter(float InCutoffHz) :
+	CutoffHz(InCutoffHz),
+	NumChannels(1),
+	B0(1.0f), B1(0.0f), B2(0.0f), A1(0.0f), A2(0.0f)
+{
+}
+
+void FVoiceChatHighPassFilter::Configure(int32 SampleRate, int32 InNumChannels)
+{
+	NumChannels = FMath::Max(InNumChannels, 1);
+	State.Reset();
+	State.AddZeroed(NumChannels * 2);
+
+	// Butterworth high-pass from the audio EQ cookbook
+	const float Q = 0.70710678f;
+	const float Omega = 2.0f * PI * FMath::Clamp(CutoffHz, 1.0f, SampleRate * 0.45f) / SampleRate;
+	const float Cos = FMath::Cos(Omega);
+	const float Alpha = FMath::Sin(Omega) / (2.0f * Q);
+	const float A0 = 1.0f + Alpha;
+	B0 = (1.0f + Cos) / 2.0f / A0;
+	B1 = -(1.0f + Cos) / A0;
+	B2 = B0;
+	A1 = -2.0f * Cos / A0;
+	A2 = (1.0f - Alpha) / A0;
+}
+
+void FVoiceChatHighPassFilter::Process(int16* Samples, int32 NumFrames)
+{
+	const int32 NumSamples = NumFrames * NumChannels;
+	if (Scratch.Num() < NumSamples)
+	{
+		Scratch.SetNumUninitialized(NumSamples, false);
+	}
+	VoiceChatDSP::Int16ToFloat(Samples, Scratch.GetData(), NumSamples);
+
+	// Every output depends on the previous one, so the filter itself cannot be vectorized along time
+	for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+	{
+		float S1 = State[Channel * 2];
+		float S2 = State[Channel * 2 + 1];
+		for (int32 Index = Channel; Index < NumSamples; Index += NumChannels)
+		{
+			const float In = Scratch[Index];
+			const float Out = B0 * In + S1;
+			S1 = B1 * In - A1 * Out + S2;
+			S2 = B2 * In - A2 * Out;
+			Scratch[Index] = Out;
+		}
+
+		// The state decays towards denormals during digital silence, which are very slow on x86
+		State[Channel * 2] = FMath::Abs(S1) < 1e-6f ? 0.0f : S1;
+		State[Channel * 2 + 1] = FMath::Abs(S2) < 1e-6f ? 0.0f : S2;
+	}
+
+	VoiceChatDSP::FloatToInt16(Scratch.GetData(), Samples, NumSamples);
+}
+
+void FVoiceChatBlockProcessor::Configure(int32 InSampleRate, int32 InNumChannels)
+{
+	SampleRate = FMath::Max(InSampleRate, 1);
+	NumChannels = FMath::Max(InNumChannels, 1);
+	Gain = 1.0f;
+}
+
+void FVoiceChatBlockProcessor::Process(int16* Samples, int32 NumFrames)
+{
+	const int32 BlockFrames = FMath::Max(SampleRate * VOICE_PROCESSOR_BLOCK_MS / 1000, 1);
+	for (int32 Frame = 0; Frame < NumFrames; Frame += BlockFrames)
+	{
+		int16* Block = Samples + Frame * NumChannels;
+		const int32 NumSamples = FMath::Min(BlockFrames, NumFrames - Frame) * NumChannels;
+
+		// ComputeGain may also move the starting gain, e.g. for the limiter's instant attack
+		const float EndGain = ComputeGain(Block, NumSamples);
+		if (Gain != 1.0f || EndGain != 1.0f)
+		{
+			VoiceChatDSP::ApplyGainRamp(Block, NumSamples, Gain, EndGain);
+		}
+		Gain = EndGain;
+	}
+}
+
+float FVoiceChatBlockProcessor::ComputeLevelDb(const int16* Samples, int32 NumSamples)
+{
+	uint64 Energy;
+	int32 ZeroCrossings;
+	VoiceChatDSP::ComputeEnergyAndZeroCrossings(Samples, NumSamples, 1, Energy, ZeroCrossings);
+
+	const float MeanSquare = (float)((double)Energy / FMath::Max(NumSamples, 1) / (32768.0 * 32768.0));
+	return MeanSquare > 0.0f ? FMath::Max(VOICE_PROCESSOR_FLOOR_DB, 10.0f * FMath::LogX(10.0f, MeanSquare)) : VOICE_PROCESSOR_FLOOR_DB;
+}
+
+FVoiceChatAutomaticGain::FVoiceChatAutomaticGain(float InTargetDb, float InMaxGainDb, float InFloorDb) :
+	TargetDb(InTargetDb),
+	MaxGainDb(FMath::Max(InMaxGainDb, 0.0f)),
+	FloorDb(InFloorDb)
+{
+}
+
+void FVoiceChatAutomaticGain::Configure(int32 InSampleRate, int32 InNumChannels)
+{
+	FVoiceChatBlockProcessor::Configure(InSampleRate, InNumChannels);
+	GainDb = 0.0f;
+}
+
+float FVoiceChatAutomaticGain::ComputeGain(const int16* Samples, int32 NumSamples)
+{
+	const float LevelDb = ComputeLevelDb(Samples, NumSamples);
+	if (LevelDb >= FloorDb)
+	{
+		// Back off quickly when the talker gets loud, catch up slowly when they get quiet
+		const float DesiredDb = FMath::Clamp(TargetDb - LevelDb, VOICE_AGC_MIN_GAIN_DB, MaxGainDb);
+		const float Seconds = GetDurationMs(NumSamples) / 1000.0f;
+		GainDb = DesiredDb < GainDb
+			? FMath::Max(DesiredDb, GainDb - VOICE_AGC_ATTACK_DB_PER_SECOND * Seconds)
+			: FMath::Min(DesiredDb, GainDb + VOICE_AGC_RELEASE_DB_PER_SECOND * Seconds);
+	}
+	return FMath::Pow(10.0f, GainDb / 20.0f);
+}
+
+FVoiceChatNoiseGate::FVoiceChatNoiseGate(float InThresholdDb, float InHoldMs, float InReleaseMs, float InAttenuationDb) :
+	ThresholdDb(InThresholdDb),
+	HoldMs(FMath::Max(InHoldMs, 0.0f)),
+	ReleaseMs(FMath::Max(InReleaseMs, 1.0f)),
+	ClosedGain(FMath::Pow(10.0f, FMath::Min(InAttenuationDb, 0.0f) / 20.0f))
+{
+}
+
+void FVoiceChatNoiseGate::Configure(int32 InSampleRate, int32 InNumChannels)
+{
+	FVoiceChatBlockProcessor::Configure(InSampleRate, InNumChannels);
+	Gain = ClosedGain;
+	HoldRemainingMs = 0.0f;
+}
+
+float FVoiceChatNoiseGate::ComputeGain(const int16* Samples, int32 NumSamples)
+{
+	const float DurationMs = GetDurationMs(NumSamples);
+	if (ComputeLevelDb(Samples, NumSamples) >= ThresholdDb)
+	{
+		// Open over a single sub-block so word onsets get through
+		HoldRemainingMs = FMath::Max(HoldMs, DurationMs);
+		return 1.0f;
+	}
+
+	HoldRemainingMs = FMath::Max(HoldRemainingMs - DurationMs, 0.0f);
+	if (HoldRemainingMs > 0.0f)
+	{
+		return 1.0f;
+	}
+	return FMath::Max(ClosedGain, Gain - (1.0f - ClosedGain) * DurationMs / ReleaseMs);
+}
+
+FVoiceChatLimiter::FVoiceChatLimiter(float InCeilingDb, float InReleaseMs) :
+	Ceiling(32768.0f * FMath::Pow(10.0f, FMath::Min(InCeilingDb, 0.0f) / 20.0f)),
+	ReleaseMs(FMath::Max(InReleaseMs, 1.0f))
+{
+}
+
+float FVoiceChatLimiter::ComputeGain(const int16* Samples, int32 NumSamples)
+{
+	const int32 Peak = VoiceChatDSP::ComputePeak(Samples, NumSamples);
+	const float PeakGain = Peak > Ceiling ? Ceiling / Peak : 1.0f;
+	if (PeakGain < Gain)
+	{
+		Gain = PeakGain;
+		return PeakGain;
+	}
+	return FMath::Min(PeakGain, Gain + (1.0f - Gain) * FMath::Min(GetDurationMs(NumSamples) / ReleaseMs, 1.0f));
+}
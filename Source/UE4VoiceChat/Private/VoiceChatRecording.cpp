@@ -0,0 +1,499 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatRecording.h"
+#include "VoiceChatPacket.h"
+#include "VoiceChatDeviceCache.h"
+#include "VoiceChatFormatConverter.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+#include "Algo/BinarySearch.h"
+#include "Algo/Reverse.h"
+
+/** "VCRC" */
+#define VOICE_RECORDING_MAGIC 0x43524356
+#define VOICE_RECORDING_VERSION 2
+#define VOICE_RECORDING_HEADER_SIZE 12
+#define VOICE_RECORDING_TRAILER_SIZE 12
+/** [Type u8][TimeMs u32][SpeakerId i32][Size u16][NumChannels u8][SampleRate u32] */
+#define VOICE_RECORDING_PACKET_RECORD_SIZE 16
+/** Version 1 packet records end after Size */
+#define VOICE_RECORDING_V1_PACKET_RECORD_SIZE 11
+/** [Type u8][TimeMs u32][PreviousIndexOffset u64] */
+#define VOICE_RECORDING_INDEX_RECORD_SIZE 13
+/** Time between index records, a seek never reads more than this much of the recording in vain */
+#define VOICE_RECORDING_INDEX_INTERVAL_MS 1000
+/** Records gathered before they are handed to a write task */
+#define VOICE_RECORDING_WRITE_SIZE 64 * 1024
+/** A decoded packet is placed right after the speaker's previous one unless they are further apart than this */
+#define VOICE_RECORDING_RESYNC_MS 200
+
+namespace
+{
+	void WriteU16(TArray<uint8>& Out, uint16 Value)
+	{
+		Out.Add((uint8)Value);
+		Out.Add((uint8)(Value >> 8));
+	}
+
+	void WriteU32(TArray<uint8>& Out, uint32 Value)
+	{
+		WriteU16(Out, (uint16)Value);
+		WriteU16(Out, (uint16)(Value >> 16));
+	}
+
+	void WriteU64(TArray<uint8>& Out, uint64 Value)
+	{
+		WriteU32(Out, (uint32)Value);
+		WriteU32(Out, (uint32)(Value >> 32));
+	}
+
+	uint16 ReadU16(const uint8* In)
+	{
+		return (uint16)In[0] | ((uint16)In[1] << 8);
+	}
+
+	uint32 ReadU32(const uint8* In)
+	{
+		return (uint32)ReadU16(In) | ((uint32)ReadU16(In + 2) << 16);
+	}
+
+	uint64 ReadU64(const uint8* In)
+	{
+		return (uint64)ReadU32(In) | ((uint64)ReadU32(In + 4) << 32);
+	}
+}
+
+FVoiceChatRecorder::FVoiceChatRecorder() :
+	FileHandle(nullptr),
+	FileSize(0),
+	LastIndexOffset(0),
+	NextIndexTimeMs(0),
+	StartTime(0.0)
+{
+	bWriteFailed.Store(false);
+}
+
+FVoiceChatRecorder::~FVoiceChatRecorder()
+{
+	Close();
+}
+
+bool FVoiceChatRecorder::Open(const FString& Filename, int32 SampleRate, int32 NumChannels)
+{
+	Close();
+
+	FScopeLock ScopeLock(&Lock);
+	FileHandle = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*Filename);
+	if (!FileHandle)
+	{
+		UE_LOG(LogVoice, Warning, TEXT("Failed to open voice recording %s"), *Filename);
+		return false;
+	}
+
+	Buffer.Reset(VOICE_RECORDING_WRITE_SIZE);
+	WriteU32(Buffer, VOICE_RECORDING_MAGIC);
+	WriteU16(Buffer, VOICE_RECORDING_VERSION);
+	WriteU16(Buffer, (uint16)NumChannels);
+	WriteU32(Buffer, (uint32)SampleRate);
+	FileSize = VOICE_RECORDING_HEADER_SIZE;
+
+	LastIndexOffset = 0;
+	StartTime = FPlatformTime::Seconds();
+	bWriteFailed.Store(false);
+	AppendIndex(0);
+	return true;
+}
+
+void FVoiceChatRecorder::Close()
+{
+	FScopeLock ScopeLock(&Lock);
+	if (!FileHandle)
+	{
+		return;
+	}
+
+	// A last index right before the trailer, the reader finds the whole chain from there
+	AppendIndex((uint32)((FPlatformTime::Seconds() - StartTime) * 1000.0));
+	WriteU64(Buffer, LastIndexOffset);
+	WriteU32(Buffer, VOICE_RECORDING_MAGIC);
+	WriteBuffer();
+
+	FTaskGraphInterface::Get().WaitUntilTaskCompletes(LastWrite);
+	LastWrite = nullptr;
+
+	if (bWriteFailed.Load())
+	{
+		UE_LOG(LogVoice, Warning, TEXT("Voice recording is incomplete, writing to disk failed"));
+	}
+
+	delete FileHandle;
+	FileHandle = nullptr;
+}
+
+bool FVoiceChatRecorder::IsOpen() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return FileHandle != nullptr;
+}
+
+void FVoiceChatRecorder::RecordPacket(int32 SpeakerId, TArrayView<const uint8> Packet, int32 SampleRate, int32 NumChannels)
+{
+	FScopeLock ScopeLock(&Lock);
+	if (!FileHandle || Packet.Num() == 0 || Packet.Num() > MAX_uint16)
+	{
+		return;
+	}
+
+	const uint32 TimeMs = (uint32)((FPlatformTime::Seconds() - StartTime) * 1000.0);
+	if (TimeMs >= NextIndexTimeMs)
+	{
+		AppendIndex(TimeMs);
+	}
+
+	Buffer.Add((uint8)EVoiceChatRecordType::Packet);
+	WriteU32(Buffer, TimeMs);
+	WriteU32(Buffer, (uint32)SpeakerId);
+	WriteU16(Buffer, (uint16)Packet.Num());
+	Buffer.Add((uint8)NumChannels);
+	WriteU32(Buffer, (uint32)SampleRate);
+	Buffer.Append(Packet.GetData(), Packet.Num());
+	FileSize += VOICE_RECORDING_PACKET_RECORD_SIZE + Packet.Num();
+
+	if (Buffer.Num() >= VOICE_RECORDING_WRITE_SIZE)
+	{
+		WriteBuffer();
+	}
+}
+
+void FVoiceChatRecorder::AppendIndex(uint32 TimeMs)
+{
+	Buffer.Add((uint8)EVoiceChatRecordType::Index);
+	WriteU32(Buffer, TimeMs);
+	WriteU64(Buffer, LastIndexOffset);
+
+	LastIndexOffset = FileSize;
+	FileSize += VOICE_RECORDING_INDEX_RECORD_SIZE;
+	NextIndexTimeMs = TimeMs - TimeMs % VOICE_RECORDING_INDEX_INTERVAL_MS + VOICE_RECORDING_INDEX_INTERVAL_MS;
+}
+
+void FVoiceChatRecorder::WriteBuffer()
+{
+	if (Buffer.Num() == 0)
+	{
+		return;
+	}
+
+	FGraphEventArray Prerequisites;
+	if (LastWrite.IsValid())
+	{
+		Prerequisites.Add(LastWrite);
+	}
+
+	IFileHandle* Handle = FileHandle;
+	TAtomic<bool>* bFailed = &bWriteFailed;
+	LastWrite = FFunctionGraphTask::CreateAndDispatchWhenReady([Handle, bFailed, Records = MoveTemp(Buffer)]()
+	{
+		if (!Handle->Write(Records.GetData(), Records.Num()))
+		{
+			bFailed->Store(true);
+		}
+	}, TStatId(), &Prerequisites, ENamedThreads::AnyBackgroundThreadNormalTask);
+
+	Buffer.Reset(VOICE_RECORDING_WRITE_SIZE);
+}
+
+FVoiceChatRecordingReader::FVoiceChatRecordingReader() :
+	Data(nullptr),
+	DataSize(0),
+	RecordsEnd(0),
+	PacketRecordSize(VOICE_RECORDING_PACKET_RECORD_SIZE),
+	SampleRate(0),
+	NumChannels(0),
+	DurationMs(0)
+{
+}
+
+FVoiceChatRecordingReader::~FVoiceChatRecordingReader()
+{
+	Close();
+}
+
+bool FVoiceChatRecordingReader::Open(const FString& Filename)
+{
+	Close();
+
+	MappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Filename));
+	if (MappedFile.IsValid())
+	{
+		MappedRegion.Reset(MappedFile->MapRegion());
+	}
+
+	if (MappedRegion.IsValid())
+	{
+		Data = MappedRegion->GetMappedPtr();
+		DataSize = MappedRegion->GetMappedSize();
+	}
+	else
+	{
+		MappedFile.Reset();
+		if (!FFileHelper::LoadFileToArray(FileData, *Filename))
+		{
+			UE_LOG(LogVoice, Warning, TEXT("Failed to open voice recording %s"), *Filename);
+			return false;
+		}
+		Data = FileData.GetData();
+		DataSize = FileData.Num();
+	}
+
+	const uint16 Version = DataSize >= VOICE_RECORDING_HEADER_SIZE ? ReadU16(Data + 4) : 0;
+	if (DataSize < VOICE_RECORDING_HEADER_SIZE || ReadU32(Data) != VOICE_RECORDING_MAGIC || Version < 1 || Version > VOICE_RECORDING_VERSION)
+	{
+		UE_LOG(LogVoice, Warning, TEXT("%s is not a voice recording"), *Filename);
+		Close();
+		return false;
+	}
+
+	NumChannels = ReadU16(Data + 6);
+	SampleRate = ReadU32(Data + 8);
+	PacketRecordSize = Version == 1 ? VOICE_RECORDING_V1_PACKET_RECORD_SIZE : VOICE_RECORDING_PACKET_RECORD_SIZE;
+	BuildIndex();
+	return true;
+}
+
+void FVoiceChatRecordingReader::Close()
+{
+	// The region has to go before the file it maps
+	MappedRegion.Reset();
+	MappedFile.Reset();
+	FileData.Empty();
+	Data = nullptr;
+	DataSize = 0;
+	RecordsEnd = 0;
+	DurationMs = 0;
+	Index.Empty();
+}
+
+void FVoiceChatRecordingReader::ForEachPacket(uint32 StartMs, uint32 EndMs, TFunctionRef<void(const FVoiceChatRecordedPacket&)> Visitor) const
+{
+	if (!Data)
+	{
+		return;
+	}
+
+	// Records are in time order, start reading at the last index at or before StartMs
+	const int32 IndexPos = Algo::UpperBoundBy(Index, StartMs, &FIndexEntry::TimeMs) - 1;
+	int64 Offset = IndexPos >= 0 ? Index[IndexPos].Offset : VOICE_RECORDING_HEADER_SIZE;
+
+	while (Offset < RecordsEnd)
+	{
+		const int64 RecordSize = GetRecordSize(Offset);
+		if (RecordSize == 0)
+		{
+			break;
+		}
+
+		const uint32 TimeMs = ReadU32(Data + Offset + 1);
+		if (TimeMs >= EndMs)
+		{
+			break;
+		}
+
+		if (Data[Offset] == (uint8)EVoiceChatRecordType::Packet && TimeMs >= StartMs)
+		{
+			FVoiceChatRecordedPacket Packet;
+			Packet.SpeakerId = (int32)ReadU32(Data + Offset + 5);
+			Packet.TimeMs = TimeMs;
+			const bool bHasFormat = PacketRecordSize > VOICE_RECORDING_V1_PACKET_RECORD_SIZE;
+			Packet.NumChannels = bHasFormat ? Data[Offset + 11] : NumChannels;
+			Packet.SampleRate = bHasFormat ? (int32)ReadU32(Data + Offset + 12) : SampleRate;
+			Packet.Data = TArrayView<const uint8>(Data + Offset + PacketRecordSize, RecordSize - PacketRecordSize);
+			Visitor(Packet);
+		}
+		Offset += RecordSize;
+	}
+}
+
+bool FVoiceChatRecordingReader::DecodeRange(uint32 StartMs, uint32 EndMs, int32 SpeakerId, TArray<int16>& OutSamples)
+{
+	OutSamples.Reset();
+	if (!Data || EndMs <= StartMs)
+	{
+		return true;
+	}
+
+	const int64 NumFrames = (int64)(EndMs - StartMs) * SampleRate / 1000;
+	OutSamples.AddZeroed(NumFrames * NumChannels);
+
+	struct FSpeakerState
+	{
+		TSharedPtr<IVoiceDecoder> Decoder;
+		/** Format of Decoder, the speaker's packets are decoded in it and converted to the recording's format */
+		int32 SampleRate = 0;
+		int32 NumChannels = 0;
+		FVoiceChatFormatConverter Converter;
+		/** Where the speaker's next packet goes when it continues the talk spurt */
+		int64 NextFrame = INDEX_NONE;
+	};
+	TMap<int32, FSpeakerState> Speakers;
+	TArray<uint8> DecodeBuffer;
+	TArray<int16> Converted;
+	bool bSuccess = true;
+
+	FVoiceChatDeviceCache& Cache = FVoiceChatDeviceCache::Get();
+	ForEachPacket(StartMs, EndMs, [&](const FVoiceChatRecordedPacket& Packet)
+	{
+		FVoiceChatPacketHeader Header;
+		if ((SpeakerId != INDEX_NONE && Packet.SpeakerId != SpeakerId) || !Header.Read(Packet.Data.GetData(), Packet.Data.Num()))
+		{
+			return;
+		}
+
+		FSpeakerState& Speaker = Speakers.FindOrAdd(Packet.SpeakerId);
+		if (EnumHasAnyFlags(Header.Flags, EVoiceChatPacketFlags::Silence))
+		{
+			Speaker.NextFrame = INDEX_NONE;
+			return;
+		}
+
+		TArrayView<const uint8> Primary;
+		TArrayView<const uint8> Redundant;
+		if (Packet.NumChannels <= 0 || Packet.SampleRate <= 0 || Packet.Data.Num() < Header.GetSize() ||
+			!Header.SplitPayload(Packet.Data.Slice(Header.GetSize(), Packet.Data.Num() - Header.GetSize()), Primary, Redundant))
+		{
+			return;
+		}
+
+		// The speaker's component may have changed profile, a new format starts a new talk spurt
+		if (!Speaker.Decoder.IsValid() || Speaker.SampleRate != Packet.SampleRate || Speaker.NumChannels != Packet.NumChannels)
+		{
+			Cache.ReleaseDecoder(Speaker.Decoder, Speaker.SampleRate, Speaker.NumChannels);
+			Speaker.Decoder = Cache.AcquireDecoder(Packet.SampleRate, Packet.NumChannels);
+			if (!Speaker.Decoder.IsValid())
+			{
+				bSuccess = false;
+				return;
+			}
+			Speaker.SampleRate = Packet.SampleRate;
+			Speaker.NumChannels = Packet.NumChannels;
+			Speaker.Converter.Init(Packet.SampleRate, Packet.NumChannels, SampleRate, NumChannels);
+			Speaker.NextFrame = INDEX_NONE;
+		}
+
+		DecodeBuffer.SetNumUninitialized(Header.NumSamples * Speaker.NumChannels * sizeof(int16), false);
+		uint32 DecodedSize = DecodeBuffer.Num();
+		Speaker.Decoder->Decode(Primary.GetData(), Primary.Num(), DecodeBuffer.GetData(), DecodedSize);
+
+		const int16* Decoded = (const int16*)DecodeBuffer.GetData();
+		int32 DecodedFrames = DecodedSize / (sizeof(int16) * Speaker.NumChannels);
+		if (!Speaker.Converter.IsPassthrough())
+		{
+			DecodedFrames = Speaker.Converter.Convert(Decoded, DecodedFrames, Converted);
+			Decoded = Converted.GetData();
+		}
+
+		// Packets were stamped when they arrived, with network jitter. Keep a talk spurt contiguous rather than
+		// leaving gaps and overlaps of a few milliseconds, unless it strayed too far from where it was recorded.
+		const int64 RecordedFrame = (int64)(Packet.TimeMs - StartMs) * SampleRate / 1000;
+		const int64 ResyncFrames = (int64)VOICE_RECORDING_RESYNC_MS * SampleRate / 1000;
+		int64 Frame = Speaker.NextFrame;
+		if (Frame == INDEX_NONE || FMath::Abs(Frame - RecordedFrame) > ResyncFrames)
+		{
+			Frame = RecordedFrame;
+		}
+		Speaker.NextFrame = Frame + DecodedFrames;
+
+		// A talk spurt kept contiguous may run past the end of the range
+		if (Frame >= NumFrames)
+		{
+			return;
+		}
+
+		const int64 NumSamples = FMath::Min<int64>(DecodedFrames, NumFrames - Frame) * NumChannels;
+		int16* Out = OutSamples.GetData() + Frame * NumChannels;
+		for (int64 Sample = 0; Sample < NumSamples; ++Sample)
+		{
+			Out[Sample] = (int16)FMath::Clamp((int32)Out[Sample] + Decoded[Sample], -32768, 32767);
+		}
+	});
+
+	for (TPair<int32, FSpeakerState>& Pair : Speakers)
+	{
+		Cache.ReleaseDecoder(Pair.Value.Decoder, Pair.Value.SampleRate, Pair.Value.NumChannels);
+	}
+	return bSuccess;
+}
+
+int64 FVoiceChatRecordingReader::GetRecordSize(int64 Offset) const
+{
+	switch ((EVoiceChatRecordType)Data[Offset])
+	{
+	case EVoiceChatRecordType::Packet:
+		if (Offset + PacketRecordSize <= DataSize)
+		{
+			const int64 RecordSize = PacketRecordSize + ReadU16(Data + Offset + 9);
+			return Offset + RecordSize <= DataSize ? RecordSize : 0;
+		}
+		return 0;
+	case EVoiceChatRecordType::Index:
+		return Offset + VOICE_RECORDING_INDEX_RECORD_SIZE <= DataSize ? VOICE_RECORDING_INDEX_RECORD_SIZE : 0;
+	default:
+		return 0;
+	}
+}
+
+void FVoiceChatRecordingReader::BuildIndex()
+{
+	Index.Reset();
+	DurationMs = 0;
+
+	// A closed recording ends with its last index and the trailer. Follow the chain back from there without touching
+	// the pages holding the packets.
+	if (DataSize >= VOICE_RECORDING_HEADER_SIZE + VOICE_RECORDING_INDEX_RECORD_SIZE + VOICE_RECORDING_TRAILER_SIZE &&
+		ReadU32(Data + DataSize - 4) == VOICE_RECORDING_MAGIC)
+	{
+		int64 Offset = (int64)ReadU64(Data + DataSize - VOICE_RECORDING_TRAILER_SIZE);
+		if (Offset + VOICE_RECORDING_INDEX_RECORD_SIZE + VOICE_RECORDING_TRAILER_SIZE == DataSize &&
+			Data[Offset] == (uint8)EVoiceChatRecordType::Index)
+		{
+			RecordsEnd = Offset + VOICE_RECORDING_INDEX_RECORD_SIZE;
+			DurationMs = ReadU32(Data + Offset + 1);
+			while (Offset >= VOICE_RECORDING_HEADER_SIZE && Data[Offset] == (uint8)EVoiceChatRecordType::Index)
+			{
+				Index.Add({ ReadU32(Data + Offset + 1), Offset });
+
+				// The first index points at 0, inside the header
+				const int64 Previous = (int64)ReadU64(Data + Offset + 5);
+				if (Previous >= Offset)
+				{
+					break;
+				}
+				Offset = Previous;
+			}
+			Algo::Reverse(Index);
+			return;
+		}
+	}
+
+	// Still being recorded or cut short, scan up to the last complete record
+	int64 Offset = VOICE_RECORDING_HEADER_SIZE;
+	while (Offset < DataSize)
+	{
+		const int64 RecordSize = GetRecordSize(Offset);
+		if (RecordSize == 0)
+		{
+			break;
+		}
+
+		const uint32 TimeMs = ReadU32(Data + Offset + 1);
+		if (Data[Offset] == (uint8)EVoiceChatRecordType::Index)
+		{
+			Index.Add({ TimeMs, Offset });
+		}
+		DurationMs = FMath::Max(DurationMs, TimeMs);
+		Offset += RecordSize;
+	}
+	RecordsEnd = Offset;
+}
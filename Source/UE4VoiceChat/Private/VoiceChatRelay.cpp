@@ -0,0 +1,205 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatRelay.h"
+#include "VoiceChatStats.h"
+
+/** Relayed packets are usually released once the receivers' RPCs are serialized, within the frame */
+#define VOICE_RELAY_POOLED_PACKETS 256
+/** Participants that relayed nothing for this long no longer count as talkers for the bandwidth budget */
+#define VOICE_RELAY_TALKER_TIMEOUT_SECONDS 1.0
+
+FVoiceChatRelay::FVoiceChatRelay() :
+	RelevancyDistanceSquared(0.0f),
+	BandwidthBudget(0),
+	PacketPool(VOICE_RELAY_POOLED_PACKETS)
+{
+	for (float& Distance : ChannelDistanceSquared)
+	{
+		Distance = -1.0f;
+	}
+}
+
+void FVoiceChatRelay::AddParticipant(int32 ParticipantId, const FOnVoiceChatRelayPacket& Sink)
+{
+	if (const int32* Index = ParticipantIndices.Find(ParticipantId))
+	{
+		Participants[*Index].Sink = Sink;
+		return;
+	}
+
+	ParticipantIndices.Add(ParticipantId, Participants.Num());
+	Participants.Add({ ParticipantId, FVector::ZeroVector, Sink, VOICE_ALL_CHANNELS, VOICE_ALL_CHANNELS, 0.0, 0 });
+}
+
+void FVoiceChatRelay::RemoveParticipant(int32 ParticipantId)
+{
+	int32 Index;
+	if (!ParticipantIndices.RemoveAndCopyValue(ParticipantId, Index))
+	{
+		return;
+	}
+
+	Participants.RemoveAtSwap(Index, 1, false);
+	if (Participants.IsValidIndex(Index))
+	{
+		ParticipantIndices[Participants[Index].Id] = Index;
+	}
+}
+
+void FVoiceChatRelay::SetParticipantLocation(int32 ParticipantId, const FVector& Location)
+{
+	if (const int32* Index = ParticipantIndices.Find(ParticipantId))
+	{
+		Participants[*Index].Location = Location;
+	}
+}
+
+void FVoiceChatRelay::SetParticipantChannels(int32 ParticipantId, FVoiceChatChannelMask Channels)
+{
+	if (const int32* Index = ParticipantIndices.Find(ParticipantId))
+	{
+		Participants[*Index].Channels = Channels;
+	}
+}
+
+FVoiceChatChannelMask FVoiceChatRelay::GetParticipantChannels(int32 ParticipantId) const
+{
+	const int32* Index = ParticipantIndices.Find(ParticipantId);
+	return Index ? Participants[*Index].Channels : 0;
+}
+
+void FVoiceChatRelay::SetParticipantSendChannels(int32 ParticipantId, FVoiceChatChannelMask Channels)
+{
+	if (const int32* Index = ParticipantIndices.Find(ParticipantId))
+	{
+		Participants[*Index].SendChannels = Channels;
+	}
+}
+
+FVoiceChatChannelMask FVoiceChatRelay::GetParticipantSendChannels(int32 ParticipantId) const
+{
+	const int32* Index = ParticipantIndices.Find(ParticipantId);
+	return Index ? Participants[*Index].SendChannels : 0;
+}
+
+void FVoiceChatRelay::SetRelevancyDistance(float Distance)
+{
+	RelevancyDistanceSquared = Distance > 0.0f ? Distance * Distance : 0.0f;
+}
+
+void FVoiceChatRelay::SetChannelRelevancyDistance(uint8 Channel, float Distance)
+{
+	if (Channel < VOICE_MAX_CHANNELS)
+	{
+		ChannelDistanceSquared[Channel] = Distance >= 0.0f ? Distance * Distance : -1.0f;
+	}
+}
+
+void FVoiceChatRelay::SetRelevancyFilter(TFunction<bool(int32 SenderId, int32 ReceiverId)> InFilter)
+{
+	Filter = MoveTemp(InFilter);
+}
+
+FVoiceChatPacketRef FVoiceChatRelay::AcquirePacket(TArrayView<const uint8> Data)
+{
+	FVoiceChatPacketRef Packet = PacketPool.Acquire(Data.Num());
+	FMemory::Memcpy(Packet->Data.GetData(), Data.GetData(), Data.Num());
+	return Packet;
+}
+
+int32 FVoiceChatRelay::Relay(int32 SenderId, const FVoiceChatPacketRef& Packet)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoiceChat_Relay);
+
+	const int32* SenderIndex = ParticipantIndices.Find(SenderId);
+	if (!SenderIndex)
+	{
+		return 0;
+	}
+
+	// The channel is whatever the client put in the packet, only relay it on channels the server allows the sender
+	uint8 Channel;
+	if (!FVoiceChatPacketHeader::ReadChannel(Packet->Data.GetData(), Packet->Data.Num(), Channel))
+	{
+		return 0;
+	}
+	const FVoiceChatChannelMask ChannelBit = VoiceChatChannelBit(Channel);
+	if (!(Participants[*SenderIndex].SendChannels & ChannelBit))
+	{
+		INC_DWORD_STAT(STAT_VoiceChat_RejectedPackets);
+		return 0;
+	}
+	const float DistanceSquared = ChannelDistanceSquared[Channel] >= 0.0f ? ChannelDistanceSquared[Channel] : RelevancyDistanceSquared;
+
+	// Sinks may add or remove participants, so they only run once the participants are no longer iterated. The receivers
+	// are appended behind those of any Relay further up the stack, a sink relaying a packet itself leaves them untouched.
+	const int32 FirstReceiver = PendingReceivers.Num();
+	const FVector SenderLocation = Participants[*SenderIndex].Location;
+	for (const FParticipant& Receiver : Participants)
+	{
+		if (Receiver.Id == SenderId || !(Receiver.Channels & ChannelBit))
+		{
+			continue;
+		}
+		if (DistanceSquared > 0.0f && FVector::DistSquared(SenderLocation, Receiver.Location) > DistanceSquared)
+		{
+			continue;
+		}
+		if (Filter && !Filter(SenderId, Receiver.Id))
+		{
+			continue;
+		}
+
+		PendingReceivers.Add(Receiver.Id);
+	}
+
+	const int32 NumReceivers = PendingReceivers.Num() - FirstReceiver;
+	for (int32 Pending = FirstReceiver; Pending < FirstReceiver + NumReceivers; ++Pending)
+	{
+		// Looked up again, an earlier sink may have removed this receiver or moved it in the array
+		if (const int32* Index = ParticipantIndices.Find(PendingReceivers[Pending]))
+		{
+			Participants[*Index].Sink.ExecuteIfBound(SenderId, Packet);
+		}
+	}
+	PendingReceivers.SetNum(FirstReceiver, false);
+
+	// Find the sender again, the sinks may have moved it
+	if (const int32* Index = ParticipantIndices.Find(SenderId))
+	{
+		Participants[*Index].LastRelayTime = FPlatformTime::Seconds();
+		Participants[*Index].LastNumReceivers = NumReceivers;
+	}
+
+	INC_DWORD_STAT_BY(STAT_VoiceChat_RelayedPackets, NumReceivers);
+	return NumReceivers;
+}
+
+int32 FVoiceChatRelay::GetTalkerBitrateBudget() const
+{
+	if (BandwidthBudget <= 0)
+	{
+		return 0;
+	}
+
+	// Every talker's stream goes out once per receiver, the budget is split over all those copies
+	const double Now = FPlatformTime::Seconds();
+	int32 NumStreamsSent = 0;
+	for (const FParticipant& Participant : Participants)
+	{
+		if (Now - Participant.LastRelayTime <= VOICE_RELAY_TALKER_TIMEOUT_SECONDS)
+		{
+			NumStreamsSent += Participant.LastNumReceivers;
+		}
+	}
+	return NumStreamsSent > 0 ? BandwidthBudget / NumStreamsSent : BandwidthBudget;
+}
+
+void FVoiceChatRelay::Empty()
+{
+	Participants.Empty();
+	ParticipantIndices.Empty();
+	Filter = nullptr;
+	PacketPool.Empty();
+}
@@ -0,0 +1,101 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatRelaySubsystem.h"
+
+void UVoiceChatRelaySubsystem::Deinitialize()
+{
+	Relay.Empty();
+
+	Super::Deinitialize();
+}
+
+void UVoiceChatRelaySubsystem::AddParticipant(int32 ParticipantId)
+{
+	Relay.AddParticipant(ParticipantId, FOnVoiceChatRelayPacket::CreateUObject(this, &UVoiceChatRelaySubsystem::BroadcastRelayed, ParticipantId));
+}
+
+void UVoiceChatRelaySubsystem::RemoveParticipant(int32 ParticipantId)
+{
+	Relay.RemoveParticipant(ParticipantId);
+}
+
+void UVoiceChatRelaySubsystem::SetParticipantLocation(int32 ParticipantId, FVector Location)
+{
+	Relay.SetParticipantLocation(ParticipantId, Location);
+}
+
+void UVoiceChatRelaySubsystem::SetRelevancyDistance(float Distance)
+{
+	Relay.SetRelevancyDistance(Distance);
+}
+
+void UVoiceChatRelaySubsystem::SetBandwidthBudget(int32 BitsPerSecond)
+{
+	Relay.SetBandwidthBudget(BitsPerSecond);
+}
+
+int32 UVoiceChatRelaySubsystem::GetTalkerBitrateBudget() const
+{
+	return Relay.GetTalkerBitrateBudget();
+}
+
+void UVoiceChatRelaySubsystem::SubscribeParticipant(int32 ParticipantId, int32 Channel)
+{
+	if (Channel >= 0 && Channel < VOICE_MAX_CHANNELS)
+	{
+		Relay.SetParticipantChannels(ParticipantId, Relay.GetParticipantChannels(ParticipantId) | VoiceChatChannelBit((uint8)Channel));
+	}
+}
+
+void UVoiceChatRelaySubsystem::UnsubscribeParticipant(int32 ParticipantId, int32 Channel)
+{
+	if (Channel >= 0 && Channel < VOICE_MAX_CHANNELS)
+	{
+		Relay.SetParticipantChannels(ParticipantId, Relay.GetParticipantChannels(ParticipantId) & ~VoiceChatChannelBit((uint8)Channel));
+	}
+}
+
+void UVoiceChatRelaySubsystem::AllowParticipantToSend(int32 ParticipantId, int32 Channel)
+{
+	if (Channel >= 0 && Channel < VOICE_MAX_CHANNELS)
+	{
+		Relay.SetParticipantSendChannels(ParticipantId, Relay.GetParticipantSendChannels(ParticipantId) | VoiceChatChannelBit((uint8)Channel));
+	}
+}
+
+void UVoiceChatRelaySubsystem::DisallowParticipantToSend(int32 ParticipantId, int32 Channel)
+{
+	if (Channel >= 0 && Channel < VOICE_MAX_CHANNELS)
+	{
+		Relay.SetParticipantSendChannels(ParticipantId, Relay.GetParticipantSendChannels(ParticipantId) & ~VoiceChatChannelBit((uint8)Channel));
+	}
+}
+
+void UVoiceChatRelaySubsystem::SetChannelRelevancyDistance(int32 Channel, float Distance)
+{
+	if (Channel >= 0 && Channel < VOICE_MAX_CHANNELS)
+	{
+		Relay.SetChannelRelevancyDistance((uint8)Channel, Distance);
+	}
+}
+
+int32 UVoiceChatRelaySubsystem::RelayVoiceAudio(int32 SenderId, const TArray<uint8>& VoiceData)
+{
+	if (VoiceData.Num() < FVoiceChatPacketHeader::Size)
+	{
+		return 0;
+	}
+
+	return Relay.Relay(SenderId, Relay.AcquirePacket(VoiceData));
+}
+
+int32 UVoiceChatRelaySubsystem::RelayVoicePacket(int32 SenderId, const FVoiceChatPacketRef& Packet)
+{
+	return Relay.Relay(SenderId, Packet);
+}
+
+void UVoiceChatRelaySubsystem::BroadcastRelayed(int32 SenderId, const FVoiceChatPacketRef& Packet, int32 ReceiverId)
+{
+	OnAudioRelayed.Broadcast(ReceiverId, SenderId, Packet->Data);
+}
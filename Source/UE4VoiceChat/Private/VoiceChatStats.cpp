@@ -0,0 +1,47 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatStats.h"
+
+DEFINE_STAT(STAT_VoiceChat_Tick);
+DEFINE_STAT(STAT_VoiceChat_Capture);
+DEFINE_STAT(STAT_VoiceChat_Processing);
+DEFINE_STAT(STAT_VoiceChat_Encode);
+DEFINE_STAT(STAT_VoiceChat_Decode);
+DEFINE_STAT(STAT_VoiceChat_Queue);
+DEFINE_STAT(STAT_VoiceChat_GenerateData);
+DEFINE_STAT(STAT_VoiceChat_Mix);
+DEFINE_STAT(STAT_VoiceChat_Relay);
+
+DEFINE_STAT(STAT_VoiceChat_BytesCaptured);
+DEFINE_STAT(STAT_VoiceChat_BytesEncoded);
+DEFINE_STAT(STAT_VoiceChat_BytesQueued);
+DEFINE_STAT(STAT_VoiceChat_RelayedPackets);
+DEFINE_STAT(STAT_VoiceChat_RejectedPackets);
+DEFINE_STAT(STAT_VoiceChat_CulledPackets);
+DEFINE_STAT(STAT_VoiceChat_StarvedSamples);
+DEFINE_STAT(STAT_VoiceChat_Underflows);
+DEFINE_STAT(STAT_VoiceChat_Overflows);
+DEFINE_STAT(STAT_VoiceChat_MixedTalkers);
+DEFINE_STAT(STAT_VoiceChat_PoolAllocations);
+
+DEFINE_STAT(STAT_VoiceChat_ComponentMemory);
+DEFINE_STAT(STAT_VoiceChat_ScratchMemory);
+DEFINE_STAT(STAT_VoiceChat_QueueMemory);
+DEFINE_STAT(STAT_VoiceChat_QueueMemoryIdle);
+
+namespace VoiceChatStats
+{
+	static thread_local uint64 GThreadPoolAllocations = 0;
+
+	void CountPoolAllocation()
+	{
+		++GThreadPoolAllocations;
+		INC_DWORD_STAT(STAT_VoiceChat_PoolAllocations);
+	}
+
+	uint64 GetThreadPoolAllocations()
+	{
+		return GThreadPoolAllocations;
+	}
+}
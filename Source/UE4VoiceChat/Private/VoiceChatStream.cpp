@@ -0,0 +1,322 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatStream.h"
+#include "VoiceChatStats.h"
+#include "VoiceChatDSP.h"
+#include "VoiceChatMemory.h"
+
+/** Concealment gives up after this many consecutive lost frames, the fade out has reached silence by then */
+#define VOICE_MAX_CONCEALED_FRAMES 5
+/** Gain applied to each consecutive concealed frame relative to the previous one */
+#define VOICE_CONCEALMENT_DECAY 0.5f
+/** Time constant of the jitter buffer depth average the drift correction follows, long enough to ignore network jitter */
+#define VOICE_DRIFT_SMOOTHING_SECONDS 2.0
+/** Depth error left alone, packets make the depth move in steps of a whole packet */
+#define VOICE_DRIFT_DEADBAND_MS 20.0f
+/** Playout rate change per millisecond of depth error beyond the deadband */
+#define VOICE_DRIFT_GAIN 0.0001f
+/** Largest playout rate change, 1% corrects 10ms per second and is well below what listeners notice on speech */
+#define VOICE_DRIFT_MAX_RATE_CHANGE 0.01f
+/** Decoded frames below this RMS level may be skipped, about -50 dBFS */
+#define VOICE_DRIFT_QUIET_LEVEL 100.0f
+
+FVoiceChatStream::FVoiceChatStream() :
+	NumConcealed(0),
+	bConcealLoss(true),
+	ConcealedCount(0),
+	RecoveredCount(0),
+	LatencyMarks(nullptr),
+	bCompensateDrift(true),
+	DriftToleranceMs(60.0f),
+	DriftExcessMs(0.0f),
+	DriftFrameMs(0.0f),
+	LastDriftUpdate(0.0),
+	SkippedCount(0),
+	SampleRate(0),
+	NumChannels(0),
+	OutputSampleRate(0),
+	bSilent(true)
+{
+}
+
+void FVoiceChatStream::Init(const TSharedPtr<IVoiceDecoder>& InDecoder, int32 InSampleRate, int32 InNumChannels, int32 InOutputSampleRate, int32 InOutputNumChannels, float MinDelayMs, float MaxDelayMs, float MaxLatencyMs)
+{
+	Decoder = InDecoder;
+	SampleRate = InSampleRate;
+	NumChannels = InNumChannels;
+	OutputSampleRate = InOutputSampleRate;
+	Converter.Init(SampleRate, NumChannels, OutputSampleRate, InOutputNumChannels);
+
+	JitterBuffer.Configure(SampleRate, MinDelayMs, MaxDelayMs, MaxLatencyMs);
+	LastDecoded.Reset();
+	NumConcealed = 0;
+	Converter.Reset();
+	DriftExcessMs = 0.0f;
+	DriftFrameMs = 0.0f;
+	bSilent = true;
+}
+
+void FVoiceChatStream::Shutdown()
+{
+	Decoder = nullptr;
+	JitterBuffer.Reset();
+	Payload.Empty();
+	LastDecoded.Empty();
+	Converted.Empty();
+}
+
+void FVoiceChatStream::Reset()
+{
+	// Arrivals before and after the reset are unrelated, comparing them would read as one huge jitter spike
+	JitterBuffer.Reset();
+	JitterBuffer.ResetTiming();
+	if (Decoder.IsValid())
+	{
+		Decoder->Reset();
+	}
+	LastDecoded.Reset();
+	NumConcealed = 0;
+	Converter.SetRateRatio(1.0);
+	Converter.Reset();
+	DriftExcessMs = 0.0f;
+	DriftFrameMs = 0.0f;
+	bSilent = true;
+}
+
+void FVoiceChatStream::SetDriftCompensation(bool bEnable, float ToleranceMs)
+{
+	bCompensateDrift = bEnable;
+	DriftToleranceMs = FMath::Max(ToleranceMs, 0.0f);
+}
+
+bool FVoiceChatStream::InsertPacket(TArrayView<const uint8> Packet, double ArrivalTime)
+{
+	FVoiceChatPacketHeader Header;
+	if (!Header.Read(Packet.GetData(), Packet.Num()))
+	{
+		UE_LOG(LogVoice, Warning, TEXT("Received voice packet too small to contain a header (%d bytes)"), Packet.Num());
+		return false;
+	}
+
+	const int32 HeaderSize = Header.GetSize();
+	return JitterBuffer.Insert(Header, Packet.GetData() + HeaderSize, Packet.Num() - HeaderSize, ArrivalTime);
+}
+
+void FVoiceChatStream::Service(TVoiceChatRingBuffer<uint8>& Output, float QueuedMs)
+{
+	if (!Decoder.IsValid())
+	{
+		return;
+	}
+
+	// Queued audio is in the output format
+	const float BytesPerMs = Converter.GetOutputChannels() * sizeof(int16) * OutputSampleRate / 1000.0f;
+
+	// Only needed while decoding, so every stream serviced on this thread shares the same memory
+	FVoiceChatScratchScope Scratch;
+	DecodeBuffer = Scratch.Allocate(NumChannels * SampleRate * sizeof(uint16));
+
+	FVoiceChatPacketHeader Header;
+	int32 NumLost = 0;
+	double ArrivalTime = 0.0;
+	while (JitterBuffer.Pop(QueuedMs, Header, Payload, NumLost, ArrivalTime))
+	{
+		DriftFrameMs = 1000.0f * Header.NumSamples / SampleRate;
+		TArrayView<const uint8> Primary;
+		TArrayView<const uint8> Redundant;
+		if (!Header.SplitPayload(Payload, Primary, Redundant))
+		{
+			UE_LOG(LogVoice, Warning, TEXT("Received voice packet with a malformed redundancy block"));
+			continue;
+		}
+
+		if (NumLost > 0)
+		{
+			// The redundant copy is the packet right before this one, the last of the missing ones
+			const bool bRecover = Redundant.Num() > 0;
+			const int32 NumToConceal = bConcealLoss ? FMath::Min(NumLost - (bRecover ? 1 : 0), VOICE_MAX_CONCEALED_FRAMES) : 0;
+			for (int32 Index = 0; Index < NumToConceal; ++Index)
+			{
+				QueuedMs += Enqueue(Output, DecodeBuffer.GetData(), Conceal(Header.NumSamples)) / BytesPerMs;
+			}
+
+			if (bRecover)
+			{
+				QueuedMs += Enqueue(Output, DecodeBuffer.GetData(), Decode(Redundant)) / BytesPerMs;
+				++RecoveredCount;
+			}
+		}
+
+		uint32 DecodedSize = 0;
+		if (EnumHasAnyFlags(Header.Flags, EVoiceChatPacketFlags::Silence))
+		{
+			// Push the tail of the talk spurt out of the queue with a little silence instead of leaving it stuck below one callback
+			DecodedSize = FMath::Min<uint32>(NumChannels * sizeof(int16) * SampleRate / 25, DecodeBuffer.Num());
+			FMemory::Memzero(DecodeBuffer.GetData(), DecodedSize);
+			LastDecoded.Reset();
+			Converter.Reset();
+			bSilent = true;
+		}
+		else
+		{
+			DecodedSize = Decode(Primary);
+			bSilent = false;
+
+			if (bCompensateDrift && DriftExcessMs > DriftToleranceMs && IsQuiet(DecodedSize))
+			{
+				// Too far behind for the rate correction alone, a pause in speech can go unnoticed
+				DriftExcessMs -= 1000.0f * Header.NumSamples / SampleRate;
+				++SkippedCount;
+				continue;
+			}
+
+			if (LatencyMarks && DecodedSize > 0 && EnumHasAnyFlags(Header.Flags, EVoiceChatPacketFlags::Traced))
+			{
+				// Ahead of the audio, so the consumer never sees the audio before the mark that belongs to it
+				FVoiceChatLatencyMark Mark;
+				Mark.QueuePosition = Output.GetPushedCount();
+				Mark.CaptureTimeMs = Header.CaptureTimeMs;
+				Mark.SendDelayMs = Header.SendDelayMs;
+				Mark.ArrivalTime = ArrivalTime;
+				Mark.DecodeTime = FPlatformTime::Seconds();
+				LatencyMarks->Enqueue(MoveTemp(Mark));
+			}
+		}
+
+		QueuedMs += Enqueue(Output, DecodeBuffer.GetData(), DecodedSize) / BytesPerMs;
+	}
+	DecodeBuffer = TArrayView<uint8>();
+
+	UpdateDrift(FPlatformTime::Seconds(), QueuedMs);
+}
+
+void FVoiceChatStream::UpdateDrift(double Now, float QueuedMs)
+{
+	const double Elapsed = Now - LastDriftUpdate;
+	LastDriftUpdate = Now;
+
+	if (!bCompensateDrift || !JitterBuffer.IsPlaying())
+	{
+		// Every talk spurt starts from a fresh prebuffer at the target depth
+		DriftExcessMs = 0.0f;
+		Converter.SetRateRatio(1.0);
+		return;
+	}
+
+	// Packets are only released while less than the target is queued, so with matched clocks the target sits in the queue,
+	// topped up by a whole frame at a time, and the jitter buffer is about empty. A sender clock running fast builds up
+	// packets in the jitter buffer, one running slow leaves the queue short of the target.
+	const float ExcessMs = JitterBuffer.GetDepthMs() + QueuedMs - JitterBuffer.GetTargetDelayMs() - DriftFrameMs / 2.0f;
+	const float Alpha = 1.0f - (float)FMath::Exp(-FMath::Max(Elapsed, 0.0) / VOICE_DRIFT_SMOOTHING_SECONDS);
+	DriftExcessMs += (ExcessMs - DriftExcessMs) * Alpha;
+
+	float RateChange = 0.0f;
+	if (FMath::Abs(DriftExcessMs) > VOICE_DRIFT_DEADBAND_MS)
+	{
+		const float Error = DriftExcessMs - FMath::Sign(DriftExcessMs) * VOICE_DRIFT_DEADBAND_MS;
+		RateChange = FMath::Clamp(Error * VOICE_DRIFT_GAIN, -VOICE_DRIFT_MAX_RATE_CHANGE, VOICE_DRIFT_MAX_RATE_CHANGE);
+	}
+	Converter.SetRateRatio(1.0 + RateChange);
+}
+
+bool FVoiceChatStream::IsQuiet(uint32 Size) const
+{
+	const int32 NumSamples = Size / sizeof(int16);
+	if (NumSamples == 0)
+	{
+		return false;
+	}
+
+	uint64 Energy;
+	int32 ZeroCrossings;
+	VoiceChatDSP::ComputeEnergyAndZeroCrossings((const int16*)DecodeBuffer.GetData(), NumSamples, NumChannels, Energy, ZeroCrossings);
+	return Energy < (uint64)(VOICE_DRIFT_QUIET_LEVEL * VOICE_DRIFT_QUIET_LEVEL) * NumSamples;
+}
+
+FVoiceChatJitterBufferStats FVoiceChatStream::GetStats() const
+{
+	FVoiceChatJitterBufferStats Stats = JitterBuffer.GetStats();
+	Stats.ConcealedCount = ConcealedCount;
+	Stats.RecoveredCount = RecoveredCount;
+	Stats.PlayoutRate = (float)Converter.GetRateRatio();
+	Stats.SkippedCount = SkippedCount;
+	return Stats;
+}
+
+uint32 FVoiceChatStream::Decode(TArrayView<const uint8> Compressed)
+{
+	// DECOMPRESSION BEGIN
+	uint32 DecodedSize = DecodeBuffer.Num();
+	{
+		SCOPE_CYCLE_COUNTER(STAT_VoiceChat_Decode);
+		Decoder->Decode(Compressed.GetData(), Compressed.Num(), DecodeBuffer.GetData(), DecodedSize);
+	}
+	check(DecodeBuffer.Num() >= (int32)DecodedSize);
+	// DECOMPRESSION END
+
+	// Keep a copy to conceal the next loss from
+	LastDecoded.SetNumUninitialized(DecodedSize / sizeof(int16), false);
+	FMemory::Memcpy(LastDecoded.GetData(), DecodeBuffer.GetData(), LastDecoded.Num() * sizeof(int16));
+	NumConcealed = 0;
+	return DecodedSize;
+}
+
+uint32 FVoiceChatStream::Conceal(int32 NumSamples)
+{
+	const int32 NumOut = FMath::Min<int32>(NumSamples * NumChannels, DecodeBuffer.Num() / sizeof(int16));
+	if (LastDecoded.Num() == 0 || NumOut <= 0)
+	{
+		return 0;
+	}
+
+	// Repeat the last decoded audio, fading from the previous frame's gain down to this frame's so consecutive losses die out smoothly
+	const float StartGain = FMath::Pow(VOICE_CONCEALMENT_DECAY, (float)NumConcealed);
+	const float EndGain = StartGain * VOICE_CONCEALMENT_DECAY;
+	const int32 NumFrames = NumOut / NumChannels;
+	int16* Out = (int16*)DecodeBuffer.GetData();
+	int32 Source = 0;
+	for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+	{
+		const float Gain = FMath::Lerp(StartGain, EndGain, (float)Frame / NumFrames);
+		for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+		{
+			*Out++ = (int16)(LastDecoded[Source++] * Gain);
+		}
+		if (Source + NumChannels > LastDecoded.Num())
+		{
+			Source = 0;
+		}
+	}
+
+	++NumConcealed;
+	++ConcealedCount;
+	return NumFrames * NumChannels * sizeof(int16);
+}
+
+uint32 FVoiceChatStream::Enqueue(TVoiceChatRingBuffer<uint8>& Output, const uint8* Data, uint32 Size)
+{
+	if (Size == 0)
+	{
+		return 0;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_VoiceChat_Queue);
+
+	if (!Converter.IsPassthrough())
+	{
+		const int32 NumOutFrames = Converter.Convert((const int16*)Data, Size / (NumChannels * sizeof(int16)), Converted);
+		Data = (const uint8*)Converted.GetData();
+		Size = NumOutFrames * Converter.GetOutputChannels() * sizeof(int16);
+	}
+
+	if (!Output.Push(Data, Size))
+	{
+		INC_DWORD_STAT(STAT_VoiceChat_Overflows);
+		VOICECHAT_DEBUG_LOG(TEXT("UncompressedDataQueue Overflow!"));
+		return 0;
+	}
+
+	INC_DWORD_STAT_BY(STAT_VoiceChat_BytesQueued, Size);
+	return Size;
+}
@@ -0,0 +1,143 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatSyntheticCapture.h"
+#include "VoiceModule.h"
+
+/** Fundamental of the generated voice */
+#define VOICE_SYNTHETIC_PITCH_HZ 150.0f
+/** Syllable rate, the envelope goes from near silence to full level and back this many times a second */
+#define VOICE_SYNTHETIC_SYLLABLE_HZ 4.0f
+/** Peak level, about -12 dBFS */
+#define VOICE_SYNTHETIC_PEAK 8000.0f
+
+FVoiceChatSyntheticCapture::FVoiceChatSyntheticCapture(int32 InSampleRate, int32 InNumChannels) :
+	SampleRate(FMath::Max(InSampleRate, 1)),
+	NumChannels(FMath::Max(InNumChannels, 1)),
+	bCapturing(false),
+	GeneratedFrames(0),
+	ReadFrames(0),
+	Amplitude(0.0f)
+{
+	Pending.Reserve(GetBufferSize() / sizeof(int16));
+}
+
+void FVoiceChatSyntheticCapture::Advance(int32 NumFrames)
+{
+	if (!bCapturing)
+	{
+		return;
+	}
+
+	// Like a real device, audio that is not read in time is lost
+	const int32 MaxSamples = GetBufferSize() / sizeof(int16);
+	NumFrames = FMath::Min(NumFrames, (MaxSamples - Pending.Num()) / NumChannels);
+
+	const int32 Offset = Pending.Num();
+	Pending.AddUninitialized(NumFrames * NumChannels);
+	int16* Out = Pending.GetData() + Offset;
+
+	for (int32 Frame = 0; Frame < NumFrames; ++Frame, ++GeneratedFrames)
+	{
+		const float Time = (float)((double)GeneratedFrames / SampleRate);
+
+		// A few decaying harmonics give the codec a voiced spectrum instead of a pure tone
+		const float Phase = 2.0f * PI * VOICE_SYNTHETIC_PITCH_HZ * Time;
+		const float Voice = FMath::Sin(Phase) + 0.5f * FMath::Sin(2.0f * Phase) + 0.25f * FMath::Sin(3.0f * Phase);
+		Amplitude = 0.55f - 0.45f * FMath::Cos(2.0f * PI * VOICE_SYNTHETIC_SYLLABLE_HZ * Time);
+
+		const int16 Sample = (int16)FMath::Clamp(FMath::RoundToInt(Voice * Amplitude * VOICE_SYNTHETIC_PEAK / 1.75f), -32768, 32767);
+		for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+		{
+			*Out++ = Sample;
+		}
+	}
+}
+
+bool FVoiceChatSyntheticCapture::Init(const FString& DeviceName, int32 InSampleRate, int32 InNumChannels)
+{
+	return ChangeDevice(DeviceName, InSampleRate, InNumChannels);
+}
+
+void FVoiceChatSyntheticCapture::Shutdown()
+{
+	Stop();
+}
+
+bool FVoiceChatSyntheticCapture::Start()
+{
+	bCapturing = true;
+	return true;
+}
+
+void FVoiceChatSyntheticCapture::Stop()
+{
+	bCapturing = false;
+	Pending.Reset();
+}
+
+bool FVoiceChatSyntheticCapture::ChangeDevice(const FString& DeviceName, int32 InSampleRate, int32 InNumChannels)
+{
+	SampleRate = FMath::Max(InSampleRate, 1);
+	NumChannels = FMath::Max(InNumChannels, 1);
+	Pending.Reset();
+	return true;
+}
+
+EVoiceCaptureState::Type FVoiceChatSyntheticCapture::GetCaptureState(uint32& OutAvailableVoiceData) const
+{
+	OutAvailableVoiceData = Pending.Num() * sizeof(int16);
+	if (!bCapturing)
+	{
+		return EVoiceCaptureState::NotCapturing;
+	}
+	return OutAvailableVoiceData > 0 ? EVoiceCaptureState::Ok : EVoiceCaptureState::NoData;
+}
+
+EVoiceCaptureState::Type FVoiceChatSyntheticCapture::GetVoiceData(uint8* OutVoiceBuffer, uint32 InVoiceBufferSize, uint32& OutAvailableVoiceData)
+{
+	uint64 SampleCounter;
+	return GetVoiceData(OutVoiceBuffer, InVoiceBufferSize, OutAvailableVoiceData, SampleCounter);
+}
+
+EVoiceCaptureState::Type FVoiceChatSyntheticCapture::GetVoiceData(uint8* OutVoiceBuffer, uint32 InVoiceBufferSize, uint32& OutAvailableVoiceData, uint64& OutSampleCounter)
+{
+	OutAvailableVoiceData = 0;
+	OutSampleCounter = ReadFrames;
+	if (!bCapturing)
+	{
+		return EVoiceCaptureState::NotCapturing;
+	}
+	if (Pending.Num() == 0)
+	{
+		return EVoiceCaptureState::NoData;
+	}
+
+	// Whole frames only
+	const int32 NumFrames = FMath::Min<int32>(Pending.Num() / NumChannels, InVoiceBufferSize / (sizeof(int16) * NumChannels));
+	if (NumFrames == 0)
+	{
+		return EVoiceCaptureState::BufferTooSmall;
+	}
+
+	const int32 NumSamples = NumFrames * NumChannels;
+	FMemory::Memcpy(OutVoiceBuffer, Pending.GetData(), NumSamples * sizeof(int16));
+	Pending.RemoveAt(0, NumSamples, false);
+
+	ReadFrames += NumFrames;
+	OutSampleCounter = ReadFrames;
+	OutAvailableVoiceData = NumSamples * sizeof(int16);
+	return EVoiceCaptureState::Ok;
+}
+
+int32 FVoiceChatSyntheticCapture::GetBufferSize() const
+{
+	// One second, in the range of what the platform capture devices buffer
+	return SampleRate * NumChannels * sizeof(int16);
+}
+
+void FVoiceChatSyntheticCapture::DumpState() const
+{
+	UE_LOG(LogVoice, Display, TEXT("Synthetic voice capture: %s, %d Hz, %d channels, %d samples pending, %llu frames read"),
+		bCapturing ? TEXT("capturing") : TEXT("stopped"), SampleRate, NumChannels, Pending.Num(), ReadFrames);
+}
@@ -0,0 +1,69 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#include "VoiceChatVAD.h"
+#include "VoiceChatDSP.h"
+
+/** Blocks this far above the threshold count as speech whatever their zero crossing rate */
+#define VOICE_VAD_LOUD_MARGIN_DB 15.0f
+/** Level reported for digital silence */
+#define VOICE_VAD_FLOOR_DB -96.0f
+
+FVoiceChatVAD::FVoiceChatVAD() :
+	SampleRate(48000),
+	ThresholdDb(-45.0f),
+	HangoverMs(300.0f),
+	MaxZeroCrossingRate(0.35f),
+	bActive(false),
+	HangoverRemainingMs(0.0f),
+	LevelDb(VOICE_VAD_FLOOR_DB)
+{
+}
+
+void FVoiceChatVAD::Configure(int32 InSampleRate, float InThresholdDb, float InHangoverMs, float InMaxZeroCrossingRate)
+{
+	SampleRate = FMath::Max(InSampleRate, 1);
+	ThresholdDb = InThresholdDb;
+	HangoverMs = FMath::Max(InHangoverMs, 0.0f);
+	MaxZeroCrossingRate = FMath::Clamp(InMaxZeroCrossingRate, 0.0f, 1.0f);
+	Reset();
+}
+
+void FVoiceChatVAD::Reset()
+{
+	bActive = false;
+	HangoverRemainingMs = 0.0f;
+	LevelDb = VOICE_VAD_FLOOR_DB;
+}
+
+bool FVoiceChatVAD::Process(const int16* Samples, int32 NumSamples, int32 NumChannels)
+{
+	if (NumSamples <= 0 || NumChannels <= 0)
+	{
+		return bActive;
+	}
+
+	uint64 Energy;
+	int32 ZeroCrossings;
+	VoiceChatDSP::ComputeEnergyAndZeroCrossings(Samples, NumSamples, NumChannels, Energy, ZeroCrossings);
+
+	const float MeanSquare = (float)((double)Energy / NumSamples / (32768.0 * 32768.0));
+	LevelDb = MeanSquare > 0.0f ? FMath::Max(VOICE_VAD_FLOOR_DB, 10.0f * FMath::LogX(10.0f, MeanSquare)) : VOICE_VAD_FLOOR_DB;
+
+	const float ZeroCrossingRate = (float)ZeroCrossings / NumSamples;
+	const bool bSpeech = LevelDb >= ThresholdDb && (ZeroCrossingRate <= MaxZeroCrossingRate || LevelDb >= ThresholdDb + VOICE_VAD_LOUD_MARGIN_DB);
+
+	const float BlockMs = (NumSamples / NumChannels) * 1000.0f / SampleRate;
+	if (bSpeech)
+	{
+		HangoverRemainingMs = HangoverMs;
+		bActive = true;
+	}
+	else if (bActive)
+	{
+		HangoverRemainingMs -= BlockMs;
+		bActive = HangoverRemainingMs > 0.0f;
+	}
+
+	return bActive;
+}
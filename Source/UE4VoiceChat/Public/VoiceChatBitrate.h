@@ -0,0 +1,136 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoiceChatJitterBuffer.h"
+
+/**
+ * Reception quality of one talker as seen by one listener. Listeners send it back to the talker over the game's
+ * own transport, about once a second, see UVoiceChatComponent::GetReceiverReport and ReceiveReport.
+ *
+ * Layout, little endian: [Version u8][LossFraction u8, in 1/255][JitterMs u16][MaxBitrate u32]
+ */
+struct FVoiceChatReceiverReport
+{
+	static const int32 Size = 8;
+	static const uint8 Version = 1;
+
+	/** Fraction of the talker's packets lost or late since the previous report, 0 to 1 */
+	float LossFraction = 0.0f;
+	/** Smoothed inter-arrival jitter */
+	float JitterMs = 0.0f;
+	/** Most the listener wants to receive from this talker in bits per second, 0 for no limit */
+	int32 MaxBitrate = 0;
+
+	/** Report the change between two snapshots of the same stream */
+	static FVoiceChatReceiverReport FromStats(const FVoiceChatJitterBufferStats& Stats, const FVoiceChatJitterBufferStats& PreviousStats, int32 MaxBitrate)
+	{
+		// Late packets arrived but were already counted as lost when playback skipped them
+		const int32 Lost = Stats.LostCount - PreviousStats.LostCount;
+		const int32 Expected = (Stats.ReceivedCount - PreviousStats.ReceivedCount) - (Stats.LateCount - PreviousStats.LateCount) + Lost;
+
+		FVoiceChatReceiverReport Report;
+		Report.LossFraction = Expected > 0 ? FMath::Clamp((float)Lost / Expected, 0.0f, 1.0f) : 0.0f;
+		Report.JitterMs = Stats.JitterMs;
+		Report.MaxBitrate = FMath::Max(MaxBitrate, 0);
+		return Report;
+	}
+
+	void Write(uint8* OutData) const
+	{
+		const uint8 Loss = (uint8)FMath::RoundToInt(FMath::Clamp(LossFraction, 0.0f, 1.0f) * 255.0f);
+		const uint16 Jitter = (uint16)FMath::Clamp(FMath::RoundToInt(JitterMs), 0, 0xFFFF);
+		OutData[0] = Version;
+		OutData[1] = Loss;
+		OutData[2] = (uint8)Jitter;
+		OutData[3] = (uint8)(Jitter >> 8);
+		OutData[4] = (uint8)MaxBitrate;
+		OutData[5] = (uint8)(MaxBitrate >> 8);
+		OutData[6] = (uint8)(MaxBitrate >> 16);
+		OutData[7] = (uint8)(MaxBitrate >> 24);
+	}
+
+	/** @return false if InData is too short or of another version */
+	bool Read(const uint8* InData, int32 InDataSize)
+	{
+		if (InDataSize < Size || InData[0] != Version)
+		{
+			return false;
+		}
+
+		LossFraction = InData[1] / 255.0f;
+		JitterMs = (float)((uint16)InData[2] | ((uint16)InData[3] << 8));
+		MaxBitrate = (int32)((uint32)InData[4] | ((uint32)InData[5] << 8) | ((uint32)InData[6] << 16) | ((uint32)InData[7] << 24));
+		return MaxBitrate >= 0;
+	}
+};
+
+/** Encoder settings chosen by FVoiceChatBitrateController */
+struct FVoiceChatEncoderSettings
+{
+	int32 Bitrate = 0;
+	bool bVBR = true;
+	int32 Complexity = 0;
+};
+
+/**
+ * Picks encoder bitrate, VBR and complexity for one talker from the reports of its listeners and the time spent encoding.
+ *
+ * Bitrate follows additive increase / multiplicative decrease on the worst listener heard from recently: it backs off
+ * sharply under heavy loss, holds under light loss or high jitter, and creeps back up otherwise. It never goes above
+ * the smallest cap among the session budget and the listeners' MaxBitrate, so a congested server or listener gets a
+ * lower quality stream instead of losing packets. VBR is switched off under loss or when held at a cap, constant
+ * bitrate keeps every packet within the budget. Complexity drops when encoding takes too large a share of real time.
+ *
+ * Not thread safe.
+ */
+class UE4VOICECHAT_API FVoiceChatBitrateController
+{
+public:
+
+	FVoiceChatBitrateController();
+
+	/** Bitrate bounds in bits per second and the highest encoder complexity to use. Forgets every report. */
+	void Configure(int32 InMinBitrate, int32 InMaxBitrate, int32 InMaxComplexity);
+
+	/** Add or replace the latest report of a listener */
+	void AddReport(int32 ListenerId, const FVoiceChatReceiverReport& Report, double Now);
+
+	/** Bitrate available to this talker in the session, in bits per second. 0 for no limit. */
+	void SetBudget(int32 InBudget) { Budget = FMath::Max(InBudget, 0); }
+
+	/** Account for one Encode call taking EncodeSeconds for AudioSeconds of audio */
+	void AddEncodeTime(double EncodeSeconds, double AudioSeconds);
+
+	/**
+	 * Re-evaluate the settings from what was reported and measured since the previous evaluation.
+	 * Only evaluates about once a second, call as often as convenient.
+	 *
+	 * @return true if the settings changed and should be applied to the encoder
+	 */
+	bool Update(double Now);
+
+	const FVoiceChatEncoderSettings& GetSettings() const { return Settings; }
+
+private:
+
+	struct FListener
+	{
+		FVoiceChatReceiverReport Report;
+		double Time;
+	};
+
+	int32 MinBitrate;
+	int32 MaxBitrate;
+	int32 MaxComplexity;
+	int32 Budget;
+
+	FVoiceChatEncoderSettings Settings;
+	TMap<int32, FListener> Listeners;
+
+	double EncodeSeconds;
+	double EncodedAudioSeconds;
+	double LastUpdateTime;
+};
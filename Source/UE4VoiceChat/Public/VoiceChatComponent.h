@@ -5,13 +5,60 @@
 
 #include "CoreMinimal.h"
 #include "Components/AudioComponent.h"
+#include "Async/TaskGraphInterfaces.h"
 #include "VoiceModule.h"
+#include "VoiceChatRingBuffer.h"
+#include "VoiceChatMemory.h"
+#include "VoiceChatStream.h"
+#include "VoiceChatMixBuffer.h"
+#include "VoiceChatPacket.h"
+#include "VoiceChatVAD.h"
+#include "VoiceChatProcessor.h"
+#include "VoiceChatBitrate.h"
+#include "VoiceChatProfile.h"
+#include "VoiceChatFormatConverter.h"
+#include "VoiceChatLatency.h"
+#include "VoiceChatRecording.h"
 #include "VoiceChatComponent.generated.h"
 
 #define VOICE_MAX_COMPRESSED_BUFFER 20 * 1024
-#define VOICE_STARTING_REMAINDER_SIZE 1 * 1024
+#define VOICE_MAX_PENDING_PACKETS 64
+/** Components at least this loud at the listener run their pipeline on high priority worker threads */
+#define VOICE_HIGH_PRIORITY_VOLUME 0.25f
+/** Most output channels the underflow fade keeps the last played frame of */
+#define VOICE_MAX_OUTPUT_CHANNELS 8
 
-DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnAudioCaptureCompleted, TArray<uint8>, VoiceData, bool, IsCompressed);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnAudioCaptureCompleted, const TArray<uint8>&, VoiceData, bool, IsCompressed);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnVoiceChatInitialized, bool, bSuccess);
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnVoicePacketCaptured, const FVoiceChatPacketRef& /*Packet*/);
+
+/** Packet handed to PlayVoiceChatAudio while the threaded pipeline is enabled, waiting for the next pipeline run */
+struct FIncomingVoicePacket
+{
+	FVoiceChatPacketPtr Packet;
+	double ArrivalTime = 0.0;
+	/** Sender passed to PlayVoiceChatAudioFromSender, INDEX_NONE for PlayVoiceChatAudio */
+	int32 SenderId = INDEX_NONE;
+};
+
+/** Report handed to ReceiveReport, waiting for the next pipeline run */
+struct FIncomingReceiverReport
+{
+	int32 ListenerId = INDEX_NONE;
+	FVoiceChatReceiverReport Report;
+	double ArrivalTime = 0.0;
+};
+
+/** Receive state of one sender played through PlayVoiceChatAudioFromSender */
+struct FVoiceChatSender
+{
+	FVoiceChatStream Stream;
+	/** Decoded audio of this sender waiting to be mixed into the playback queue */
+	FVoiceChatPooledQueue Queue;
+	double LastPacketTime = 0.0;
+	/** Stream stats as of the last receiver report on this sender */
+	FVoiceChatJitterBufferStats ReportedStats;
+};
 
 UCLASS(BlueprintType, meta = (BlueprintSpawnableComponent))
 class UVoiceChatComponent : public UAudioComponent
@@ -33,49 +80,298 @@ public:
 
 	/** Name of current device under capture */
 	FString DeviceName;
+	/** VoiceCapture came from FVoiceChatDeviceCache and goes back there on cleanup */
+	bool bCaptureFromCache;
+	/** Incremented by every InitWithInputDeviceAsync and Shutdown, an async init finishing under an older serial is stale */
+	int32 InitSerial;
+	/** An InitWithInputDeviceAsync is still opening devices */
+	bool bIsInitializing;
 	/** Current type of audio under capture */
 	EAudioEncodeHint EncodeHint;
-	/** Current input sample rate provided */
+	/** Sample rate audio is encoded and decoded at, set by VoiceProfile */
 	int32 InputSampleRate;
 	/** Desired output sample rate */
 	int32 OutputSampleRate;
-	/** Current number of channels captured */
+	/** Number of channels encoded and decoded, set by VoiceProfile */
 	int32 NumInChannels;
 	/** Desired number of output channels */
 	int32 NumOutChannels;
+	/** Sample rate requested from the capture device */
+	int32 CaptureSampleRate;
+	/** Number of channels requested from the capture device */
+	int32 NumCaptureChannels;
+
+	/**
+	 * Format audio is encoded and sent in. The mono voice profiles move, encode and send a fraction of the data of the
+	 * default 48 kHz stereo one. Applied by the Init functions, every component of a session must use the same profile.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		EVoiceChatProfile VoiceProfile = EVoiceChatProfile::Stereo48k;
+	/** Capture device format to codec format */
+	FVoiceChatFormatConverter CaptureConverter;
+	/** Codec format to playback format, for the local loopback */
+	FVoiceChatFormatConverter LoopbackConverter;
+	TArray<int16> ConvertedCapture;
+	TArray<int16> ConvertedLoopback;
 
 	/** Was the audio component playing last frame */
 	bool bLastWasPlaying;
 	/** Number of consecutive frames that the playback has been starved */
 	int32 StarvedDataCount;
+	/** Playback underflows filled by GenerateData, written by the audio thread */
+	TAtomic<int32> UnderflowCount;
+	/** Frames of playback GenerateData had to fill, written by the audio thread */
+	TAtomic<int64> StarvedFrameCount;
+	/**
+	 * Is a talker played by this component in the middle of a talk spurt, written by the pipeline or, for mix buses, by
+	 * UVoiceChatMixerSubsystem. Playback running dry is only filled while it is set.
+	 */
+	FThreadSafeBool bMidTalkSpurt;
+	/** Frames filled since the queue last had audio, audio thread only */
+	int32 FilledFramesSinceAudio;
+	/** Last frame handed to the procedural wave, the underflow fill fades out from it. Audio thread only. */
+	int16 LastPlayedFrame[VOICE_MAX_OUTPUT_CHANNELS];
+	/** Comfort noise generator state, audio thread only */
+	uint32 NoiseSeed;
+	/** Underflow fill handed to the procedural wave, audio thread only */
+	TArray<int16> UnderflowFill;
+	/** GenerateData calls currently using the playback queue, see FencePlayback */
+	TAtomic<int32> ActivePlaybackReads;
+	/** Cleared by FencePlayback, GenerateData leaves the playback queue alone while it is */
+	TAtomic<bool> bPlaybackQueueOpen;
 
-	/** Buffer for pre-encoded audio data */
+	/** Captured audio in the codec format, encoded in place from CaptureReadOffset up to CaptureWriteOffset */
 	TArray<uint8> RawCaptureData;
 	/** Maximum size of a single raw capture packet */
 	int32 MaxRawCaptureDataSize;
-	/** Buffer for compressed audio data */
-	TArray<uint8> CompressedData;
-	/** Maximum size of a single encoded packet */
+	/** Maximum size of a single encoded packet, the buffer for it comes from the scratch arena of the encoding thread */
 	int32 MaxCompressedDataSize;
-	/** Buffer for uncompressed audio data (valid during Tick only) */
-	TArray<uint8> UncompressedData;
-	/** Maximum size of a single decoded packet */
+	/** Maximum size of a single decoded packet, the buffer for it comes from the scratch arena of the decoding thread */
 	int32 MaxUncompressedDataSize;
 
-	/** Buffer for outgoing audio intended for procedural streaming */
-	mutable FCriticalSection QueueLock;
-	TArray<uint8> UncompressedDataQueue;
-	/** Amount of data currently in the outgoing playback queue */
-	int32 CurrentUncompressedDataQueueSize;
-	/** Maximum size of the outgoing playback queue */
+	/** Buffer for outgoing audio intended for procedural streaming, pushed by the game thread and popped by the audio thread */
+	FVoiceChatPooledQueue UncompressedDataQueue;
+	/** Size of the outgoing playback queue, may be less than asked for when the queue pool is over budget */
 	int32 MaxUncompressedDataQueueSize;
 
-	/** Buffer for data left uncompressed after call to Encode to be used next encoding */
-	TArray<uint8> Remainder;
-	/** Maximum size of the remainder buffer */
-	int32 MaxRemainderSize;
-	/** Current amount of raw data left over from last encode */
-	int32 LastRemainderSize;
+	/** Reorders, delays and decodes received packets into the playback queue */
+	FVoiceChatStream ReceiveStream;
+	/** Lower bound of the adaptive jitter buffer delay */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		float JitterBufferMinDelayMs = 40.0f;
+	/** Upper bound of the adaptive jitter buffer delay */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		float JitterBufferMaxDelayMs = 80.0f;
+	/** Received audio older than this is dropped to keep mouth to ear latency bounded */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		float MaxPlayoutLatencyMs = 200.0f;
+
+	/**
+	 * Keep playout latency from creeping up or down when the sender's capture clock runs slightly faster or slower than
+	 * the local output clock. Small drift is absorbed by playing up to 1% faster or slower, larger excess by skipping quiet frames.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		bool bCompensateClockDrift = true;
+	/** Excess buffered audio above the jitter buffer target at which quiet frames start being skipped */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		float DriftToleranceMs = 60.0f;
+
+	/** Synthesize audio for lost packets from the last received audio instead of leaving a gap */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		bool bConcealPacketLoss = true;
+	/**
+	 * Level of the noise filling the playback when it runs dry in the middle of a talk spurt, in dBFS. The last played
+	 * audio fades out into it instead of cutting to digital silence. -96 or lower fills with silence.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		float ComfortNoiseLevelDb = -60.0f;
+	/**
+	 * Repeat the previous payload in every packet so receivers can recover any single lost packet.
+	 * Roughly doubles the outgoing bandwidth.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		bool bSendRedundantAudio = false;
+	/** Payload of the last packet sent, repeated in the next one when bSendRedundantAudio is set */
+	TArray<uint8> RedundantPayload;
+	/**
+	 * Let a component initialized with InitAsSender play the talker's own voice back to them. The raw capture is
+	 * played as is, nothing is decoded. Read by InitAsSender.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		bool bSidetone = false;
+	/** Initialized with InitAsSender: capture and encode only */
+	bool bSenderOnly;
+
+	/** Channel the packets captured by this component are sent on, 0 to VOICE_MAX_CHANNELS - 1. E.g. one per team, squad or admin. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Channels")
+		int32 VoiceChannel = 0;
+	/** Channels this component plays, packets sent on any other channel are dropped before they are copied or decoded */
+	FVoiceChatChannelMask SubscribedChannels;
+
+	/** Jitter buffer state as of the last completed service, what the Blueprint getters report */
+	FVoiceChatJitterBufferStats JitterStats;
+	/** Buffer memory as of the last completed service, counted in the Component Buffers stat */
+	int32 MemoryUsage = 0;
+
+	/** Maximum number of senders decoded at once, the least recently heard sender is evicted to make room for a new one */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		int32 MaxSenderDecoders = 8;
+	/** Senders that sent nothing for this long are dropped and their decoder kept for the next sender */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		float SenderTimeoutSeconds = 5.0f;
+	/** Senders currently decoded, only touched by the pipeline */
+	TMap<int32, TUniquePtr<FVoiceChatSender>> Senders;
+	/** Decoders of evicted or timed out senders, reset and ready for reuse */
+	TArray<TSharedPtr<IVoiceDecoder>> IdleDecoders;
+	/** Scratch for mixing the senders into the playback queue */
+	FVoiceChatMixBuffer SenderMix;
+
+	/**
+	 * Drop received audio without decoding or queuing it while the attenuated volume at the listener is below
+	 * CullingVolumeThreshold. Only applies while the component is spatialized with attenuation.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Culling")
+		bool bEnableDistanceCulling = true;
+	/** Attenuated volume below which received audio is culled, 0.01 is -40 dB. Culling ends once the volume is twice this. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Culling")
+		float CullingVolumeThreshold = 0.01f;
+	/** Is received audio currently dropped, game thread only */
+	bool bIsCulled = false;
+	/** Volume at the listener after attenuation as of the last tick, 1 when not attenuated */
+	float AudibleVolume = 1.0f;
+
+	/**
+	 * Run capture, encode and decode on a background task instead of the game thread.
+	 * Only the OnAudioCaptureCompleted broadcast and playback control stay on the game thread.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		bool bUseThreadedPipeline = false;
+	/** Background run of the pipeline started by the last tick, if any */
+	FGraphEventRef PipelineTask;
+	/** Packets received on the game thread, consumed by the pipeline task */
+	TVoiceChatRingBuffer<FIncomingVoicePacket> IncomingPackets;
+	/** Packets encoded by the pipeline task, broadcast on the game thread */
+	TVoiceChatRingBuffer<FVoiceChatPacketPtr> CapturedPackets;
+	/** Buffers for packets this component encodes */
+	FVoiceChatPacketPool CapturePacketPool;
+	/** Buffers for received packets waiting for the pipeline task */
+	FVoiceChatPacketPool IncomingPacketPool;
+
+	/** Skip encoding and transmission while the talker is not speaking */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		bool bEnableVoiceActivityDetection = true;
+	/** Level in dBFS above which captured audio may be speech */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		float VoiceActivityThresholdDb = -45.0f;
+	/** How long to keep transmitting after speech stops */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		float VoiceActivityHangoverMs = 300.0f;
+	/** Fraction of sign changes per sample above which quiet audio is treated as noise rather than speech */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		float VoiceActivityMaxZeroCrossingRate = 0.35f;
+	/** Voice activity detector run on captured audio before it is encoded */
+	FVoiceChatVAD VAD;
+
+	/** Remove rumble and DC offset below HighPassCutoffHz from captured audio */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Processing")
+		bool bHighPassFilter = false;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Processing")
+		float HighPassCutoffHz = 80.0f;
+	/** Attenuate captured audio quieter than NoiseGateThresholdDb, e.g. keyboard and fan noise between words */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Processing")
+		bool bNoiseGate = false;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Processing")
+		float NoiseGateThresholdDb = -50.0f;
+	/** Steer the level of captured speech towards AutomaticGainTargetDb, boosting it by at most AutomaticGainMaxDb */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Processing")
+		bool bAutomaticGainControl = false;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Processing")
+		float AutomaticGainTargetDb = -20.0f;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Processing")
+		float AutomaticGainMaxDb = 24.0f;
+	/** Keep captured peaks under LimiterCeilingDb, run after every other stage */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Processing")
+		bool bLimiter = false;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Processing")
+		float LimiterCeilingDb = -1.0f;
+	/** Stages run in place on captured audio before voice activity detection and encoding, built by ApplyCaptureProcessing */
+	FVoiceChatProcessorChain CaptureProcessors;
+	/** Stages added with AddCaptureProcessor */
+	TArray<TSharedRef<IVoiceChatProcessor>> CustomCaptureProcessors;
+
+	/**
+	 * Adapt the encoder bitrate, VBR and complexity to the reports listeners send back through ReceiveReport,
+	 * the budget set with SetBitrateBudget and the time spent encoding. Read by Init.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Bitrate")
+		bool bAdaptiveBitrate = false;
+	/** Lowest bitrate the adaptive bitrate goes down to, in bits per second */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Bitrate")
+		int32 MinBitrate = 12000;
+	/** Highest bitrate the adaptive bitrate goes up to, in bits per second */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Bitrate")
+		int32 MaxBitrate = 64000;
+	/** Highest encoder complexity, 0 to 10. The adaptive bitrate lowers it while encoding takes too long. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Bitrate")
+		int32 MaxEncoderComplexity = 10;
+	/**
+	 * Most this listener wants to receive from all talkers together, in bits per second. Shared evenly among the
+	 * talkers heard and sent to them in receiver reports. 0 for no limit.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Bitrate")
+		int32 ReceiveBitrateBudget = 0;
+	/** Encoder settings of this talker, only touched by the pipeline */
+	FVoiceChatBitrateController BitrateController;
+	/** Reports received on the game thread, consumed by the pipeline */
+	TVoiceChatRingBuffer<FIncomingReceiverReport> IncomingReports;
+	/** Budget set with SetBitrateBudget, read by the pipeline */
+	TAtomic<int32> BitrateBudget;
+	/** Were the encoder settings changed, the encoder is then not handed to other components through the device cache */
+	bool bEncoderTuned;
+	/** Stream stats as of the last receiver report on the PlayVoiceChatAudio stream */
+	FVoiceChatJitterBufferStats ReportedStats;
+	/** Were packets sent for the last captured block, a silence marker is sent when this drops */
+	bool bIsTransmitting;
+
+	/**
+	 * Amount of audio per sent packet, rounded to the 20ms codec frame. Packets go out at this rate whatever the frame rate:
+	 * larger intervals mean fewer, bigger packets at the cost of latency. 0 sends whatever was captured each tick as one packet.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		float PacketIntervalMs = 40.0f;
+
+	/**
+	 * Stamp sent packets with their capture time so receivers can measure capture to playout latency, see GetLatencyPercentileMs.
+	 * Adds 6 bytes to every packet.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|Latency")
+		bool bTraceLatency = false;
+	/**
+	 * Shared clock minus FPlatformTime::Seconds, in microseconds. The shared clock is the game state's server world time
+	 * so stamps are comparable between machines, or the local clock without a game state. Written by the game thread.
+	 */
+	TAtomic<int64> ClockOffsetMicroseconds;
+	/** Traced packets decoded into the playback queue, pushed by the decoding thread and resolved by GenerateData */
+	TVoiceChatRingBuffer<FVoiceChatLatencyMark> PendingLatencyMarks;
+	/** Traced packets played out, pushed by GenerateData and recorded on the game thread */
+	TVoiceChatRingBuffer<FVoiceChatLatencyMark> PlayedLatencyMarks;
+	/** Latency of the traced packets played by this component, game thread only */
+	FVoiceChatLatencyTracker LatencyTracker;
+
+	/** Every packet sent and received is appended here while set, may be shared with other components */
+	TSharedPtr<FVoiceChatRecorder, ESPMode::ThreadSafe> Recorder;
+	/** Speaker ID the packets captured by this component are recorded under */
+	int32 RecordingSpeakerId;
+
+	/** Sequence number of the next packet sent */
+	uint16 OutgoingSequence;
+	/** Capture clock of the next packet sent, in samples */
+	uint32 OutgoingTimestamp;
+
+	/** Start of the captured audio in RawCaptureData not encoded yet, always less than a packet between ticks */
+	int32 CaptureReadOffset;
+	/** End of the captured audio in RawCaptureData, new capture is appended here */
+	int32 CaptureWriteOffset;
 	/** Cached Sample Count to allow us to compare the SampleCount of a call to GetVoiceData against the previous call. */
 	uint64 CachedSampleCount;
 	/** Zero out input before encoding */
@@ -91,12 +387,41 @@ public:
 	bool Init();
 	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
 		bool InitWithInputDevice(FName DeviceName);
+	/**
+	 * InitWithInputDevice without blocking the game thread: the capture device and codecs are opened on a worker
+	 * thread, reusing ones cached by previously shut down components, and the VoIP sound class is loaded
+	 * asynchronously. OnInitialized is broadcast on the game thread once the component is ready.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
+		void InitWithInputDeviceAsync(FName DeviceName);
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		bool IsInitializing() const { return bIsInitializing; }
+	/**
+	 * Close every idle capture device and codec kept by shut down components and probe devices that failed to open
+	 * again, e.g. after the user plugged a microphone in or when voice chat is left for good.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
+		static void FlushDeviceCache();
+	/** Set the codec, capture and output formats from VoiceProfile */
+	void ApplyVoiceProfile();
 	/** (Re)Initialize the audio capture object with current settings, reallocating buffers */
 	void InitVoiceCapture();
+	/** Initialize with a capture created elsewhere, e.g. FVoiceChatSyntheticCapture. InVoiceCapture must produce the device format. */
+	void InitVoiceCapture(const TSharedPtr<IVoiceCapture>& InVoiceCapture);
 	/** (Re)Initialize the audio encoder with current settings, reallocating buffers */
 	void InitVoiceEncoder();
+	/** Initialize with an encoder opened elsewhere for the current codec format */
+	void InitVoiceEncoder(const TSharedPtr<IVoiceEncoder>& InVoiceEncoder);
 	/** (Re)Initialize the audio decoder with current settings, reallocating buffers */
 	void InitVoiceDecoder();
+	/** Initialize with a decoder opened elsewhere for the current codec format */
+	void InitVoiceDecoder(const TSharedPtr<IVoiceDecoder>& InVoiceDecoder);
+	/** (Re)Allocate the decode buffer and the outgoing playback queue for the current output format */
+	void InitPlaybackQueue();
+	/** Create the procedural sound wave this component plays */
+	void InitSoundStreaming();
+	/** Apply the project's VoIP sound class, loading it in the background instead of blocking when bAsync */
+	void InitSoundClass(bool bAsync);
 	/** Cleanup and shutdown the entire object */
 	void Shutdown();
 
@@ -106,12 +431,91 @@ public:
 	void CleanupAudioComponent();
 	/** Empty and reset the outgoing audio data queue */
 	void CleanupQueue();
+	/**
+	 * Wait for GenerateData calls still reading the playback queue and keep later ones out of it, until the queue is
+	 * opened again. Unbinding the callback does not wait for a call already running on an audio thread.
+	 */
+	void FencePlayback();
+	/**
+	 * Append decoded audio to the outgoing playback queue, dropping it entirely if it does not fit
+	 *
+	 * @return true if the data was queued
+	 */
+	bool EnqueueUncompressedData(const uint8* VoiceDataPtr, uint32 VoiceDataSize);
+	/** For playback fed through EnqueueUncompressedData: is any talker in it in the middle of a talk spurt */
+	void SetMidTalkSpurt(bool bInMidTalkSpurt) { bMidTalkSpurt = bInMidTalkSpurt; }
+	/** Amount of decoded audio waiting to be played, in the playback queue and in the procedural wave */
+	float GetQueuedPlaybackMs() const;
+	/** Decode every received packet that is due into the playback queue */
+	void ServiceJitterBuffer();
+	/** Move packets received while the threaded pipeline is enabled into the jitter buffer */
+	void ProcessIncomingPackets();
+	/** Route a received packet to the jitter buffer of its sender */
+	void InsertIncomingPacket(int32 SenderId, TArrayView<const uint8> Packet, double ArrivalTime);
+	/** Find the state of SenderId, creating it and evicting the least recently heard sender if needed */
+	FVoiceChatSender* FindOrAddSender(int32 SenderId, double Now);
+	/** Shut a sender's stream down and keep its decoder for reuse */
+	void ReleaseSender(FVoiceChatSender& Sender);
+	/** Snapshot the memory held by this component into MemoryUsage, while the pipeline is idle */
+	void UpdateMemoryUsage();
+	/** Decode every sender and mix their audio into the playback queue */
+	void ServiceSenders();
+	/** Capture, encode and emit whatever the microphone produced since the last call, queuing the local loopback */
+	void ProcessCapture();
+	/**
+	 * Encode captured audio into one packet, emit it and queue the local loopback
+	 *
+	 * @param CaptureTime FPlatformTime::Seconds the first sample of VoiceData was captured at
+	 * @return number of bytes of VoiceData encoded, the rest did not fill a whole codec frame
+	 */
+	uint32 EncodePacket(const uint8* VoiceData, uint32 VoiceDataSize, double CaptureTime);
+	/** GenerateData once the playback queue is pinned against FencePlayback */
+	void GenerateQueuedData(USoundWaveProcedural* InProceduralWave, int32 SamplesRequired);
+	/** Fill the end of a playback request the queue could not satisfy with a fade out into comfort noise */
+	void FillUnderflow(USoundWaveProcedural* InProceduralWave, int32 NumFrames);
+	/** VoiceChannel clamped to a valid channel ID */
+	uint8 GetOutgoingChannel() const;
+	/** Convert audio in the codec format to the playback format and queue it for local playback */
+	void QueueLoopback(const uint8* VoiceData, uint32 VoiceDataSize);
+	/** Number of captured samples per channel going into each packet */
+	uint32 GetPacketIntervalSamples() const;
+	/** Make room for Size bytes of capture at CaptureWriteOffset, compacting RawCaptureData only when it runs out at the end */
+	uint8* ReserveCaptureSpace(uint32 Size);
+	/** Feed received reports to the adaptive bitrate and apply its settings to the encoder when they change */
+	void UpdateBitrate();
+	void ApplyEncoderSettings();
+	/** Tell receivers the talker stopped speaking so their playback winds down instead of starving */
+	void EmitSilenceMarker();
+	/** Broadcast an encoded packet, deferring it to the game thread when called from the pipeline task */
+	void EmitPacket(const FVoiceChatPacketRef& Packet);
+	/** Hand a packet to native and Blueprint listeners */
+	void BroadcastPacket(const FVoiceChatPacketRef& Packet);
+	/** Broadcast packets encoded by the pipeline task */
+	void BroadcastCapturedPackets();
+	/** Block until the background pipeline run, if any, has finished */
+	void WaitForPipeline();
+	/** Start playback once enough decoded audio is queued */
+	void UpdatePlayback();
+	/** Everything TickComponent does besides the engine's own tick: capture, encode, decode, broadcast and playback control */
+	void TickVoice();
+	/** Follow the shared clock used for latency stamps */
+	void UpdateClockOffset();
+	/** Shared clock minus FPlatformTime::Seconds, in seconds */
+	double GetClockOffsetSeconds() const;
+	/** Audio thread: pass on the traced packets whose audio starts within the PlayedBytes bytes of the playback queue at PlayedPosition */
+	void ResolveLatencyMarks(uint32 PlayedPosition, uint32 PlayedBytes);
+	/** Volume of this component at the listener after attenuation, 1 when not attenuated or without a listener */
+	float ComputeAudibleVolume() const;
+	/** Re-evaluate AudibleVolume and start or end culling */
+	void UpdateCulling();
+	/** Drop every received packet and all decoded audio not played yet, and reset the decoders */
+	void ResyncReceive();
 
 	/**
 	 * Callback from streaming audio when data is requested for playback
 	 *
 	 * @param InProceduralWave SoundWave requesting more data
-	 * @param SamplesRequired number of samples needed for immediate playback
+	 * @param SamplesRequired number of samples needed for immediate playback, all channels counted
 	 */
 	UFUNCTION()
 		void GenerateData(USoundWaveProcedural* InProceduralWave, int32 SamplesRequired);
@@ -119,11 +523,151 @@ public:
 	UPROPERTY(BlueprintAssignable)
 		FOnAudioCaptureCompleted OnAudioCaptureCompleted;
 
+	/** Native counterpart of OnAudioCaptureCompleted, hands out the pooled packet itself instead of a copy */
+	FOnVoicePacketCaptured OnVoicePacketCaptured;
+
+	/** Broadcast when InitWithInputDeviceAsync finished, bSuccess is false if the capture device or a codec could not be opened */
+	UPROPERTY(BlueprintAssignable)
+		FOnVoiceChatInitialized OnInitialized;
+
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
+		void PlayVoiceChatAudio(const TArray<uint8>& VoiceData, bool IsCompressed);
+
+	/** Native counterpart of PlayVoiceChatAudio, the packet is only read during the call */
+	void PlayVoiceChatPacket(TArrayView<const uint8> Packet);
+
+	/**
+	 * Play a packet from one of several senders sharing this component. Every sender gets its own jitter buffer,
+	 * decoder and queue, and the senders are mixed for playback. Do not combine with PlayVoiceChatAudio on the same component.
+	 */
 	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
-		void PlayVoiceChatAudio(TArray<uint8> VoiceData, bool IsCompressed);
+		void PlayVoiceChatAudioFromSender(int32 SenderId, const TArray<uint8>& VoiceData);
+
+	/** Native counterpart of PlayVoiceChatAudioFromSender, the packet is only read during the call */
+	void PlayVoiceChatPacketFromSender(int32 SenderId, TArrayView<const uint8> Packet);
+
+	/** Stop decoding a sender right away instead of waiting for SenderTimeoutSeconds, e.g. when the player leaves */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
+		void RemoveSender(int32 SenderId);
+
+	/** Play packets sent on Channel. Components start out subscribed to every channel. */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Channels")
+		void SubscribeToChannel(int32 Channel);
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Channels")
+		void UnsubscribeFromChannel(int32 Channel);
+	UFUNCTION(BlueprintPure, Category = "VoiceChat|Channels")
+		bool IsSubscribedToChannel(int32 Channel) const;
+	/** Replace every subscription at once, bit N subscribes to channel N */
+	void SetChannelSubscriptions(FVoiceChatChannelMask Channels) { SubscribedChannels = Channels; }
+	FVoiceChatChannelMask GetChannelSubscriptions() const { return SubscribedChannels; }
 
 	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
 		void InitAsListener();
 
+	/**
+	 * Counterpart of InitAsListener: capture and encode only. No decoder, playback queue or sound wave is created
+	 * unless bSidetone is set, and captured packets are never decoded locally.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
+		void InitAsSender();
+
+	/** Initialize as an output of UVoiceChatMixerSubsystem: playback only, fed with already mixed PCM through EnqueueUncompressedData */
+	void InitAsMixBus();
+
+	/** Amount of received audio currently held in the jitter buffer, in milliseconds */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		float GetJitterBufferDepthMs() const;
+	/** Current adaptive jitter buffer delay, in milliseconds */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		float GetJitterBufferTargetDelayMs() const;
+	/** Number of received packets dropped because they arrived after their playout time */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		int32 GetLatePacketCount() const;
+	/** Number of packets that never arrived in time and were skipped */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		int32 GetLostPacketCount() const;
+	/** Number of frames synthesized to cover lost packets */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		int32 GetConcealedFrameCount() const;
+	/** Number of lost packets recovered from the redundant copy in the following packet */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		int32 GetRecoveredPacketCount() const;
+	/** Current clock drift correction of the playout rate, 1 when none */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		float GetPlayoutRate() const;
+	/** Number of quiet frames skipped to bring latency back down */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		int32 GetSkippedFrameCount() const;
+	/** Number of times playback ran dry mid talk spurt and was filled, a jitter buffer delay that is too low shows here first */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		int32 GetUnderflowCount() const;
+	/** Total playback filled by underflows, in milliseconds */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		float GetStarvedMs() const;
+
+	/**
+	 * Report the reception of SenderId, INDEX_NONE for PlayVoiceChatAudio, since the previous report. Send it back to
+	 * that talker about once a second to be handed to its ReceiveReport. Waits for the pipeline.
+	 *
+	 * @return false if nothing is received from SenderId
+	 */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Bitrate")
+		bool GetReceiverReport(int32 SenderId, TArray<uint8>& OutReport);
+	/** Hand a report sent back by one of the listeners of this talker to the adaptive bitrate */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Bitrate")
+		void ReceiveReport(int32 ListenerId, const TArray<uint8>& Report);
+	/** Bitrate this talker may use in the session, e.g. UVoiceChatRelaySubsystem::GetTalkerBitrateBudget. 0 for no limit. */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Bitrate")
+		void SetBitrateBudget(int32 BitsPerSecond);
+	/** Bitrate currently chosen by the adaptive bitrate, 0 when it is off */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat|Bitrate")
+		int32 GetEncoderBitrate() const;
+	/**
+	 * Capture to playout latency of received packets, for the packets whose senders set bTraceLatency
+	 *
+	 * @param Percentile 0-100, e.g. 50, 95 or 99
+	 */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat|Latency")
+		float GetLatencyPercentileMs(EVoiceChatLatencyStage Stage, float Percentile) const;
+	/** Number of traced packets measured since the last ResetLatencyStats */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat|Latency")
+		int32 GetLatencySampleCount() const;
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Latency")
+		void ResetLatencyStats();
+
+	/** Rebuild the capture processing chain from the VoiceChat|Processing settings, done by Init and needed after changing them */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Processing")
+		void ApplyCaptureProcessing();
+	/** Run a custom stage on captured audio, after the high-pass filter, gate and automatic gain and before the limiter */
+	void AddCaptureProcessor(const TSharedRef<IVoiceChatProcessor>& Processor);
+	void RemoveCaptureProcessor(const TSharedRef<IVoiceChatProcessor>& Processor);
+
+	/**
+	 * Record the compressed packets this component sends and receives to Filename, see FVoiceChatRecorder.
+	 * Received packets are recorded under their sender ID, INDEX_NONE for PlayVoiceChatAudio.
+	 *
+	 * @param LocalSpeakerId speaker ID of the packets captured by this component
+	 */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Recording")
+		bool StartRecording(const FString& Filename, int32 LocalSpeakerId);
+	/** Stop recording on this component, the file is finished once no other component records to it either */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Recording")
+		void StopRecording();
+	/** Record to a recorder shared with other components, e.g. every participant of a session into one file */
+	void SetRecorder(const TSharedPtr<FVoiceChatRecorder, ESPMode::ThreadSafe>& InRecorder, int32 LocalSpeakerId);
+	/** Is received audio currently dropped because the component is out of earshot */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		bool IsVoiceCulled() const { return bIsCulled; }
+
+	/**
+	 * Bytes of audio buffers and queues held by this component as of the last completed pipeline run. Scratch buffers
+	 * shared through the per thread arenas are not included, see the Scratch Arenas stat.
+	 */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		int32 GetVoiceMemoryUsage() const { return MemoryUsage; }
+
+	virtual void GetResourceSizeEx(FResourceSizeEx& CumulativeResourceSize) override;
+	virtual void OnUnregister() override;
+	virtual void BeginDestroy() override;
 	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 };
\ No newline at end of file
@@ -0,0 +1,59 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Vectorized kernels over interleaved 16 bit PCM shared by the capture and playback paths.
+ * SSE2 is used on x86, everything else falls back to scalar loops producing identical results. Float to integer
+ * conversions round half way values to even in both, like SSE does in its default rounding mode.
+ */
+namespace VoiceChatDSP
+{
+	/**
+	 * Sum of squared samples and number of sign changes between consecutive frames, per channel
+	 *
+	 * @param Samples interleaved PCM
+	 * @param NumSamples total number of samples across all channels
+	 * @param NumChannels interleave stride used to compare each sample with the previous one of the same channel
+	 * @param OutEnergy sum of Samples[i]^2
+	 * @param OutZeroCrossings number of i where Samples[i] and Samples[i - NumChannels] have different signs
+	 */
+	void ComputeEnergyAndZeroCrossings(const int16* Samples, int32 NumSamples, int32 NumChannels, uint64& OutEnergy, int32& OutZeroCrossings);
+
+	/** Accumulator[i] += Samples[i] * Gain */
+	void MixInt16(const int16* Samples, float Gain, float* Accumulator, int32 NumSamples);
+
+	/** Out[i] = In[i] converted to float, without rescaling */
+	void Int16ToFloat(const int16* In, float* Out, int32 NumSamples);
+
+	/** Out[i] = In[i] rounded to the nearest integer and saturated to the 16 bit range */
+	void FloatToInt16(const float* In, int16* Out, int32 NumSamples);
+
+	/**
+	 * Scale samples in place by a gain moving linearly from StartGain to EndGain across the block, saturating to the
+	 * 16 bit range. Ramping between blocks avoids the clicks of a gain that jumps at block boundaries.
+	 */
+	void ApplyGainRamp(int16* Samples, int32 NumSamples, float StartGain, float EndGain);
+
+	/** Largest absolute sample value, 32768 for a full scale negative sample */
+	int32 ComputePeak(const int16* Samples, int32 NumSamples);
+
+	/** Average the NumChannels channels of every frame of In into one sample of Out. In and Out may not overlap. */
+	void DownmixToMono(const int16* In, int16* Out, int32 NumFrames, int32 NumChannels);
+
+	/** Copy every sample of the mono In to all NumChannels channels of the matching frame of Out. In and Out may not overlap. */
+	void UpmixFromMono(const int16* In, int16* Out, int32 NumFrames, int32 NumChannels);
+
+	/**
+	 * Low-pass filter mono PCM and keep every Factor-th sample: Out[i] = sum of In[i * Factor + k] * Taps[k] / 32768,
+	 * rounded half up and saturated to the 16 bit range.
+	 *
+	 * @param In (NumOut - 1) * Factor + NumTaps samples
+	 * @param Taps filter coefficients in Q15, the sum of their absolute values must stay below 65536
+	 * @param NumTaps a multiple of 8
+	 */
+	void FirDecimate(const int16* In, int16* Out, int32 NumOut, int32 Factor, const int16* Taps, int32 NumTaps);
+}
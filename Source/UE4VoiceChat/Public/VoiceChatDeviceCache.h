@@ -0,0 +1,65 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoiceModule.h"
+
+/** Idle codecs of one format kept around for the next component */
+#define VOICE_MAX_IDLE_CODECS 8
+
+/**
+ * Process wide cache of opened capture devices and codecs.
+ *
+ * Opening a capture device can stall for tens of milliseconds, so components hand their devices and codecs back
+ * here on shutdown instead of destroying them, and the next component initialized with the same format reuses them.
+ * Idle captures are stopped but stay open until Flush, so the platform may keep showing the microphone as in use.
+ * Devices that failed to open are not probed again for a few seconds, unless retried with RetryDevice.
+ *
+ * Thread safe. Get must first be called on the game thread, the Voice module can only be loaded there.
+ */
+class UE4VOICECHAT_API FVoiceChatDeviceCache
+{
+public:
+
+	static FVoiceChatDeviceCache& Get();
+	/** Shut down everything cached, on module shutdown while the Voice module is still loaded */
+	static void Destroy();
+
+	/** Reuse an idle capture device of this format or open a new one, null if the device cannot be opened */
+	TSharedPtr<IVoiceCapture> AcquireCapture(const FString& DeviceName, int32 SampleRate, int32 NumChannels);
+	/** Stop a capture from AcquireCapture and keep it open for the next component, until Flush */
+	void ReleaseCapture(const TSharedPtr<IVoiceCapture>& Capture, const FString& DeviceName, int32 SampleRate, int32 NumChannels);
+
+	TSharedPtr<IVoiceEncoder> AcquireEncoder(int32 SampleRate, int32 NumChannels, EAudioEncodeHint EncodeHint);
+	/** Reset an encoder from AcquireEncoder and keep it for the next component */
+	void ReleaseEncoder(const TSharedPtr<IVoiceEncoder>& Encoder, int32 SampleRate, int32 NumChannels, EAudioEncodeHint EncodeHint);
+
+	TSharedPtr<IVoiceDecoder> AcquireDecoder(int32 SampleRate, int32 NumChannels);
+	/** Reset a decoder from AcquireDecoder and keep it for the next component */
+	void ReleaseDecoder(const TSharedPtr<IVoiceDecoder>& Decoder, int32 SampleRate, int32 NumChannels);
+
+	/** False if opening the device failed recently and it is not probed again yet */
+	bool IsDeviceAvailable(const FString& DeviceName) const;
+	/** Probe the device again on the next AcquireCapture even if it failed recently, e.g. when the user picks it */
+	void RetryDevice(const FString& DeviceName);
+
+	/** Shut down every idle device and codec and forget failed devices, e.g. after devices were plugged in */
+	void Flush();
+
+private:
+
+	FVoiceChatDeviceCache();
+
+	static FString GetCaptureKey(const FString& DeviceName, int32 SampleRate, int32 NumChannels);
+
+	FVoiceModule& VoiceModule;
+
+	mutable FCriticalSection Lock;
+	TMap<FString, TArray<TSharedPtr<IVoiceCapture>>> IdleCaptures;
+	TMap<uint64, TArray<TSharedPtr<IVoiceEncoder>>> IdleEncoders;
+	TMap<uint64, TArray<TSharedPtr<IVoiceDecoder>>> IdleDecoders;
+	/** Devices that failed to open and when they did */
+	TMap<FString, double> FailedDevices;
+};
@@ -0,0 +1,89 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Converts a stream of interleaved 16 bit PCM between sample rates and channel counts.
+ *
+ * Channels are reduced before resampling and expanded after it, so the resampler always works on the smaller of the
+ * two channel counts. Downmix and upmix use the vectorized VoiceChatDSP kernels. Mono audio going down by an integer
+ * factor, like 48 kHz capture to a 24 or 16 kHz profile, is low-pass filtered and decimated by VoiceChatDSP::FirDecimate
+ * so nothing above the new Nyquist frequency aliases into the speech. Any other rate change, and the small trim of
+ * SetRateRatio, is linear interpolation with its phase carried across calls, which is plenty for speech coming out of
+ * the codec. Only mono <-> multichannel conversions are supported besides passthrough.
+ *
+ * The playout rate can be nudged away from 1 to make up for clock drift between sender and receiver, the resampler
+ * then runs even if the formats match.
+ */
+class FVoiceChatFormatConverter
+{
+public:
+
+	FVoiceChatFormatConverter();
+
+	void Init(int32 InInputSampleRate, int32 InInputChannels, int32 InOutputSampleRate, int32 InOutputChannels);
+
+	/** Forget the resampler history, e.g. at the start of a new talk spurt */
+	void Reset();
+
+	/**
+	 * Consume input Ratio times as fast as the formats alone would, slightly raising or lowering the pitch.
+	 * Above 1 produces fewer output frames. Applies from the next Convert.
+	 */
+	void SetRateRatio(double Ratio);
+
+	double GetRateRatio() const { return RateRatio; }
+
+	/** Do input and output formats match at the nominal rate, Convert is then a plain copy */
+	bool IsPassthrough() const { return InputSampleRate == OutputSampleRate && InputChannels == OutputChannels && RateRatio == 1.0; }
+
+	/**
+	 * Convert NumFrames frames of In, replacing the content of Out
+	 *
+	 * @return number of frames written to Out
+	 */
+	int32 Convert(const int16* In, int32 NumFrames, TArray<int16>& Out);
+
+	/** Upper bound of the frames Convert produces for NumFrames input frames */
+	int32 GetMaxOutputFrames(int32 NumFrames) const;
+
+	int32 GetOutputChannels() const { return OutputChannels; }
+
+private:
+
+	/** Resample NumFrames frames of Channels channels from In, appending to Out */
+	void Resample(const int16* In, int32 NumFrames, int32 Channels, TArray<int16>& Out);
+	/** Filter and decimate NumFrames mono frames of In by DecimationFactor, replacing the content of Out */
+	void Decimate(const int16* In, int32 NumFrames, TArray<int16>& Out);
+
+	int32 InputSampleRate;
+	int32 InputChannels;
+	int32 OutputSampleRate;
+	int32 OutputChannels;
+
+	/** Integer factor the input is decimated by before any interpolation, 1 when not decimating */
+	int32 DecimationFactor;
+	/** Q15 low-pass taps of the decimator */
+	TArray<int16> DecimatorTaps;
+	/** Input the decimator has not consumed yet, starts with the last NumTaps - 1 samples of the previous block */
+	TArray<int16> DecimatorInput;
+	/** Decimator output waiting for interpolation or upmix */
+	TArray<int16> Decimated;
+
+	/** Input frames advanced per output frame at the nominal rate, after decimation */
+	double BaseStep;
+	/** Playout rate correction, see SetRateRatio */
+	double RateRatio;
+	/** Input frames advanced per output frame */
+	double Step;
+	/** Position of the next output frame relative to the first frame of the next input block, -1 is the last frame of the previous block */
+	double Phase;
+	/** Last frame of the previous input block */
+	TArray<int16> History;
+
+	/** Downmixed or resampled intermediate audio */
+	TArray<int16> Scratch;
+};
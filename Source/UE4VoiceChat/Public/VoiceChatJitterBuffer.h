@@ -0,0 +1,146 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoiceChatPacket.h"
+
+/** Snapshot of the jitter buffer state, safe to read while the buffer itself is being serviced on another thread */
+struct FVoiceChatJitterBufferStats
+{
+	float DepthMs = 0.0f;
+	float TargetDelayMs = 0.0f;
+	float JitterMs = 0.0f;
+	/** Packets handed to Insert, late and duplicate ones included */
+	int32 ReceivedCount = 0;
+	int32 LateCount = 0;
+	int32 LostCount = 0;
+	int32 DroppedCount = 0;
+	/** Frames synthesized by loss concealment, filled in by FVoiceChatStream */
+	int32 ConcealedCount = 0;
+	/** Lost packets recovered from the redundant copy carried by the next packet, filled in by FVoiceChatStream */
+	int32 RecoveredCount = 0;
+	/** Current clock drift correction of the playout rate, 1 when none. Filled in by FVoiceChatStream. */
+	float PlayoutRate = 1.0f;
+	/** Quiet frames skipped to bring latency back down, filled in by FVoiceChatStream */
+	int32 SkippedCount = 0;
+};
+
+/**
+ * Receive side jitter buffer for compressed voice packets.
+ *
+ * Packets are reordered by sequence number and held back until enough audio is buffered to ride out
+ * the measured inter-arrival jitter. Packets arriving after their turn are dropped as late, holes that
+ * are still open when playback needs the next packet are skipped as lost, and the oldest packets are
+ * dropped whenever the total buffered latency grows past the configured bound. A silence marker ends the
+ * current talk spurt, the next one is prebuffered again.
+ */
+class FVoiceChatJitterBuffer
+{
+public:
+
+	FVoiceChatJitterBuffer();
+
+	/**
+	 * Set the sample rate used to convert packet timestamps and the bounds of the adaptive target delay.
+	 * Resets the buffer.
+	 */
+	void Configure(int32 InSampleRate, float InMinDelayMs, float InMaxDelayMs, float InMaxLatencyMs);
+
+	/**
+	 * Drop all buffered packets and wait for a new prebuffer before releasing packets again. The next packet is accepted
+	 * whatever its sequence number. Counters are kept.
+	 */
+	void Reset();
+
+	/** Forget the arrival timing and the jitter estimate, for a stream resuming after a pause. Counters are kept. */
+	void ResetTiming();
+
+	/**
+	 * Add a received packet
+	 *
+	 * @param Header parsed header of the packet
+	 * @param Payload compressed data following the header
+	 * @param PayloadSize size of Payload in bytes
+	 * @param ArrivalTime time the packet was received, in seconds
+	 * @return false if the packet was dropped as late or duplicate
+	 */
+	bool Insert(const FVoiceChatPacketHeader& Header, const uint8* Payload, int32 PayloadSize, double ArrivalTime);
+
+	/**
+	 * Release the next packet for decoding if playback needs it
+	 *
+	 * @param QueuedMs amount of already decoded audio waiting to be played
+	 * @param OutHeader header of the released packet
+	 * @param OutPayload receives the compressed data of the released packet, its previous storage is recycled
+	 * @param OutNumLost number of packets given up as lost right before the released one, to be concealed by the caller
+	 * @param OutArrivalTime time the released packet was inserted with
+	 * @return true if a packet was released, call again until it returns false
+	 */
+	bool Pop(float QueuedMs, FVoiceChatPacketHeader& OutHeader, TArray<uint8>& OutPayload, int32& OutNumLost, double& OutArrivalTime);
+
+	/** Is a talk spurt being played out, false while prebuffering */
+	bool IsPlaying() const { return bPlaying; }
+	/** Amount of audio currently held in the buffer, in milliseconds */
+	float GetDepthMs() const;
+	/** Current adaptive target delay, in milliseconds */
+	float GetTargetDelayMs() const { return TargetDelayMs; }
+	/** Smoothed inter-arrival jitter estimate, in milliseconds */
+	float GetJitterMs() const { return JitterMs; }
+	/** Number of packets handed to Insert */
+	int32 GetReceivedCount() const { return ReceivedCount; }
+	/** Number of packets that arrived after their playout time */
+	int32 GetLateCount() const { return LateCount; }
+	/** Number of packets that never arrived in time and were skipped */
+	int32 GetLostCount() const { return LostCount; }
+	/** Number of packets dropped to keep latency bounded */
+	int32 GetDroppedCount() const { return DroppedCount; }
+	/** Copy of all of the above */
+	FVoiceChatJitterBufferStats GetStats() const;
+
+private:
+
+	struct FSlot
+	{
+		FVoiceChatPacketHeader Header;
+		TArray<uint8> Payload;
+		double ArrivalTime = 0.0;
+	};
+
+	/** Convert a sample count at the configured sample rate to milliseconds */
+	float SamplesToMs(int32 NumSamples) const;
+	/** Remove the first slot, recycling its payload storage */
+	void RemoveFront(FVoiceChatPacketHeader& OutHeader, TArray<uint8>& OutPayload);
+	/** Recompute the target delay from the current jitter estimate */
+	void UpdateTargetDelay();
+
+	/** Buffered packets, sorted by sequence number */
+	TArray<FSlot> Slots;
+	/** Payload storage of released packets, reused by Insert */
+	TArray<TArray<uint8>> FreePayloads;
+	/** Sample rate of the packet timestamps */
+	int32 SampleRate;
+
+	float MinDelayMs;
+	float MaxDelayMs;
+	float MaxLatencyMs;
+	float TargetDelayMs;
+
+	/** Is a talk spurt currently being played out */
+	bool bPlaying;
+	/** Sequence number expected next by playback, kept across talk spurts so their stragglers still count as late */
+	uint16 NextSequence;
+	/** Has NextSequence been set since the last Reset */
+	bool bHasNextSequence;
+
+	/** Transit time of the previous packet, used for the jitter estimate */
+	double LastTransitMs;
+	bool bHasLastTransit;
+	float JitterMs;
+
+	int32 ReceivedCount;
+	int32 LateCount;
+	int32 LostCount;
+	int32 DroppedCount;
+};
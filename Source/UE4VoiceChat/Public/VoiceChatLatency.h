@@ -0,0 +1,93 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoiceChatLatency.generated.h"
+
+/** Width of a latency histogram bin */
+#define VOICE_LATENCY_BIN_MS 1.0f
+/** Number of latency histogram bins, anything slower lands in the last one */
+#define VOICE_LATENCY_NUM_BINS 1000
+
+/** Part of the capture to playout path measured by FVoiceChatLatencyTracker */
+UENUM(BlueprintType)
+enum class EVoiceChatLatencyStage : uint8
+{
+	/** First captured sample of a packet to the packet being sent: packetization and encode */
+	Send,
+	/** Packet sent to packet received. Between machines this is only as accurate as the server clock sync. */
+	Network,
+	/** Packet received to packet decoded, time spent in the jitter buffer */
+	JitterBuffer,
+	/** Packet decoded to its audio being handed to the procedural wave */
+	Playback,
+	/** First captured sample to its playout */
+	Total,
+	Num UMETA(Hidden),
+};
+
+/** One traced packet on its way through the receive side, see EVoiceChatPacketFlags::Traced */
+struct FVoiceChatLatencyMark
+{
+	/** Playback queue position of the first decoded byte of the packet, see TVoiceChatRingBuffer::GetPushedCount */
+	uint32 QueuePosition = 0;
+	/** Capture time of the packet's first sample on the sender, in shared clock milliseconds */
+	uint32 CaptureTimeMs = 0;
+	/** Time from capture to the packet being sent, in milliseconds */
+	uint16 SendDelayMs = 0;
+	/** Local FPlatformTime::Seconds the packet was received, decoded and played at */
+	double ArrivalTime = 0.0;
+	double DecodeTime = 0.0;
+	double PlayoutTime = 0.0;
+};
+
+/** Fixed bin latency histogram, storage is only allocated by the first Add */
+class FVoiceChatLatencyHistogram
+{
+public:
+
+	void Add(float Ms);
+
+	/** Latency below which Percentile (0-100) percent of the samples fall, upper edge of the bin. 0 without samples. */
+	float GetPercentile(float Percentile) const;
+
+	int32 GetCount() const { return Count; }
+
+	void Reset();
+
+private:
+
+	TArray<uint32> Bins;
+	int32 Count = 0;
+};
+
+/** Per stage latency histograms of the traced packets played by a component */
+class FVoiceChatLatencyTracker
+{
+public:
+
+	/**
+	 * Add a played packet
+	 *
+	 * @param ClockOffsetSeconds shared clock minus local FPlatformTime::Seconds, converts local times to the sender's clock
+	 */
+	void Record(const FVoiceChatLatencyMark& Mark, double ClockOffsetSeconds);
+
+	float GetPercentileMs(EVoiceChatLatencyStage Stage, float Percentile) const;
+
+	int32 GetNumSamples() const;
+
+	void Reset();
+
+	/** p50/p95/p99 of every stage on one line, for logging */
+	FString ToString() const;
+
+	/** Convert a local FPlatformTime::Seconds to shared clock milliseconds as carried in packets */
+	static uint32 ToSharedMs(double LocalSeconds, double ClockOffsetSeconds);
+
+private:
+
+	FVoiceChatLatencyHistogram Histograms[(int32)EVoiceChatLatencyStage::Num];
+};
@@ -0,0 +1,137 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoiceChatRingBuffer.h"
+
+/** Pooled queues are never shrunk below this much audio to fit the budget, less would overflow at the jitter buffer's delays */
+#define VOICE_MIN_QUEUE_MS 500
+
+/**
+ * Scratch memory valid until the scope ends, carved out of an arena owned by the calling thread.
+ *
+ * Encode and decode buffers are only needed for the duration of a call, so instead of every component and stream
+ * holding its own, every thread running a pipeline keeps one arena that all of them share. The arena grows to the
+ * deepest use seen on its thread and keeps its blocks until the thread exits. Scopes nest, and must be destroyed in
+ * reverse order of creation on the thread that created them.
+ */
+class UE4VOICECHAT_API FVoiceChatScratchScope
+{
+public:
+
+	FVoiceChatScratchScope();
+	~FVoiceChatScratchScope();
+
+	FVoiceChatScratchScope(const FVoiceChatScratchScope&) = delete;
+	FVoiceChatScratchScope& operator=(const FVoiceChatScratchScope&) = delete;
+
+	/** NumBytes of uninitialized memory, 16 byte aligned */
+	TArrayView<uint8> Allocate(int32 NumBytes);
+
+	/** Bytes held by the arenas of every thread */
+	static int64 GetTotalArenaSize();
+
+private:
+
+	int32 MarkBlock;
+	int32 MarkOffset;
+};
+
+/**
+ * Process wide pool of playback queue storage with a total memory budget, set with voicechat.QueueBudgetKB.
+ *
+ * Queues are sized for the worst case but mostly sit idle, so with many talkers their storage is bounded as a whole:
+ * while the budget is exceeded, idle storage returned by released queues is freed first, then new queues get a smaller
+ * capacity, down to VOICE_MIN_QUEUE_MS of audio. Storage is kept by power of two size for the next queue.
+ *
+ * Thread safe.
+ */
+class UE4VOICECHAT_API FVoiceChatQueuePool
+{
+public:
+
+	static FVoiceChatQueuePool& Get();
+
+	/**
+	 * Storage for DesiredBytes, or less but at least MinBytes while over budget. Both are rounded up to a power of two.
+	 * Only goes over budget for MinBytes.
+	 */
+	TArray<uint8> Acquire(uint32 DesiredBytes, uint32 MinBytes);
+	/** Take back storage of AcquiredBytes from Acquire, kept for reuse if the budget allows */
+	void Release(TArray<uint8>&& Storage, uint32 AcquiredBytes);
+
+	/** Free every idle storage */
+	void Trim();
+
+	/** Budget in bytes, 0 for no limit */
+	int64 GetBudget() const;
+	/** Bytes held by the pool, in use or idle */
+	int64 GetAllocatedBytes() const;
+	/** Bytes held by queues */
+	int64 GetUsedBytes() const;
+
+	FString ToString() const;
+
+private:
+
+	FVoiceChatQueuePool();
+
+	/** Free idle storage until BytesNeeded are freed or none is left. Lock must be held. */
+	void FreeIdle(int64 BytesNeeded);
+	void UpdateStats() const;
+
+	mutable FCriticalSection Lock;
+	TMap<uint32, TArray<TArray<uint8>>> Idle;
+	int64 AllocatedBytes;
+	int64 UsedBytes;
+	bool bWarnedOverBudget;
+};
+
+/** Byte queue with its storage from FVoiceChatQueuePool, given back on Release or destruction */
+class UE4VOICECHAT_API FVoiceChatPooledQueue : public TVoiceChatRingBuffer<uint8>
+{
+public:
+
+	FVoiceChatPooledQueue() :
+		PooledBytes(0)
+	{
+	}
+
+	~FVoiceChatPooledQueue()
+	{
+		Release();
+	}
+
+	/**
+	 * Replace the storage with DesiredBytes from the pool, or less but at least MinBytes while the pool is over budget.
+	 * Not thread safe, neither side may be active, see Release.
+	 *
+	 * @return the new capacity
+	 */
+	uint32 Acquire(uint32 DesiredBytes, uint32 MinBytes)
+	{
+		Release();
+		SetStorage(FVoiceChatQueuePool::Get().Acquire(DesiredBytes, MinBytes));
+		PooledBytes = Capacity();
+		return PooledBytes;
+	}
+
+	/**
+	 * Give the storage back to the pool. Not thread safe, neither side may be active: the pool may hand the storage to
+	 * another queue right away, so a consumer still reading regions from Peek must have finished, not merely been told to stop.
+	 */
+	void Release()
+	{
+		if (PooledBytes > 0 || Capacity() > 0)
+		{
+			FVoiceChatQueuePool::Get().Release(TakeStorage(), PooledBytes);
+			PooledBytes = 0;
+		}
+	}
+
+private:
+
+	uint32 PooledBytes;
+};
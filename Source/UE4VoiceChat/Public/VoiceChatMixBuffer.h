@@ -0,0 +1,60 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoiceChatRingBuffer.h"
+
+/**
+ * Sums the decoded queues of several talkers into one block of 16 bit PCM.
+ *
+ *	Mix.Begin(NumFrames, NumChannels);
+ *	for each talker: Mix.Add(Talker.Queue, Talker.Gain);
+ *	Output.Push(Mix.Finish(), Mix.GetNumBytes());
+ *
+ * Talkers with less than NumFrames queued are padded with silence. Scratch storage is kept between mixes.
+ */
+class FVoiceChatMixBuffer
+{
+public:
+
+	FVoiceChatMixBuffer();
+
+	/** Start a new mix of NumFrames frames, interleaved with NumChannels channels */
+	void Begin(int32 InNumFrames, int32 InNumChannels);
+
+	/**
+	 * Pop up to NumFrames frames from Queue and add them to the mix
+	 *
+	 * @return number of frames taken from Queue
+	 */
+	int32 Add(TVoiceChatRingBuffer<uint8>& Queue, float Gain);
+
+	/** Saturate the mix to 16 bit, valid until the next Begin */
+	const uint8* Finish();
+
+	int32 GetNumFrames() const { return NumFrames; }
+	uint32 GetNumBytes() const { return NumFrames * NumChannels * sizeof(int16); }
+
+	/** Release scratch storage */
+	void Empty();
+
+	/** Number of whole frames queued in a queue of 16 bit PCM with NumChannels channels */
+	static int32 GetQueuedFrames(const TVoiceChatRingBuffer<uint8>& Queue, int32 NumChannels)
+	{
+		return Queue.Num() / (NumChannels * sizeof(int16));
+	}
+
+private:
+
+	/** Float accumulator the talkers are summed into */
+	TArray<float> Accumulator;
+	/** Talker audio popped from its queue before mixing */
+	TArray<int16> TalkerBuffer;
+	/** Final 16 bit mix */
+	TArray<int16> OutputBuffer;
+
+	int32 NumFrames;
+	int32 NumChannels;
+};
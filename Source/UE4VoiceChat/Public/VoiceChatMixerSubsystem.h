@@ -0,0 +1,145 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "VoiceChatStream.h"
+#include "VoiceChatRingBuffer.h"
+#include "VoiceChatMemory.h"
+#include "VoiceChatMixBuffer.h"
+#include "VoiceChatProfile.h"
+#include "VoiceChatMixerSubsystem.generated.h"
+
+class UVoiceChatComponent;
+
+/**
+ * Optional receive path for sessions with many remote talkers.
+ *
+ * Instead of one UVoiceChatComponent per talker, packets of every talker are handed to this subsystem keyed by
+ * a talker id. Each talker gets a jitter buffer and a decoder, and the decoded streams are summed with per talker
+ * gain into a small number of bus components, each playing a single procedural wave.
+ *
+ * Buses are 2D by default. A talker that is alone on its bus can be given a world location with SetTalkerLocation,
+ * which moves and spatializes the bus, so nearby or important talkers can keep positional audio on dedicated buses
+ * while everybody else shares the remaining ones.
+ */
+UCLASS()
+class UE4VOICECHAT_API UVoiceChatMixerSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+
+	UVoiceChatMixerSubsystem();
+
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override { return Buses.Num() > 0; }
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+
+	/** Create the bus components. Talkers already added keep their bus if it still exists, otherwise they move to bus 0. */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
+		void InitMixer(int32 NumBuses = 1);
+
+	/** Release every talker and bus */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
+		void ShutdownMixer();
+
+	/** Add a packet received from TalkerId, as broadcast by the talker's OnAudioCaptureCompleted. The talker is created on first use. */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
+		void PlayTalkerAudio(int32 TalkerId, const TArray<uint8>& VoiceData);
+
+	void PlayTalkerPacket(int32 TalkerId, TArrayView<const uint8> Packet);
+
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
+		void SetTalkerGain(int32 TalkerId, float Gain);
+
+	/** Route a talker to another bus, out of range indices are clamped */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
+		void SetTalkerBus(int32 TalkerId, int32 BusIndex);
+
+	/**
+	 * Spatialize a talker at Location. Only possible while the talker is the only one on its bus, since a bus
+	 * is a single sound source. Returns false if other talkers share the bus, the talker is then played 2D until
+	 * it is alone on its bus again, which spatializes the bus at the last location given.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
+		bool SetTalkerLocation(int32 TalkerId, FVector Location);
+
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat")
+		void RemoveTalker(int32 TalkerId);
+
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		UVoiceChatComponent* GetBus(int32 BusIndex) const;
+
+	UFUNCTION(BlueprintPure, Category = "VoiceChat")
+		int32 GetNumTalkers() const { return Talkers.Num(); }
+
+	/** How far ahead of playback the buses are mixed. Lower means less latency but more risk of a bus starving between ticks. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		float MixAheadMs;
+
+	/** Format the talkers encode in, must match their components' VoiceProfile */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		EVoiceChatProfile VoiceProfile;
+
+	/** Talkers that sent nothing for this long are removed and their decoder released */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat")
+		float TalkerTimeoutSeconds;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|JitterBuffer")
+		float JitterBufferMinDelayMs;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|JitterBuffer")
+		float JitterBufferMaxDelayMs;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VoiceChat|JitterBuffer")
+		float MaxPlayoutLatencyMs;
+
+private:
+
+	struct FTalker
+	{
+		FVoiceChatStream Stream;
+		/** Format of the stream's decoder, to give it back to the device cache */
+		FVoiceChatCodecFormat Format = {};
+		/** Decoded audio waiting to be mixed */
+		FVoiceChatPooledQueue Queue;
+		float Gain = 1.0f;
+		int32 BusIndex = 0;
+		double LastPacketTime = 0.0;
+		/** Last location given to SetTalkerLocation, used whenever the talker is alone on its bus */
+		FVector Location = FVector::ZeroVector;
+		bool bHasLocation = false;
+	};
+
+	FTalker* FindOrAddTalker(int32 TalkerId);
+	/** Shut the talker's stream down and hand its decoder back to the device cache */
+	void ReleaseTalker(FTalker& Talker);
+	/**
+	 * Spatialize the bus at its talker's location if it has exactly one talker with a location, play it 2D otherwise.
+	 * Called by everything that adds, moves or removes talkers.
+	 */
+	void UpdateBusSpatialization(int32 BusIndex);
+	/** Mix up to NumFrames frames of every talker on BusIndex into the bus, returns the number of frames mixed */
+	int32 MixBus(int32 BusIndex, int32 NumFrames);
+	/** Let the bus fill playback running dry only while one of its talkers is in the middle of a talk spurt */
+	void UpdateBusTalkSpurt(int32 BusIndex);
+	float BytesToMs(int32 NumBytes) const;
+
+	UPROPERTY(Transient)
+		TArray<UVoiceChatComponent*> Buses;
+
+	TMap<int32, TUniquePtr<FTalker>> Talkers;
+
+	/** Scratch for mixing, one bus at a time */
+	FVoiceChatMixBuffer Mix;
+
+	int32 SampleRate;
+	int32 NumChannels;
+};
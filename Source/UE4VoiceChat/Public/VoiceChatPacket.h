@@ -0,0 +1,222 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Number of voice channels, a packet's channel ID is below this */
+#define VOICE_MAX_CHANNELS 64
+
+/** Set of voice channels, bit N stands for channel N */
+typedef uint64 FVoiceChatChannelMask;
+
+/** Subscribed to every channel */
+#define VOICE_ALL_CHANNELS (~(FVoiceChatChannelMask)0)
+
+/** Mask with only Channel set, Channel must be below VOICE_MAX_CHANNELS */
+inline FVoiceChatChannelMask VoiceChatChannelBit(uint8 Channel)
+{
+	checkSlow(Channel < VOICE_MAX_CHANNELS);
+	return (FVoiceChatChannelMask)1 << Channel;
+}
+
+enum class EVoiceChatPacketFlags : uint8
+{
+	None = 0,
+	/** The talker stopped speaking, no payload. Playback ends the talk spurt instead of waiting for more audio. */
+	Silence = 1 << 0,
+	/**
+	 * The payload starts with a copy of the previous packet's payload so a single lost packet can be recovered.
+	 * Layout: [RedundantSize u16][redundant payload][primary payload]
+	 */
+	Redundant = 1 << 1,
+	/** The header is followed by [CaptureTimeMs u32][SendDelayMs u16] for latency measurement, see FVoiceChatLatencyTracker */
+	Traced = 1 << 2,
+};
+ENUM_CLASS_FLAGS(EVoiceChatPacketFlags);
+
+/**
+ * Header prepended to every compressed packet broadcast through OnAudioCaptureCompleted
+ * and expected by PlayVoiceChatAudio. All fields are little endian.
+ */
+struct FVoiceChatPacketHeader
+{
+	/** Serialized size of the header in bytes, without the trace fields */
+	static const int32 Size = 10;
+	/** Serialized size of the trace fields of Traced packets */
+	static const int32 TraceSize = 6;
+
+	EVoiceChatPacketFlags Flags;
+	/** Incremented by one for every packet sent by a component */
+	uint16 Sequence;
+	/** Capture clock of the first sample in the packet, in samples since capture started */
+	uint32 Timestamp;
+	/** Number of samples per channel the packet decodes to */
+	uint16 NumSamples;
+	/** Voice channel the packet is sent on, below VOICE_MAX_CHANNELS. Routing only needs this byte, see ReadChannel. */
+	uint8 Channel;
+	/** Traced packets only: capture time of the first sample on the shared clock, in milliseconds */
+	uint32 CaptureTimeMs;
+	/** Traced packets only: time from capture of the first sample to the packet being sent, in milliseconds */
+	uint16 SendDelayMs;
+
+	FVoiceChatPacketHeader()
+		: Flags(EVoiceChatPacketFlags::None)
+		, Sequence(0)
+		, Timestamp(0)
+		, NumSamples(0)
+		, Channel(0)
+		, CaptureTimeMs(0)
+		, SendDelayMs(0)
+	{
+	}
+
+	/** Serialized size of this header in bytes, the payload starts right after */
+	int32 GetSize() const
+	{
+		return EnumHasAnyFlags(Flags, EVoiceChatPacketFlags::Traced) ? Size + TraceSize : Size;
+	}
+
+	/** Write the header to the first GetSize() bytes of OutData */
+	void Write(uint8* OutData) const
+	{
+		OutData[0] = (uint8)Flags;
+		OutData[1] = (uint8)(Sequence);
+		OutData[2] = (uint8)(Sequence >> 8);
+		OutData[3] = (uint8)(Timestamp);
+		OutData[4] = (uint8)(Timestamp >> 8);
+		OutData[5] = (uint8)(Timestamp >> 16);
+		OutData[6] = (uint8)(Timestamp >> 24);
+		OutData[7] = (uint8)(NumSamples);
+		OutData[8] = (uint8)(NumSamples >> 8);
+		OutData[9] = Channel;
+
+		if (EnumHasAnyFlags(Flags, EVoiceChatPacketFlags::Traced))
+		{
+			OutData[10] = (uint8)(CaptureTimeMs);
+			OutData[11] = (uint8)(CaptureTimeMs >> 8);
+			OutData[12] = (uint8)(CaptureTimeMs >> 16);
+			OutData[13] = (uint8)(CaptureTimeMs >> 24);
+			OutData[14] = (uint8)(SendDelayMs);
+			OutData[15] = (uint8)(SendDelayMs >> 8);
+		}
+	}
+
+	/**
+	 * Read the header from the start of InData
+	 *
+	 * @return false if InData is too small to contain a header or the channel is invalid
+	 */
+	bool Read(const uint8* InData, int32 InDataSize)
+	{
+		if (InDataSize < Size)
+		{
+			return false;
+		}
+
+		Flags = (EVoiceChatPacketFlags)InData[0];
+		Sequence = (uint16)InData[1] | ((uint16)InData[2] << 8);
+		Timestamp = (uint32)InData[3] | ((uint32)InData[4] << 8) | ((uint32)InData[5] << 16) | ((uint32)InData[6] << 24);
+		NumSamples = (uint16)InData[7] | ((uint16)InData[8] << 8);
+		Channel = InData[9];
+		if (Channel >= VOICE_MAX_CHANNELS)
+		{
+			return false;
+		}
+
+		if (EnumHasAnyFlags(Flags, EVoiceChatPacketFlags::Traced))
+		{
+			if (InDataSize < Size + TraceSize)
+			{
+				return false;
+			}
+			CaptureTimeMs = (uint32)InData[10] | ((uint32)InData[11] << 8) | ((uint32)InData[12] << 16) | ((uint32)InData[13] << 24);
+			SendDelayMs = (uint16)InData[14] | ((uint16)InData[15] << 8);
+		}
+		return true;
+	}
+
+	/**
+	 * Read only the channel of a packet, for routing it without parsing the rest
+	 *
+	 * @return false if InData is too small to contain a header or the channel is invalid, it comes from the network
+	 */
+	static bool ReadChannel(const uint8* InData, int32 InDataSize, uint8& OutChannel)
+	{
+		if (InDataSize < Size || InData[9] >= VOICE_MAX_CHANNELS)
+		{
+			return false;
+		}
+		OutChannel = InData[9];
+		return true;
+	}
+
+	/**
+	 * Split the payload following the header into the primary payload and, for Redundant packets, the copy of the previous one
+	 *
+	 * @return false if the redundancy prefix is malformed
+	 */
+	bool SplitPayload(TArrayView<const uint8> Payload, TArrayView<const uint8>& OutPrimary, TArrayView<const uint8>& OutRedundant) const
+	{
+		OutPrimary = Payload;
+		OutRedundant = TArrayView<const uint8>();
+		if (!EnumHasAnyFlags(Flags, EVoiceChatPacketFlags::Redundant))
+		{
+			return true;
+		}
+
+		if (Payload.Num() < 2)
+		{
+			return false;
+		}
+		const int32 RedundantSize = (int32)Payload[0] | ((int32)Payload[1] << 8);
+		if (Payload.Num() < 2 + RedundantSize)
+		{
+			return false;
+		}
+		OutRedundant = TArrayView<const uint8>(Payload.GetData() + 2, RedundantSize);
+		OutPrimary = TArrayView<const uint8>(Payload.GetData() + 2 + RedundantSize, Payload.Num() - 2 - RedundantSize);
+		return true;
+	}
+
+	/** Signed distance from B to A, handling wrap around of the 16 bit sequence number */
+	static int32 SequenceDelta(uint16 A, uint16 B)
+	{
+		return (int16)(A - B);
+	}
+};
+
+/** An encoded packet, header included, shared between every listener it is handed to */
+struct FVoiceChatPacket
+{
+	TArray<uint8> Data;
+};
+
+typedef TSharedRef<FVoiceChatPacket, ESPMode::ThreadSafe> FVoiceChatPacketRef;
+typedef TSharedPtr<FVoiceChatPacket, ESPMode::ThreadSafe> FVoiceChatPacketPtr;
+
+/**
+ * Recycles packet buffers. A pooled packet is free again as soon as nobody but the pool references it,
+ * so listeners may keep a packet as long as they like without ever copying it.
+ * Acquire must only be called from one thread at a time.
+ */
+class FVoiceChatPacketPool
+{
+public:
+
+	explicit FVoiceChatPacketPool(int32 InMaxPooledPackets = 16);
+
+	/** Returns a packet referenced by nobody else with Data sized to Size bytes */
+	FVoiceChatPacketRef Acquire(int32 Size);
+
+	/** Release every pooled packet, packets still referenced elsewhere stay alive until they are released */
+	void Empty();
+
+private:
+
+	TArray<FVoiceChatPacketRef> Packets;
+	/** Where the search for a free packet starts, packets are usually released in the order they were acquired */
+	int32 NextIndex;
+	int32 MaxPooledPackets;
+};
@@ -0,0 +1,207 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * One stage of the capture processing chain, run in place on interleaved 16 bit PCM in the codec format.
+ * Stages run on whichever thread runs the capture pipeline, one block at a time and always in order.
+ */
+class UE4VOICECHAT_API IVoiceChatProcessor
+{
+public:
+
+	virtual ~IVoiceChatProcessor() {}
+
+	/** Name shown in the per stage timings */
+	virtual const TCHAR* GetName() const = 0;
+
+	/** Prepare for audio in this format and forget any state from previous audio */
+	virtual void Configure(int32 SampleRate, int32 NumChannels) = 0;
+
+	/** Process NumFrames frames of interleaved PCM in place */
+	virtual void Process(int16* Samples, int32 NumFrames) = 0;
+};
+
+/** Time spent in one stage of a FVoiceChatProcessorChain */
+struct FVoiceChatProcessorStats
+{
+	const TCHAR* Name = nullptr;
+	/** Total time spent in the stage */
+	double Milliseconds = 0.0;
+	/** Number of processed blocks */
+	int32 NumBlocks = 0;
+	/** Duration of the audio processed */
+	double AudioMilliseconds = 0.0;
+};
+
+/**
+ * Ordered chain of processing stages on the capture path, between the capture device and the encoder.
+ * Every stage is timed separately, see GetStats. Not thread safe: change the chain only while the capture pipeline
+ * is idle.
+ */
+class UE4VOICECHAT_API FVoiceChatProcessorChain
+{
+public:
+
+	FVoiceChatProcessorChain();
+
+	/** Append a stage, configured right away if the chain already is */
+	void Add(const TSharedRef<IVoiceChatProcessor>& Processor);
+	void Remove(const TSharedRef<IVoiceChatProcessor>& Processor);
+	void Empty();
+	bool IsEmpty() const { return Stages.Num() == 0; }
+
+	/** Configure every stage and reset the timings */
+	void Configure(int32 InSampleRate, int32 InNumChannels);
+
+	/** Run every stage in order on NumFrames frames of interleaved PCM, in place */
+	void Process(int16* Samples, int32 NumFrames);
+
+	/** Timings of every stage in chain order */
+	TArray<FVoiceChatProcessorStats> GetStats() const;
+	void ResetStats();
+	FString ToString() const;
+
+private:
+
+	struct FStage
+	{
+		TSharedRef<IVoiceChatProcessor> Processor;
+		uint64 Cycles;
+		int32 NumBlocks;
+		int64 NumFrames;
+	};
+
+	TArray<FStage> Stages;
+	int32 SampleRate;
+	int32 NumChannels;
+};
+
+/**
+ * Second order Butterworth high-pass filter, removing rumble, handling noise and DC offset below the voice band.
+ * The recursion runs per sample in float, the conversions around it are vectorized.
+ */
+class UE4VOICECHAT_API FVoiceChatHighPassFilter : public IVoiceChatProcessor
+{
+public:
+
+	explicit FVoiceChatHighPassFilter(float InCutoffHz = 80.0f);
+
+	virtual const TCHAR* GetName() const override { return TEXT("HighPass"); }
+	virtual void Configure(int32 SampleRate, int32 InNumChannels) override;
+	virtual void Process(int16* Samples, int32 NumFrames) override;
+
+private:
+
+	float CutoffHz;
+	int32 NumChannels;
+	/** Normalized biquad coefficients */
+	float B0, B1, B2, A1, A2;
+	/** Transposed direct form II state, two values per channel */
+	TArray<float> State;
+	TArray<float> Scratch;
+};
+
+/**
+ * Fixed size sub-blocks over which the level driven stages measure and change their gain, so their time constants
+ * do not depend on how much audio a tick captured.
+ */
+class UE4VOICECHAT_API FVoiceChatBlockProcessor : public IVoiceChatProcessor
+{
+public:
+
+	virtual void Configure(int32 InSampleRate, int32 InNumChannels) override;
+	virtual void Process(int16* Samples, int32 NumFrames) override;
+
+protected:
+
+	/** Gain to reach by the end of a sub-block, the gain ramps there from the previous one */
+	virtual float ComputeGain(const int16* Samples, int32 NumSamples) = 0;
+
+	/** RMS level of the samples in dBFS */
+	static float ComputeLevelDb(const int16* Samples, int32 NumSamples);
+	/** Duration of NumSamples interleaved samples */
+	float GetDurationMs(int32 NumSamples) const { return NumSamples * 1000.0f / (NumChannels * SampleRate); }
+
+	int32 SampleRate = 48000;
+	int32 NumChannels = 1;
+	/** Gain at the end of the last sub-block */
+	float Gain = 1.0f;
+};
+
+/**
+ * Automatic gain control: slowly steers the speech level towards a target so quiet and loud talkers come out alike.
+ * Audio below the floor is treated as a pause and leaves the gain alone instead of raising the noise.
+ */
+class UE4VOICECHAT_API FVoiceChatAutomaticGain : public FVoiceChatBlockProcessor
+{
+public:
+
+	explicit FVoiceChatAutomaticGain(float InTargetDb = -20.0f, float InMaxGainDb = 24.0f, float InFloorDb = -50.0f);
+
+	virtual const TCHAR* GetName() const override { return TEXT("AutomaticGain"); }
+	virtual void Configure(int32 InSampleRate, int32 InNumChannels) override;
+
+	float GetGainDb() const { return GainDb; }
+
+protected:
+
+	virtual float ComputeGain(const int16* Samples, int32 NumSamples) override;
+
+private:
+
+	float TargetDb;
+	float MaxGainDb;
+	float FloorDb;
+	float GainDb = 0.0f;
+};
+
+/** Attenuates audio while its level stays below the threshold, opening fast and closing after a hold time */
+class UE4VOICECHAT_API FVoiceChatNoiseGate : public FVoiceChatBlockProcessor
+{
+public:
+
+	explicit FVoiceChatNoiseGate(float InThresholdDb = -50.0f, float InHoldMs = 150.0f, float InReleaseMs = 100.0f, float InAttenuationDb = -40.0f);
+
+	virtual const TCHAR* GetName() const override { return TEXT("NoiseGate"); }
+	virtual void Configure(int32 InSampleRate, int32 InNumChannels) override;
+
+	bool IsOpen() const { return HoldRemainingMs > 0.0f; }
+
+protected:
+
+	virtual float ComputeGain(const int16* Samples, int32 NumSamples) override;
+
+private:
+
+	float ThresholdDb;
+	float HoldMs;
+	float ReleaseMs;
+	float ClosedGain;
+	float HoldRemainingMs = 0.0f;
+};
+
+/**
+ * Keeps peaks under the ceiling. The gain drops at the start of the sub-block holding a peak and recovers over the
+ * release time. Without lookahead the drop is a step, which the limiter only takes on peaks that would distort anyway.
+ */
+class UE4VOICECHAT_API FVoiceChatLimiter : public FVoiceChatBlockProcessor
+{
+public:
+
+	explicit FVoiceChatLimiter(float InCeilingDb = -1.0f, float InReleaseMs = 80.0f);
+
+	virtual const TCHAR* GetName() const override { return TEXT("Limiter"); }
+
+protected:
+
+	virtual float ComputeGain(const int16* Samples, int32 NumSamples) override;
+
+private:
+
+	float Ceiling;
+	float ReleaseMs;
+};
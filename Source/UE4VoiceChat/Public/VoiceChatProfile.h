@@ -0,0 +1,48 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoiceModule.h"
+#include "VoiceChatProfile.generated.h"
+
+/**
+ * Format audio is encoded and sent in. Capture and playback stay at the device format, audio is converted on the way
+ * in and out of the codec. Every component of a session must use the same profile.
+ */
+UENUM(BlueprintType)
+enum class EVoiceChatProfile : uint8
+{
+	/** 48 kHz stereo tuned for general audio, the most CPU, memory and bandwidth */
+	Stereo48k UMETA(DisplayName = "48 kHz Stereo"),
+	/** 24 kHz mono tuned for speech */
+	Mono24k UMETA(DisplayName = "24 kHz Mono Voice"),
+	/** 16 kHz mono tuned for speech, the cheapest */
+	Mono16k UMETA(DisplayName = "16 kHz Mono Voice"),
+};
+
+/** Codec settings of a profile */
+struct FVoiceChatCodecFormat
+{
+	int32 SampleRate;
+	int32 NumChannels;
+	EAudioEncodeHint EncodeHint;
+
+	static FVoiceChatCodecFormat FromProfile(EVoiceChatProfile Profile)
+	{
+		switch (Profile)
+		{
+		case EVoiceChatProfile::Mono24k:
+			return { 24000, 1, EAudioEncodeHint::VoiceEncode_Voice };
+		case EVoiceChatProfile::Mono16k:
+			return { 16000, 1, EAudioEncodeHint::VoiceEncode_Voice };
+		default:
+			return { 48000, 2, EAudioEncodeHint::VoiceEncode_Audio };
+		}
+	}
+};
+
+/** Capture and playback device format, independent of the profile */
+#define VOICE_DEVICE_SAMPLE_RATE 48000
+#define VOICE_DEVICE_NUM_CHANNELS 2
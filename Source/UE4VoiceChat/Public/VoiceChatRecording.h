@@ -0,0 +1,154 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Atomic.h"
+#include "Async/TaskGraphInterfaces.h"
+
+class IFileHandle;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * Voice recording file layout, all fields little endian:
+ *
+ * Header:  [Magic u32][Version u16][NumChannels u16][SampleRate u32]
+ * Records: [Type u8][TimeMs u32] followed by
+ *          Packet: [SpeakerId i32][Size u16][NumChannels u8][SampleRate u32][packet, header included]
+ *          Index:  [PreviousIndexOffset u64], written every second, chaining back to the first one
+ * Trailer: [LastIndexOffset u64][Magic u32], only present once the recording was closed
+ *
+ * TimeMs is the time since the recording started. Packets are stored exactly as sent, along with the codec format
+ * they decode at, so components using different voice profiles can share a recording. The header format is the one
+ * DecodeRange produces. Version 1 recordings have no per packet format, all their packets are in the header format.
+ * A recording is about the size of the voice traffic itself. A recording cut short by a crash is still readable, the reader then rebuilds
+ * the index by scanning the records instead of following the chain back from the trailer.
+ */
+enum class EVoiceChatRecordType : uint8
+{
+	Packet = 1,
+	Index = 2,
+};
+
+/** A packet read back from a recording, Data points into the mapped file */
+struct FVoiceChatRecordedPacket
+{
+	int32 SpeakerId;
+	/** Time since the recording started */
+	uint32 TimeMs;
+	/** Codec format the packet decodes at */
+	int32 SampleRate;
+	int32 NumChannels;
+	/** The packet as sent, FVoiceChatPacketHeader included */
+	TArrayView<const uint8> Data;
+};
+
+/**
+ * Appends compressed voice packets to a recording file. Records are gathered in memory and written out by background
+ * tasks, one at a time and in order, so recording never blocks on the disk. Thread safe.
+ */
+class UE4VOICECHAT_API FVoiceChatRecorder
+{
+public:
+
+	FVoiceChatRecorder();
+	~FVoiceChatRecorder();
+
+	/** Start a new recording, replacing Filename. The format is the one the recording decodes to, see FVoiceChatRecordingReader::DecodeRange. */
+	bool Open(const FString& Filename, int32 SampleRate, int32 NumChannels);
+
+	/** Write out everything still buffered, finish the file and wait for the writes to complete */
+	void Close();
+
+	bool IsOpen() const;
+
+	/**
+	 * Append a packet as sent or received, stamped with the time since Open
+	 *
+	 * @param SampleRate codec format the packet decodes at, the recording component's voice profile
+	 */
+	void RecordPacket(int32 SpeakerId, TArrayView<const uint8> Packet, int32 SampleRate, int32 NumChannels);
+
+private:
+
+	void AppendIndex(uint32 TimeMs);
+	/** Hand the buffered records to a write task chained behind the previous one */
+	void WriteBuffer();
+
+	mutable FCriticalSection Lock;
+	IFileHandle* FileHandle;
+	/** Records not handed to a write task yet */
+	TArray<uint8> Buffer;
+	/** Last write task, every write waits for the previous one */
+	FGraphEventRef LastWrite;
+	/** File size once every buffered record is written */
+	uint64 FileSize;
+	uint64 LastIndexOffset;
+	uint32 NextIndexTimeMs;
+	double StartTime;
+	TAtomic<bool> bWriteFailed;
+};
+
+/**
+ * Reads a recording through a memory mapping, so only the parts of the file actually looked at are loaded.
+ * Packets can be visited or decoded over any time range, e.g. to replay them through
+ * UVoiceChatComponent::PlayVoiceChatAudioFromSender or to export a speaker's audio for a report.
+ */
+class UE4VOICECHAT_API FVoiceChatRecordingReader
+{
+public:
+
+	FVoiceChatRecordingReader();
+	~FVoiceChatRecordingReader();
+
+	bool Open(const FString& Filename);
+	void Close();
+
+	int32 GetSampleRate() const { return SampleRate; }
+	int32 GetNumChannels() const { return NumChannels; }
+	/** Time of the last record */
+	uint32 GetDurationMs() const { return DurationMs; }
+
+	/** Visit every packet recorded in [StartMs, EndMs), in recording order */
+	void ForEachPacket(uint32 StartMs, uint32 EndMs, TFunctionRef<void(const FVoiceChatRecordedPacket&)> Visitor) const;
+
+	/**
+	 * Decode [StartMs, EndMs) to interleaved PCM in the recording's format, GetSampleRate and GetNumChannels. Every
+	 * packet is decoded in its own format and converted, and placed at the time it was recorded, time nobody spoke stays silent.
+	 *
+	 * @param SpeakerId speaker to decode, INDEX_NONE mixes every speaker
+	 * @return false if no decoder could be created
+	 */
+	bool DecodeRange(uint32 StartMs, uint32 EndMs, int32 SpeakerId, TArray<int16>& OutSamples);
+
+private:
+
+	struct FIndexEntry
+	{
+		uint32 TimeMs;
+		int64 Offset;
+	};
+
+	/** Size of the record starting at Offset, 0 if it is truncated or malformed */
+	int64 GetRecordSize(int64 Offset) const;
+	/** Follow the index chain back from the trailer, or scan every record if the recording was not closed */
+	void BuildIndex();
+
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+	/** File contents when the platform cannot map files */
+	TArray<uint8> FileData;
+	const uint8* Data;
+	int64 DataSize;
+	/** End of the last complete record */
+	int64 RecordsEnd;
+	/** Size of a packet record without the packet, depends on the version */
+	int64 PacketRecordSize;
+
+	int32 SampleRate;
+	int32 NumChannels;
+	uint32 DurationMs;
+	TArray<FIndexEntry> Index;
+};
@@ -0,0 +1,106 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoiceChatPacket.h"
+
+/** Called for every receiver a packet is relayed to. The packet is shared by all receivers and must not be modified. */
+DECLARE_DELEGATE_TwoParams(FOnVoiceChatRelayPacket, int32 /*SenderId*/, const FVoiceChatPacketRef& /*Packet*/);
+
+/**
+ * Forwards compressed packets from one participant to every other relevant participant, without decoding them.
+ *
+ * A packet is copied once into a pooled buffer on arrival and that same buffer is handed to every receiver, so fanning
+ * out to N receivers costs N delegate calls and no copies. A receiver only gets packets sent on a channel it is
+ * subscribed to, a single bit test whatever the number of channels. Relevancy is then a distance check between sender
+ * and receiver locations, which can differ per channel, optionally refined by a custom filter. The channel byte comes
+ * from the sender, so packets on a channel the sender may not send on, e.g. another team's, are rejected.
+ * Not thread safe, call from the game thread.
+ */
+class UE4VOICECHAT_API FVoiceChatRelay
+{
+public:
+
+	FVoiceChatRelay();
+
+	/** Add or replace a participant, Sink receives the packets relayed to it */
+	void AddParticipant(int32 ParticipantId, const FOnVoiceChatRelayPacket& Sink);
+	void RemoveParticipant(int32 ParticipantId);
+	void SetParticipantLocation(int32 ParticipantId, const FVector& Location);
+
+	/** Replace the channels a participant receives, bit N subscribes to channel N. Participants start out subscribed to every channel. */
+	void SetParticipantChannels(int32 ParticipantId, FVoiceChatChannelMask Channels);
+	/** Channels a participant receives, none if it is not a participant */
+	FVoiceChatChannelMask GetParticipantChannels(int32 ParticipantId) const;
+	/** Replace the channels a participant may send on, its packets on any other are not relayed. Participants start out allowed every channel. */
+	void SetParticipantSendChannels(int32 ParticipantId, FVoiceChatChannelMask Channels);
+	/** Channels a participant may send on, none if it is not a participant */
+	FVoiceChatChannelMask GetParticipantSendChannels(int32 ParticipantId) const;
+
+	/** Receivers further than this from the sender are skipped, 0 relays to everybody */
+	void SetRelevancyDistance(float Distance);
+	/**
+	 * Relevancy distance of one channel, e.g. a proximity channel among team wide ones.
+	 * 0 relays to every subscriber, a negative distance goes back to the SetRelevancyDistance one.
+	 */
+	void SetChannelRelevancyDistance(uint8 Channel, float Distance);
+	/**
+	 * Most the relay should send out in total, in bits per second, 0 for no limit. The relay does not drop anything
+	 * itself: talkers are asked to fit their share through GetTalkerBitrateBudget.
+	 */
+	void SetBandwidthBudget(int32 BitsPerSecond) { BandwidthBudget = FMath::Max(BitsPerSecond, 0); }
+	/**
+	 * Bitrate every talker may use for the relayed traffic to stay within the bandwidth budget, given how many
+	 * receivers the talkers of the last second were relayed to. 0 without a budget.
+	 */
+	int32 GetTalkerBitrateBudget() const;
+
+	/** Extra check run for every sender/receiver pair passing the distance check, e.g. teams or channels */
+	void SetRelevancyFilter(TFunction<bool(int32 SenderId, int32 ReceiverId)> InFilter);
+
+	/** Copy received data into a pooled packet that can be relayed */
+	FVoiceChatPacketRef AcquirePacket(TArrayView<const uint8> Data);
+
+	/**
+	 * Hand Packet to every relevant participant other than the sender. The receivers are picked before any sink runs,
+	 * sinks may add or remove participants: a receiver removed by an earlier sink is skipped, one added only gets the next packet.
+	 *
+	 * @return number of receivers the packet was relayed to, 0 for packets with an invalid channel or one the sender may not send on
+	 */
+	int32 Relay(int32 SenderId, const FVoiceChatPacketRef& Packet);
+
+	int32 GetNumParticipants() const { return Participants.Num(); }
+
+	/** Remove every participant and the filter, release pooled packets */
+	void Empty();
+
+private:
+
+	struct FParticipant
+	{
+		int32 Id;
+		FVector Location;
+		FOnVoiceChatRelayPacket Sink;
+		FVoiceChatChannelMask Channels;
+		FVoiceChatChannelMask SendChannels;
+		/** When the participant last talked, and to how many receivers */
+		double LastRelayTime;
+		int32 LastNumReceivers;
+	};
+
+	/** Kept dense so relaying a packet walks a contiguous array */
+	TArray<FParticipant> Participants;
+	TMap<int32, int32> ParticipantIndices;
+	/** IDs of the receivers picked by Relay, kept between packets so relaying does not allocate */
+	TArray<int32> PendingReceivers;
+
+	float RelevancyDistanceSquared;
+	/** Per channel override of RelevancyDistanceSquared, negative when there is none */
+	float ChannelDistanceSquared[VOICE_MAX_CHANNELS];
+	TFunction<bool(int32, int32)> Filter;
+	int32 BandwidthBudget;
+
+	FVoiceChatPacketPool PacketPool;
+};
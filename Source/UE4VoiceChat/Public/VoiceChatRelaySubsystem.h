@@ -0,0 +1,90 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "VoiceChatRelay.h"
+#include "VoiceChatRelaySubsystem.generated.h"
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnVoiceChatAudioRelayed, int32, ReceiverId, int32, SenderId, const TArray<uint8>&, VoiceData);
+
+/**
+ * Server side voice routing. Clients send the packets from OnAudioCaptureCompleted to the server, which hands them
+ * to RelayVoiceAudio. The relay forwards them untouched to every relevant participant, where they go back to the
+ * clients and into PlayVoiceChatAudioFromSender. No codec is ever created on the server.
+ *
+ * Participants added from Blueprint receive their packets through OnAudioRelayed, native code can give every
+ * participant its own sink through GetRelay().
+ */
+UCLASS()
+class UE4VOICECHAT_API UVoiceChatRelaySubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Deinitialize() override;
+
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Relay")
+		void AddParticipant(int32 ParticipantId);
+
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Relay")
+		void RemoveParticipant(int32 ParticipantId);
+
+	/** Update where a participant is for the relevancy check, typically its pawn location */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Relay")
+		void SetParticipantLocation(int32 ParticipantId, FVector Location);
+
+	/** Receivers further than this from the sender do not get its packets, 0 relays to everybody */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Relay")
+		void SetRelevancyDistance(float Distance);
+
+	/** Relay packets sent on Channel to the participant. Participants start out subscribed to every channel. */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Relay")
+		void SubscribeParticipant(int32 ParticipantId, int32 Channel);
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Relay")
+		void UnsubscribeParticipant(int32 ParticipantId, int32 Channel);
+	/**
+	 * Let the participant send on Channel. Participants start out allowed every channel, disallow team or admin channels
+	 * for those not in them: the channel of a packet is picked by the client, its packets on such channels are dropped.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Relay")
+		void AllowParticipantToSend(int32 ParticipantId, int32 Channel);
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Relay")
+		void DisallowParticipantToSend(int32 ParticipantId, int32 Channel);
+	/** Relevancy distance of one channel, 0 relays to every subscriber and a negative distance uses SetRelevancyDistance's */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Relay")
+		void SetChannelRelevancyDistance(int32 Channel, float Distance);
+
+	/** Most the relay should send out in total, in bits per second, 0 for no limit */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Relay")
+		void SetBandwidthBudget(int32 BitsPerSecond);
+	/** Share of the bandwidth budget of every talker, pass it to the talkers' UVoiceChatComponent::SetBitrateBudget */
+	UFUNCTION(BlueprintPure, Category = "VoiceChat|Relay")
+		int32 GetTalkerBitrateBudget() const;
+
+	/**
+	 * Relay a packet received from SenderId to every relevant participant
+	 *
+	 * @return number of receivers
+	 */
+	UFUNCTION(BlueprintCallable, Category = "VoiceChat|Relay")
+		int32 RelayVoiceAudio(int32 SenderId, const TArray<uint8>& VoiceData);
+
+	/** Native counterpart of RelayVoiceAudio for packets already held in a shared buffer */
+	int32 RelayVoicePacket(int32 SenderId, const FVoiceChatPacketRef& Packet);
+
+	/** Called once per receiver of Blueprint participants, VoiceData is the same buffer for every receiver of a packet */
+	UPROPERTY(BlueprintAssignable, Category = "VoiceChat|Relay")
+		FOnVoiceChatAudioRelayed OnAudioRelayed;
+
+	FVoiceChatRelay& GetRelay() { return Relay; }
+
+private:
+
+	void BroadcastRelayed(int32 SenderId, const FVoiceChatPacketRef& Packet, int32 ReceiverId);
+
+	FVoiceChatRelay Relay;
+};
@@ -0,0 +1,305 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Atomic.h"
+
+/**
+ * Fixed capacity, lock-free, single-producer/single-consumer ring buffer.
+ *
+ * Only one thread may push (the producer) and only one thread may pop (the consumer) at a time.
+ * Indices grow monotonically and are masked on access, so the capacity is always rounded up to a power of two.
+ * Neither side ever blocks or moves data that is already in the buffer.
+ *
+ * Push/Pop/Peek copy raw memory and are meant for trivially copyable samples, Enqueue/Dequeue move
+ * single elements and work for any type, e.g. shared pointers.
+ */
+template<typename ElementType>
+class TVoiceChatRingBuffer
+{
+public:
+
+	TVoiceChatRingBuffer()
+		: Mask(0)
+		, ReadIndex(0)
+		, WriteIndex(0)
+		, FlushIndex(0)
+		, FlushCount(0)
+		, AppliedFlushCount(0)
+	{
+	}
+
+	explicit TVoiceChatRingBuffer(uint32 InCapacity)
+		: TVoiceChatRingBuffer()
+	{
+		SetCapacity(InCapacity);
+	}
+
+	/** (Re)allocate the storage, discarding any content. Not thread safe, neither side may be active. */
+	void SetCapacity(uint32 InCapacity)
+	{
+		const uint32 NewCapacity = InCapacity > 0 ? FMath::RoundUpToPowerOfTwo(InCapacity) : 0;
+		Storage.Empty(NewCapacity);
+		Storage.AddDefaulted(NewCapacity);
+		Mask = NewCapacity > 0 ? NewCapacity - 1 : 0;
+
+		ReadIndex.Store(0);
+		WriteIndex.Store(0);
+		FlushIndex.Store(0);
+		FlushCount.Store(0);
+		AppliedFlushCount.Store(0);
+	}
+
+	/** Free the storage. Not thread safe, neither side may be active. */
+	void Release()
+	{
+		SetCapacity(0);
+	}
+
+	/**
+	 * Adopt InStorage, e.g. from a pool, discarding any content. Its size becomes the capacity and must be a power of two.
+	 * Not thread safe, neither side may be active.
+	 */
+	void SetStorage(TArray<ElementType>&& InStorage)
+	{
+		check(InStorage.Num() == 0 || FMath::IsPowerOfTwo(InStorage.Num()));
+		Storage = MoveTemp(InStorage);
+		Mask = Storage.Num() > 0 ? Storage.Num() - 1 : 0;
+
+		ReadIndex.Store(0);
+		WriteIndex.Store(0);
+		FlushIndex.Store(0);
+		FlushCount.Store(0);
+		AppliedFlushCount.Store(0);
+	}
+
+	/** Hand the storage over, e.g. back to a pool, leaving the buffer without capacity. Not thread safe, neither side may be active. */
+	TArray<ElementType> TakeStorage()
+	{
+		TArray<ElementType> Result = MoveTemp(Storage);
+		SetStorage(TArray<ElementType>());
+		return Result;
+	}
+
+	/** Total number of elements the buffer can hold */
+	uint32 Capacity() const
+	{
+		return (uint32)Storage.Num();
+	}
+
+	/** Number of elements currently readable. Safe to call from either side. */
+	uint32 Num() const
+	{
+		return WriteIndex.Load(EMemoryOrder::SequentiallyConsistent) - GetEffectiveReadIndex();
+	}
+
+	/**
+	 * Producer side. Number of elements ever pushed, wrapping at 2^32. Identifies a position in the stream of elements,
+	 * compare positions with a signed difference.
+	 */
+	uint32 GetPushedCount() const
+	{
+		return WriteIndex.Load(EMemoryOrder::SequentiallyConsistent);
+	}
+
+	/** Consumer side. Number of elements ever consumed or flushed, see GetPushedCount. Pending flushes apply on the next consumer call. */
+	uint32 GetPoppedCount() const
+	{
+		return ReadIndex.Load(EMemoryOrder::SequentiallyConsistent);
+	}
+
+	/**
+	 * Number of elements that can currently be pushed. Safe to call from either side.
+	 * Flushed elements only count as free once the consumer has moved past them, it may still be reading them.
+	 */
+	uint32 Space() const
+	{
+		return Capacity() - (WriteIndex.Load(EMemoryOrder::SequentiallyConsistent) - ReadIndex.Load(EMemoryOrder::SequentiallyConsistent));
+	}
+
+	/**
+	 * Producer side. Copies all of InData into the buffer or nothing at all.
+	 *
+	 * @return false if there was not enough space for NumElements
+	 */
+	bool Push(const ElementType* InData, uint32 NumElements)
+	{
+		const uint32 Write = WriteIndex.Load(EMemoryOrder::Relaxed);
+		if (NumElements > Capacity() - (Write - ReadIndex.Load(EMemoryOrder::SequentiallyConsistent)))
+		{
+			return false;
+		}
+
+		const uint32 Start = Write & Mask;
+		const uint32 FirstPart = FMath::Min(NumElements, Capacity() - Start);
+		FMemory::Memcpy(Storage.GetData() + Start, InData, FirstPart * sizeof(ElementType));
+		FMemory::Memcpy(Storage.GetData(), InData + FirstPart, (NumElements - FirstPart) * sizeof(ElementType));
+
+		WriteIndex.Store(Write + NumElements, EMemoryOrder::SequentiallyConsistent);
+		return true;
+	}
+
+	/**
+	 * Producer side. Moves a single element into the buffer.
+	 *
+	 * @return false if the buffer is full
+	 */
+	bool Enqueue(ElementType&& Element)
+	{
+		const uint32 Write = WriteIndex.Load(EMemoryOrder::Relaxed);
+		if (Write - ReadIndex.Load(EMemoryOrder::SequentiallyConsistent) >= Capacity())
+		{
+			return false;
+		}
+
+		Storage[Write & Mask] = MoveTemp(Element);
+		WriteIndex.Store(Write + 1, EMemoryOrder::SequentiallyConsistent);
+		return true;
+	}
+
+	/**
+	 * Consumer side. Moves a single element out of the buffer.
+	 *
+	 * @return false if the buffer is empty
+	 */
+	bool Dequeue(ElementType& OutElement)
+	{
+		const uint32 Read = ApplyFlush();
+		if (WriteIndex.Load(EMemoryOrder::SequentiallyConsistent) == Read)
+		{
+			return false;
+		}
+
+		OutElement = MoveTemp(Storage[Read & Mask]);
+		ReadIndex.Store(Read + 1, EMemoryOrder::SequentiallyConsistent);
+		return true;
+	}
+
+	/**
+	 * Producer side. Asks the consumer to drop everything pushed so far.
+	 * The data is discarded on the next consumer call, Num() reflects the flush immediately. The space it takes is only
+	 * reused once the consumer has acknowledged the flush, so data the consumer got from Peek stays intact until Consume.
+	 */
+	void Flush()
+	{
+		// The index first, a consumer that sees the new count finds this flush point or a later one
+		FlushIndex.Store(WriteIndex.Load(EMemoryOrder::Relaxed), EMemoryOrder::SequentiallyConsistent);
+		FlushCount.Store(FlushCount.Load(EMemoryOrder::Relaxed) + 1, EMemoryOrder::SequentiallyConsistent);
+	}
+
+	/**
+	 * Consumer side. Exposes the readable elements as at most two contiguous regions without copying them.
+	 * Call Consume() once the data has been used.
+	 *
+	 * @return total number of readable elements (OutFirstNum + OutSecondNum)
+	 */
+	uint32 Peek(const ElementType*& OutFirst, uint32& OutFirstNum, const ElementType*& OutSecond, uint32& OutSecondNum)
+	{
+		const uint32 Read = ApplyFlush();
+		const uint32 Available = WriteIndex.Load(EMemoryOrder::SequentiallyConsistent) - Read;
+
+		const uint32 Start = Read & Mask;
+		OutFirstNum = FMath::Min(Available, Capacity() - Start);
+		OutSecondNum = Available - OutFirstNum;
+		OutFirst = Storage.GetData() + Start;
+		OutSecond = Storage.GetData();
+		return Available;
+	}
+
+	/**
+	 * Consumer side. Releases NumElements previously returned by Peek() back to the producer.
+	 * A flush published since the Peek discards the consumed range and everything before the flush point.
+	 */
+	void Consume(uint32 NumElements)
+	{
+		// Only the consumer moves the read index, so it still is the one Peek read from
+		const uint32 Read = ReadIndex.Load(EMemoryOrder::Relaxed);
+		check(NumElements <= WriteIndex.Load(EMemoryOrder::SequentiallyConsistent) - Read);
+		AdvanceReadIndex(Read + NumElements);
+	}
+
+	/**
+	 * Consumer side. Copies up to MaxElements into OutData and releases them.
+	 *
+	 * @return number of elements copied
+	 */
+	uint32 Pop(ElementType* OutData, uint32 MaxElements)
+	{
+		const ElementType* First;
+		const ElementType* Second;
+		uint32 FirstNum, SecondNum;
+		Peek(First, FirstNum, Second, SecondNum);
+
+		const uint32 FromFirst = FMath::Min(MaxElements, FirstNum);
+		const uint32 FromSecond = FMath::Min(MaxElements - FromFirst, SecondNum);
+		FMemory::Memcpy(OutData, First, FromFirst * sizeof(ElementType));
+		FMemory::Memcpy(OutData + FromFirst, Second, FromSecond * sizeof(ElementType));
+
+		Consume(FromFirst + FromSecond);
+		return FromFirst + FromSecond;
+	}
+
+private:
+
+	/**
+	 * Is Flush a flush point to honour with the read index at Read: inside the readable range and not Read itself.
+	 * Anything else is a flush point already applied, which the indices may have wrapped around to since.
+	 */
+	bool IsFlushAhead(uint32 Read, uint32 Flush) const
+	{
+		const uint32 Skipped = Flush - Read;
+		return Skipped > 0 && Skipped <= WriteIndex.Load(EMemoryOrder::SequentiallyConsistent) - Read;
+	}
+
+	/** Read index with any pending flush applied, without modifying it */
+	uint32 GetEffectiveReadIndex() const
+	{
+		// The counts before the read index, a flush the consumer applies meanwhile then already shows in the index
+		const bool bFlushPending = FlushCount.Load(EMemoryOrder::SequentiallyConsistent) != AppliedFlushCount.Load(EMemoryOrder::SequentiallyConsistent);
+		const uint32 Read = ReadIndex.Load(EMemoryOrder::SequentiallyConsistent);
+		const uint32 Flush = FlushIndex.Load(EMemoryOrder::SequentiallyConsistent);
+		return bFlushPending && IsFlushAhead(Read, Flush) ? Flush : Read;
+	}
+
+	/** Consumer side. Moves the read index to Read, or past a flush published since the last one applied, and returns it. */
+	uint32 AdvanceReadIndex(uint32 Read)
+	{
+		// The count before the index, a flush published meanwhile is either applied now or seen on the next call
+		const uint32 Count = FlushCount.Load(EMemoryOrder::SequentiallyConsistent);
+		if (Count != AppliedFlushCount.Load(EMemoryOrder::Relaxed))
+		{
+			const uint32 Flush = FlushIndex.Load(EMemoryOrder::SequentiallyConsistent);
+			if (IsFlushAhead(Read, Flush))
+			{
+				Read = Flush;
+			}
+		}
+
+		// The read index before the count, so Num() never sees the flush as applied while the index lags behind
+		ReadIndex.Store(Read, EMemoryOrder::SequentiallyConsistent);
+		AppliedFlushCount.Store(Count, EMemoryOrder::SequentiallyConsistent);
+		return Read;
+	}
+
+	/** Consumer side. Moves the read index past any pending flush and returns it. */
+	uint32 ApplyFlush()
+	{
+		return AdvanceReadIndex(ReadIndex.Load(EMemoryOrder::Relaxed));
+	}
+
+	TArray<ElementType> Storage;
+	uint32 Mask;
+
+	/** Owned by the consumer */
+	TAtomic<uint32> ReadIndex;
+	/** Owned by the producer */
+	TAtomic<uint32> WriteIndex;
+	/** Owned by the producer, honoured by the consumer */
+	TAtomic<uint32> FlushIndex;
+	/** Number of Flush calls, owned by the producer */
+	TAtomic<uint32> FlushCount;
+	/** FlushCount the consumer last applied, owned by the consumer. Flush points are only honoured while the two differ. */
+	TAtomic<uint32> AppliedFlushCount;
+};
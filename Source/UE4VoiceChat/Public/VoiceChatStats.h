@@ -0,0 +1,63 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "VoiceModule.h"
+
+/**
+ * Per packet / per tick debug logging of the capture and playback paths.
+ * Compiled out unless the module is built with VOICECHAT_DEBUG_OUTPUT=1 (see UE4VoiceChat.Build.cs).
+ */
+#ifndef VOICECHAT_DEBUG_OUTPUT
+#define VOICECHAT_DEBUG_OUTPUT 0
+#endif
+
+#if VOICECHAT_DEBUG_OUTPUT
+#define VOICECHAT_DEBUG_LOG(Format, ...) UE_LOG(LogVoice, Verbose, Format, ##__VA_ARGS__)
+#else
+#define VOICECHAT_DEBUG_LOG(Format, ...)
+#endif
+
+DECLARE_STATS_GROUP(TEXT("VoiceChat"), STATGROUP_VoiceChat, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Tick"), STAT_VoiceChat_Tick, STATGROUP_VoiceChat, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Capture"), STAT_VoiceChat_Capture, STATGROUP_VoiceChat, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Processing"), STAT_VoiceChat_Processing, STATGROUP_VoiceChat, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Encode"), STAT_VoiceChat_Encode, STATGROUP_VoiceChat, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Decode"), STAT_VoiceChat_Decode, STATGROUP_VoiceChat, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Queue"), STAT_VoiceChat_Queue, STATGROUP_VoiceChat, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("GenerateData"), STAT_VoiceChat_GenerateData, STATGROUP_VoiceChat, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Mix"), STAT_VoiceChat_Mix, STATGROUP_VoiceChat, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Relay"), STAT_VoiceChat_Relay, STATGROUP_VoiceChat, );
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes Captured"), STAT_VoiceChat_BytesCaptured, STATGROUP_VoiceChat, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes Encoded"), STAT_VoiceChat_BytesEncoded, STATGROUP_VoiceChat, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes Queued"), STAT_VoiceChat_BytesQueued, STATGROUP_VoiceChat, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Relayed Packets"), STAT_VoiceChat_RelayedPackets, STATGROUP_VoiceChat, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Rejected Packets"), STAT_VoiceChat_RejectedPackets, STATGROUP_VoiceChat, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Culled Packets"), STAT_VoiceChat_CulledPackets, STATGROUP_VoiceChat, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Starved Samples"), STAT_VoiceChat_StarvedSamples, STATGROUP_VoiceChat, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Queue Underflows"), STAT_VoiceChat_Underflows, STATGROUP_VoiceChat, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Queue Overflows"), STAT_VoiceChat_Overflows, STATGROUP_VoiceChat, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Mixed Talkers"), STAT_VoiceChat_MixedTalkers, STATGROUP_VoiceChat, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Pool Allocations"), STAT_VoiceChat_PoolAllocations, STATGROUP_VoiceChat, );
+
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Component Buffers"), STAT_VoiceChat_ComponentMemory, STATGROUP_VoiceChat, );
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Scratch Arenas"), STAT_VoiceChat_ScratchMemory, STATGROUP_VoiceChat, );
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Queue Pool"), STAT_VoiceChat_QueueMemory, STATGROUP_VoiceChat, );
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Queue Pool Idle"), STAT_VoiceChat_QueueMemoryIdle, STATGROUP_VoiceChat, );
+
+namespace VoiceChatStats
+{
+	/**
+	 * Note that a packet pool, scratch arena or queue pool had to allocate instead of reusing a buffer. Counted in the
+	 * Pool Allocations stat and per thread, a warmed up pipeline should not allocate at all.
+	 */
+	UE4VOICECHAT_API void CountPoolAllocation();
+
+	/** Pool allocations made on the calling thread so far */
+	UE4VOICECHAT_API uint64 GetThreadPoolAllocations();
+}
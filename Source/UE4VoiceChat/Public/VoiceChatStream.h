@@ -0,0 +1,129 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/ThreadSafeBool.h"
+#include "VoiceModule.h"
+#include "VoiceChatJitterBuffer.h"
+#include "VoiceChatRingBuffer.h"
+#include "VoiceChatFormatConverter.h"
+#include "VoiceChatLatency.h"
+
+/**
+ * Receive side of a single talker: packets go into a jitter buffer and come out decoded into a playback queue
+ * owned by the caller. The decoder is injected so it can be shared with, or recycled from, other users.
+ *
+ * Packets the jitter buffer gives up on are recovered from the redundant copy carried by the next packet when
+ * the sender provides one, otherwise concealed by repeating the last decoded audio with a fade out.
+ */
+class FVoiceChatStream
+{
+public:
+
+	FVoiceChatStream();
+
+	/**
+	 * Attach a decoder and configure the jitter buffer. Resets the stream.
+	 *
+	 * @param InDecoder decoder for this talker's packets, must not be fed packets of other talkers
+	 * @param InSampleRate decoder output sample rate
+	 * @param InNumChannels decoder output channel count
+	 * @param InOutputSampleRate sample rate of the playback queue, decoded audio is resampled if it differs
+	 * @param InOutputNumChannels channel count of the playback queue, decoded audio is up or downmixed if it differs
+	 */
+	void Init(const TSharedPtr<IVoiceDecoder>& InDecoder, int32 InSampleRate, int32 InNumChannels, int32 InOutputSampleRate, int32 InOutputNumChannels, float MinDelayMs, float MaxDelayMs, float MaxLatencyMs);
+
+	/** Release the decoder and buffers */
+	void Shutdown();
+
+	/** Drop buffered packets and reset the decoder state, e.g. after the stream was not received for a while */
+	void Reset();
+
+	/**
+	 * Parse a received packet and add it to the jitter buffer
+	 *
+	 * @return false if the packet was malformed, late or a duplicate
+	 */
+	bool InsertPacket(TArrayView<const uint8> Packet, double ArrivalTime);
+
+	/**
+	 * Decode every packet the jitter buffer releases into Output
+	 *
+	 * @param Output producer side of the playback queue for this talker
+	 * @param QueuedMs decoded audio of this talker already waiting to be played, in Output and further downstream
+	 */
+	void Service(TVoiceChatRingBuffer<uint8>& Output, float QueuedMs);
+
+	/**
+	 * Where to report traced packets as they are decoded, with their position in the Output of Service.
+	 * The producer side is used from the thread calling Service. nullptr, the default, ignores traces.
+	 */
+	void SetLatencyMarks(TVoiceChatRingBuffer<FVoiceChatLatencyMark>* InLatencyMarks) { LatencyMarks = InLatencyMarks; }
+
+	/**
+	 * Keep the jitter buffer at its target depth when sender and receiver clocks drift apart, on by default.
+	 * Small excess is corrected by playing slightly faster or slower, excess beyond ToleranceMs additionally skips quiet frames.
+	 */
+	void SetDriftCompensation(bool bEnable, float ToleranceMs);
+
+	/** Synthesize audio for lost packets instead of leaving a gap, on by default */
+	void SetLossConcealment(bool bEnable) { bConcealLoss = bEnable; }
+
+	/** Is the talker between talk spurts: nothing decoded since Init or Reset, or a silence marker since its last audio. Safe to call from any thread. */
+	bool IsSilent() const { return bSilent; }
+
+	const TSharedPtr<IVoiceDecoder>& GetDecoder() const { return Decoder; }
+	FVoiceChatJitterBufferStats GetStats() const;
+	float GetTargetDelayMs() const { return JitterBuffer.GetTargetDelayMs(); }
+
+private:
+
+	/** Convert decoded audio to the output format and push it into Output, dropping it entirely if it does not fit. Returns the bytes queued. */
+	uint32 Enqueue(TVoiceChatRingBuffer<uint8>& Output, const uint8* Data, uint32 Size);
+	/** Decode Compressed into DecodeBuffer, returns the decoded size in bytes */
+	uint32 Decode(TArrayView<const uint8> Compressed);
+	/** Fill DecodeBuffer with NumSamples samples per channel continuing the last decoded audio, returns the size in bytes */
+	uint32 Conceal(int32 NumSamples);
+	/** Follow the audio buffered in the jitter buffer and the QueuedMs downstream of it and adjust the playout rate */
+	void UpdateDrift(double Now, float QueuedMs);
+	/** Is decoded audio of Size bytes in DecodeBuffer quiet enough to be skipped unnoticed */
+	bool IsQuiet(uint32 Size) const;
+
+	TSharedPtr<IVoiceDecoder> Decoder;
+	FVoiceChatJitterBuffer JitterBuffer;
+	/** Compressed payload released by the jitter buffer, reused between packets */
+	TArray<uint8> Payload;
+	/** Decoder output, approx 1 sec worth of data borrowed from the scratch arena for the duration of Service */
+	TArrayView<uint8> DecodeBuffer;
+	/** Last decoded packet, the source of concealment */
+	TArray<int16> LastDecoded;
+	/** Consecutive frames concealed so far, each one is quieter than the previous */
+	int32 NumConcealed;
+	bool bConcealLoss;
+
+	int32 ConcealedCount;
+	int32 RecoveredCount;
+
+	TVoiceChatRingBuffer<FVoiceChatLatencyMark>* LatencyMarks;
+
+	bool bCompensateDrift;
+	float DriftToleranceMs;
+	/** Smoothed audio buffered above the target, in the jitter buffer and queued downstream, in milliseconds */
+	float DriftExcessMs;
+	/** Duration of the last released packet, the queue is topped up by this much at a time */
+	float DriftFrameMs;
+	double LastDriftUpdate;
+	int32 SkippedCount;
+
+	/** Decoder output to playback queue format */
+	FVoiceChatFormatConverter Converter;
+	TArray<int16> Converted;
+
+	int32 SampleRate;
+	int32 NumChannels;
+	int32 OutputSampleRate;
+
+	FThreadSafeBool bSilent;
+};
@@ -0,0 +1,50 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Interfaces/VoiceCapture.h"
+
+/**
+ * IVoiceCapture producing a synthetic voice-like signal instead of reading a microphone.
+ *
+ * Audio only becomes available when Advance is called, so the caller controls the capture clock. Hand it to
+ * UVoiceChatComponent::InitVoiceCapture to run the send path without audio hardware, e.g. in benchmarks.
+ */
+class UE4VOICECHAT_API FVoiceChatSyntheticCapture : public IVoiceCapture
+{
+public:
+
+	FVoiceChatSyntheticCapture(int32 InSampleRate, int32 InNumChannels);
+
+	/** Make NumFrames more frames available to GetVoiceData, capped at GetBufferSize */
+	void Advance(int32 NumFrames);
+
+	virtual bool Init(const FString& DeviceName, int32 InSampleRate, int32 InNumChannels) override;
+	virtual void Shutdown() override;
+	virtual bool Start() override;
+	virtual void Stop() override;
+	virtual bool ChangeDevice(const FString& DeviceName, int32 InSampleRate, int32 InNumChannels) override;
+	virtual bool IsCapturing() override { return bCapturing; }
+	virtual EVoiceCaptureState::Type GetCaptureState(uint32& OutAvailableVoiceData) const override;
+	virtual EVoiceCaptureState::Type GetVoiceData(uint8* OutVoiceBuffer, uint32 InVoiceBufferSize, uint32& OutAvailableVoiceData) override;
+	virtual EVoiceCaptureState::Type GetVoiceData(uint8* OutVoiceBuffer, uint32 InVoiceBufferSize, uint32& OutAvailableVoiceData, uint64& OutSampleCounter) override;
+	virtual int32 GetBufferSize() const override;
+	virtual void DumpState() const override;
+	virtual float GetCurrentAmplitude() const override { return bCapturing ? Amplitude : -1.0f; }
+
+private:
+
+	int32 SampleRate;
+	int32 NumChannels;
+	bool bCapturing;
+	/** Generated audio not read yet, interleaved */
+	TArray<int16> Pending;
+	/** Frames generated since Start, drives the waveform and the sample counter */
+	uint64 GeneratedFrames;
+	/** Frames handed out by GetVoiceData */
+	uint64 ReadFrames;
+	/** Envelope of the last generated frame */
+	float Amplitude;
+};
@@ -0,0 +1,54 @@
+// Created by Kaan Buran
+// See https://github.com/Naocum/UE4VoiceChat for documentation and licensing
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Energy / zero crossing voice activity detector with hangover.
+ *
+ * A block is considered speech when its level is above the threshold and its zero crossing rate is low enough
+ * to not be broadband noise, or when it is far enough above the threshold that the crossing rate no longer matters.
+ * Once speech stops the detector stays active for the hangover time so word endings are not clipped.
+ */
+class FVoiceChatVAD
+{
+public:
+
+	FVoiceChatVAD();
+
+	/**
+	 * @param InSampleRate sample rate of the processed PCM
+	 * @param InThresholdDb level in dBFS above which a block may be speech
+	 * @param InHangoverMs how long to stay active after the last speech block
+	 * @param InMaxZeroCrossingRate fraction of sign changes per sample above which a quiet block is treated as noise
+	 */
+	void Configure(int32 InSampleRate, float InThresholdDb, float InHangoverMs, float InMaxZeroCrossingRate);
+
+	/** Return to the inactive state */
+	void Reset();
+
+	/**
+	 * Classify a block of interleaved 16 bit PCM
+	 *
+	 * @return true if the block should be transmitted
+	 */
+	bool Process(const int16* Samples, int32 NumSamples, int32 NumChannels);
+
+	/** Result of the last Process call */
+	bool IsActive() const { return bActive; }
+	/** Level of the last processed block in dBFS */
+	float GetLevelDb() const { return LevelDb; }
+
+private:
+
+	int32 SampleRate;
+	float ThresholdDb;
+	float HangoverMs;
+	float MaxZeroCrossingRate;
+
+	bool bActive;
+	float HangoverRemainingMs;
+	float LevelDb;
+};
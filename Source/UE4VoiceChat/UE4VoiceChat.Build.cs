@@ -13,6 +13,9 @@ public class UE4VoiceChat : ModuleRules
         PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
         bEnableExceptions = false;
 
+        // Set to 1 to log every captured, encoded and received packet (LogVoice Verbose). Keep at 0 outside of debugging, the formatting costs more than the codec.
+        PublicDefinitions.Add("VOICECHAT_DEBUG_OUTPUT=0");
+
         PublicIncludePaths.AddRange(
             new string[] {
 				// ... add public include paths required here ...